@@ -1,36 +1,47 @@
 #include <assert.h>
 #include <errno.h>
-#include <gc.h>
 #include <lib.h>
+#include <private/alloc.h>
 #include <private/ast/debug.h>
 #include <private/ast/expr.h>
+#include <private/alloc_profiler.h>
 #include <private/ast/printer.h>
+#include <private/emit_c.h>
+#include <private/gc_stats.h>
+#include <private/heap_snapshot.h>
+#include <private/inliner.h>
 #include <private/interpreter.h>
+#include <private/jit.h>
 #include <private/parser.h>
 #include <private/scanner.h>
 #include <private/strutils.h>
+#include <private/timing.h>
 #include <private/token.h>
+#include <private/trace.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
 
-bool HadError = false;
-bool HadRuntimeError = false;
-static struct interpreter* interpreter = NULL;
+THREADS_LOCAL bool HadError = false;
+THREADS_LOCAL bool HadRuntimeError = false;
+// 0 until set: as deep as each interpreter's stack allows
+static long MaxCallDepth = 0;
 
 static void report(size_t line, const char* where, const char* message);
+static struct interpreter* library_new_interpreter(void);
+static int library_read_file(const char* filename,
+                             char** contents,
+                             long* length);
+static struct stmt_list* library_parse(const char* text_begin,
+                                       const char* text_end);
 
-static void library_run(const char* text_begin, const char* text_end)
+static void library_run(struct interpreter* interpreter,
+                        const char* text_begin,
+                        const char* text_end)
 {
-  if (!interpreter) {
-    interpreter = interpreter_new();
-  }
-  struct scanner* scanner = scanner_new(text_begin, text_end);
-  struct token_list* tokens = scanner_scan_tokens(scanner);
-  struct parser* parser = parser_new(tokens);
-  struct stmt_list* statements = parser_parse(parser);
+  struct stmt_list* statements = library_parse(text_begin, text_end);
   if (HadError) {
     return;
   }
@@ -43,8 +54,60 @@ static void library_run(const char* text_begin, const char* text_end)
   interpret(interpreter, statements);
 }
 
+static struct stmt_list* library_parse(const char* text_begin,
+                                       const char* text_end)
+{
+  unsigned long long start = timing_now_ns();
+  struct scanner* scanner = scanner_new(text_begin, text_end);
+  struct token_list* tokens = scanner_scan_tokens(scanner);
+  unsigned long long scanned = timing_now_ns();
+  trace_span("scan", "pipeline", start, scanned);
+  struct parser* parser = parser_new(tokens);
+  struct stmt_list* statements = parser_parse(parser);
+  trace_span("parse", "pipeline", scanned, timing_now_ns());
+  return statements;
+}
+
 int library_run_file(const char* filename)
 {
+  char* contents;
+  long length;
+  int ret = library_read_file(filename, &contents, &length);
+  if (ret) {
+    return ret;
+  }
+  library_run(library_new_interpreter(), contents, contents + length);
+
+  if (HadError) {
+    return EX_DATAERR;
+  }
+  if (HadRuntimeError) {
+    return EX_SOFTWARE;
+  }
+  return 0;
+}
+
+int library_emit_c(const char* filename, FILE* out)
+{
+  char* contents;
+  long length;
+  int ret = library_read_file(filename, &contents, &length);
+  if (ret) {
+    return ret;
+  }
+  struct stmt_list* statements = library_parse(contents, contents + length);
+  if (HadError) {
+    return EX_DATAERR;
+  }
+  emit_c(out, statements, filename, MaxCallDepth);
+  return 0;
+}
+
+static int library_read_file(const char* filename,
+                             char** contents_out,
+                             long* length)
+{
+  unsigned long long load_start = timing_now_ns();
   FILE* fp = fopen(filename, "re");
   if (!fp) {
     return EX_NOINPUT;
@@ -61,7 +124,7 @@ int library_run_file(const char* filename)
   }
 
   rewind(fp);
-  char* contents = GC_MALLOC((size_t)eofpos + 1);
+  char* contents = alloc_string((size_t)eofpos);
   if (!contents) {
     fclose(fp);
     fprintf(stderr, "Could not allocate enough memory for file contents\n");
@@ -69,7 +132,7 @@ int library_run_file(const char* filename)
     return EX_OSERR;
   }
 
-  size_t nread = fread(contents, 1, eofpos, fp);
+  size_t nread = alloc_fread(contents, (size_t)eofpos, fp);
   if (nread != (size_t)eofpos) {
     if (feof(fp)) {
       fprintf(stderr,
@@ -89,25 +152,21 @@ int library_run_file(const char* filename)
 
   fclose(fp);
   contents[eofpos] = '\0';
-  library_run(contents, contents + eofpos);
-
-  if (HadError) {
-    return EX_DATAERR;
-  }
-  if (HadRuntimeError) {
-    return EX_SOFTWARE;
-  }
+  trace_span("load", "pipeline", load_start, timing_now_ns());
+  *contents_out = contents;
+  *length = eofpos;
   return 0;
 }
 
 int library_run_prompt()
 {
+  struct interpreter* interpreter = library_new_interpreter();
   while (true) {
     printf("> ");
     fflush(stdout);
     char* line = NULL;
     size_t len;
-    ssize_t ret = getline(&line, &len, stdin);
+    ssize_t ret = getline(&line, &len, stdin);  // outside the heap
     if (ret == -1) {
       assert(errno != EINVAL);
       if (errno == 0) {
@@ -120,7 +179,7 @@ int library_run_prompt()
       return EX_OSERR;
     }
 
-    library_run(line, line + strlen(line));
+    library_run(interpreter, line, line + strlen(line));
 
     HadError = false;
     HadRuntimeError = false;
@@ -151,6 +210,90 @@ void library_runtime_error(struct runtime_error* err)
   HadRuntimeError = true;
 }
 
+bool library_enable_incremental_gc(unsigned long pause_target_ms)
+{
+  return alloc_enable_incremental(pause_target_ms);
+}
+
+void library_enable_gc_stats(void)
+{
+  gc_stats_enable();
+}
+
+struct gc_stats library_gc_stats(void)
+{
+  return gc_stats_get();
+}
+
+void library_print_gc_stats(FILE* fp)
+{
+  gc_stats_fprint(fp);
+}
+
+void library_enable_alloc_profiler(void)
+{
+  alloc_profiler_enable();
+  // an inlined call never enters the profiler, which would charge what the
+  // callee allocates to its caller
+  inliner_set_enabled(false);
+}
+
+void library_print_alloc_profile(FILE* fp)
+{
+  alloc_profiler_fprint(fp);
+}
+
+void library_print_alloc_stacks(FILE* fp)
+{
+  alloc_profiler_fprint_collapsed(fp);
+}
+
+bool library_open_trace(const char* path, unsigned long long call_threshold_ns)
+{
+  return trace_open(path, call_threshold_ns);
+}
+
+void library_close_trace(void)
+{
+  trace_close();
+}
+
+bool library_heap_snapshot_on_signal(int signal_number, const char* path)
+{
+  return heap_snapshot_on_signal(signal_number, path);
+}
+
+void library_set_max_call_depth(long max_call_depth)
+{
+  MaxCallDepth = max_call_depth;
+}
+
+void library_set_max_heap_size(size_t bytes)
+{
+  alloc_set_max_heap_size(bytes);
+}
+
+void library_set_jit_threshold(unsigned long threshold)
+{
+  jit_set_threshold(threshold);
+}
+
+void library_set_inlining(bool enabled)
+{
+  inliner_set_enabled(enabled);
+}
+
+// Each run gets its own interpreter rather than a shared one, so that
+// scripts can be run from several threads in a threaded build.
+static struct interpreter* library_new_interpreter(void)
+{
+  struct interpreter* interpreter = interpreter_new();
+  if (MaxCallDepth > 0) {
+    interpreter_set_max_call_depth(interpreter, MaxCallDepth);
+  }
+  return interpreter;
+}
+
 static void report(size_t line, const char* where, const char* message)
 {
   fprintf(stderr, "[line %zu] Error%s: %s\n", line, where, message);
@@ -1,15 +1,47 @@
 #pragma once
 
+#include <private/alloc_profiler.h>
+#include <private/gc_stats.h>
+#include <private/interpreter.h>
+#include <private/jit.h>
 #include <private/runtime_error.h>
+#include <private/threads.h>
 #include <private/token.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 int library_run_file(const char* filename);
 int library_run_prompt(void);
 void library_error(size_t line, const char* message);
 void library_error_at_token(struct token* token, const char* message);
 void library_runtime_error(struct runtime_error* err);
+void library_enable_gc_stats(void);
+struct gc_stats library_gc_stats(void);
+void library_print_gc_stats(FILE* fp);
+// Makes the collector incremental and generational (with mprotect-based
+// dirty bits on Linux), aiming to keep each pause under the target. Returns
+// false if the platform or the precise collector doesn't support it.
+bool library_enable_incremental_gc(unsigned long pause_target_ms);
+// also turns inlining off, so that each call is profiled as itself
+void library_enable_alloc_profiler(void);
+void library_print_alloc_profile(FILE* fp);
+void library_print_alloc_stacks(FILE* fp);
+bool library_open_trace(const char* path, unsigned long long call_threshold_ns);
+void library_close_trace(void);
+// writes a heap snapshot (see heap_snapshot.h) to path whenever the signal
+// arrives
+bool library_heap_snapshot_on_signal(int signal_number, const char* path);
+// Lowers how deep Lox calls may nest. By default (and at most) that is as
+// deep as the C stack allows; see INTERPRETER_STACK_PER_CALL.
+void library_set_max_call_depth(long max_call_depth);
+// Caps the collector's heap at `bytes`. A script that needs more fails with
+// an 'Out of memory.' runtime error instead of growing the process.
+void library_set_max_heap_size(size_t bytes);
+void library_set_jit_threshold(unsigned long threshold);
+void library_set_inlining(bool enabled);
+// writes the script as a C program (see emit_c.h) instead of running it
+int library_emit_c(const char* filename, FILE* out);
 
-extern bool HadError;
-extern bool HadRuntimeError;
+extern THREADS_LOCAL bool HadError;
+extern THREADS_LOCAL bool HadRuntimeError;
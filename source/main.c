@@ -1,18 +1,230 @@
-#include <gc.h>
 #include <lib.h>
+#include <limits.h>
+#include <private/alloc.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sysexits.h>
 
+#define DEFAULT_TRACE_THRESHOLD_US 100
+#define DEFAULT_GC_PAUSE_TARGET_MS 5
+
+static int usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [options] [script]\n"
+          "Options:\n"
+          "  --gc-stats             print collector statistics at exit\n"
+          "  --gc=MODE              'full' (default) or 'incremental' "
+          "collection\n"
+          "  --gc-pause-target=MS   pause time the incremental collector aims "
+          "for\n"
+          "                         (default %d)\n"
+          "  --profile=alloc        print an allocation profile at exit "
+          "(turns off\n"
+          "                         inlining)\n"
+          "  --profile-out=FILE     write collapsed allocation stacks to FILE\n"
+          "  --trace=FILE           write a Chrome trace-event JSON file\n"
+          "  --heap-snapshot=FILE   write a heap snapshot to FILE on SIGUSR1\n"
+          "  --trace-threshold=US   only trace calls taking at least US "
+          "microseconds\n"
+          "                         (default %d)\n"
+          "  --max-call-depth=N     fail with 'Stack overflow.' past N nested "
+          "calls\n"
+          "                         (default and maximum %ld, one per %d "
+          "bytes of stack)\n"
+          "  --max-heap=SIZE        fail with 'Out of memory.' rather than grow "
+          "the\n"
+          "                         heap past SIZE bytes (K, M or G suffix)\n"
+          "  --emit-c               write the script as a C program to stdout "
+          "instead\n"
+          "                         of running it\n"
+          "  --jit-threshold=N      compile functions to machine code after N "
+          "calls,\n"
+          "                         0 to disable (default %d)\n"
+          "  --no-inline            don't inline small functions at their call "
+          "sites\n",
+          program,
+          DEFAULT_GC_PAUSE_TARGET_MS,
+          DEFAULT_TRACE_THRESHOLD_US,
+          interpreter_default_max_call_depth(),
+          INTERPRETER_STACK_PER_CALL,
+          JIT_DEFAULT_THRESHOLD);
+  return EX_USAGE;
+}
+
+// returns the text after "name=" if arg is of that form, NULL otherwise
+static const char* option_value(const char* arg, const char* name)
+{
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+    return arg + len + 1;
+  }
+  return NULL;
+}
+
+static bool parse_unsigned(const char* text, unsigned long long* out)
+{
+  char* end;
+  *out = strtoull(text, &end, 10);
+  return *text != '\0' && *end == '\0';
+}
+
+// an unsigned number of bytes, optionally followed by K, M or G (powers of
+// 1024)
+static bool parse_size(const char* text, unsigned long long* out)
+{
+  char* end;
+  *out = strtoull(text, &end, 10);
+  if (*text == '\0' || end == text) {
+    return false;
+  }
+  unsigned shift = 0;
+  switch (*end) {
+    case '\0':
+      return true;
+    case 'K':
+      shift = 10;
+      break;
+    case 'M':
+      shift = 20;
+      break;
+    case 'G':
+      shift = 30;
+      break;
+    default:
+      return false;
+  }
+  if (end[1] != '\0' || *out > ULLONG_MAX >> shift) {
+    return false;
+  }
+  *out <<= shift;
+  return true;
+}
+
 int main(int argc, const char* argv[])
 {
-  GC_INIT();
-  if (argc > 2) {
-    fprintf(stderr, "Usage: %s [script]\n", argv[0]);
-    return EX_USAGE;
+  ALLOC_INIT();
+  const char* script = NULL;
+  bool gc_stats = false;
+  bool incremental_gc = false;
+  unsigned long long gc_pause_target_ms = DEFAULT_GC_PAUSE_TARGET_MS;
+  bool alloc_profile = false;
+  const char* profile_out = NULL;
+  const char* trace = NULL;
+  const char* heap_snapshot = NULL;
+  bool emit_c = false;
+  unsigned long long trace_threshold_us = DEFAULT_TRACE_THRESHOLD_US;
+  const char* value;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--gc-stats") == 0) {
+      gc_stats = true;
+    } else if ((value = option_value(argv[i], "--gc"))) {
+      if (strcmp(value, "incremental") == 0) {
+        incremental_gc = true;
+      } else if (strcmp(value, "full") == 0) {
+        incremental_gc = false;
+      } else {
+        return usage(argv[0]);
+      }
+    } else if ((value = option_value(argv[i], "--gc-pause-target"))) {
+      if (!parse_unsigned(value, &gc_pause_target_ms)
+          || gc_pause_target_ms == 0 || gc_pause_target_ms > ULONG_MAX)
+      {
+        return usage(argv[0]);
+      }
+    } else if (strcmp(argv[i], "--emit-c") == 0) {
+      emit_c = true;
+    } else if (strcmp(argv[i], "--profile=alloc") == 0) {
+      alloc_profile = true;
+    } else if ((value = option_value(argv[i], "--profile-out"))) {
+      profile_out = value;
+    } else if ((value = option_value(argv[i], "--trace"))) {
+      trace = value;
+    } else if ((value = option_value(argv[i], "--heap-snapshot"))) {
+      heap_snapshot = value;
+    } else if ((value = option_value(argv[i], "--trace-threshold"))) {
+      if (!parse_unsigned(value, &trace_threshold_us)) {
+        return usage(argv[0]);
+      }
+    } else if ((value = option_value(argv[i], "--max-call-depth"))) {
+      unsigned long long max_call_depth;
+      if (!parse_unsigned(value, &max_call_depth) || max_call_depth == 0
+          || max_call_depth > LONG_MAX)
+      {
+        return usage(argv[0]);
+      }
+      library_set_max_call_depth((long)max_call_depth);
+    } else if ((value = option_value(argv[i], "--max-heap"))) {
+      unsigned long long max_heap;
+      if (!parse_size(value, &max_heap) || max_heap == 0
+          || max_heap > SIZE_MAX)
+      {
+        return usage(argv[0]);
+      }
+      library_set_max_heap_size((size_t)max_heap);
+    } else if ((value = option_value(argv[i], "--jit-threshold"))) {
+      unsigned long long jit_threshold;
+      if (!parse_unsigned(value, &jit_threshold) || jit_threshold > ULONG_MAX)
+      {
+        return usage(argv[0]);
+      }
+      library_set_jit_threshold((unsigned long)jit_threshold);
+    } else if (strcmp(argv[i], "--no-inline") == 0) {
+      library_set_inlining(false);
+    } else if (argv[i][0] == '-' || script) {
+      return usage(argv[0]);
+    } else {
+      script = argv[i];
+    }
+  }
+
+  if (emit_c) {
+    return script ? library_emit_c(script, stdout) : usage(argv[0]);
+  }
+  if (incremental_gc
+      && !library_enable_incremental_gc((unsigned long)gc_pause_target_ms))
+  {
+    fprintf(stderr, "Incremental collection is not supported here\n");
+  }
+  if (gc_stats) {
+    library_enable_gc_stats();
+  }
+  if (alloc_profile) {
+    library_enable_alloc_profiler();
+  }
+  if (trace && !library_open_trace(trace, trace_threshold_us * 1000)) {
+    fprintf(stderr, "Could not open '%s' for writing\n", trace);
+    return EX_CANTCREAT;
+  }
+  if (heap_snapshot
+      && !library_heap_snapshot_on_signal(SIGUSR1, heap_snapshot))
+  {
+    fprintf(stderr, "Could not handle SIGUSR1\n");
+    return EX_OSERR;
+  }
+  int ret = script ? library_run_file(script) : library_run_prompt();
+  library_close_trace();
+  if (gc_stats) {
+    library_print_gc_stats(stderr);
   }
-  if (argc == 2) {
-    return library_run_file(argv[1]);
+  if (alloc_profile) {
+    library_print_alloc_profile(stderr);
+    FILE* fp = profile_out ? fopen(profile_out, "we") : NULL;
+    if (fp) {
+      library_print_alloc_stacks(fp);
+      fclose(fp);
+    } else {
+      if (profile_out) {
+        fprintf(stderr, "Could not open '%s' for writing\n", profile_out);
+      }
+      fprintf(stderr, "--- ALLOC STACKS ---\n");
+      library_print_alloc_stacks(stderr);
+      fprintf(stderr, "--- END ALLOC STACKS ---\n");
+    }
   }
-  return library_run_prompt();
+  return ret;
 }
@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <private/alloc.h>
+#include <string.h>
+
+char* alloc_string(size_t length)
+{
+  char* s = alloc_atomic(length + 1);
+  if (s) {
+    s[0] = '\0';
+    s[length] = '\0';
+  }
+  return s;
+}
+
+char* alloc_strdup(const char* s)
+{
+  size_t length = strlen(s);
+  char* copy = alloc_atomic(length + 1);
+  if (copy) {
+    memcpy(copy, s, length + 1);
+  }
+  return copy;
+}
+
+void alloc_layout_init(struct alloc_layout* layout, size_t size)
+{
+  assert(size <= ALLOC_LAYOUT_MAX_WORDS * sizeof(uintptr_t));
+  memset(layout->bitmap, 0, sizeof layout->bitmap);
+  layout->size = size;
+}
+
+void alloc_layout_pointer(struct alloc_layout* layout, size_t offset)
+{
+  assert(offset % sizeof(uintptr_t) == 0 && offset < layout->size);
+  size_t word = offset / sizeof(uintptr_t);
+  layout->bitmap[word / ALLOC_WORD_BITS] |= (uintptr_t)1
+      << (word % ALLOC_WORD_BITS);
+}
+
+// The precise collector's half of this interface is in precise.c.
+#ifndef ALLOC_PRECISE
+
+_Static_assert(sizeof(GC_word) == sizeof(uintptr_t),
+               "layout bitmaps are passed to the collector as-is");
+
+void* alloc_untyped(size_t size)
+{
+  return GC_MALLOC(size);
+}
+
+void* alloc_realloc(void* pointer, size_t size)
+{
+  return GC_REALLOC(pointer, size);
+}
+
+void* alloc_atomic(size_t size)
+{
+  return GC_MALLOC_ATOMIC(size);
+}
+
+alloc_descriptor alloc_layout_descriptor(struct alloc_layout* layout)
+{
+  return GC_make_descriptor(
+      (GC_word*)layout->bitmap,
+      (layout->size + sizeof(GC_word) - 1) / sizeof(GC_word));
+}
+
+void* alloc_typed(size_t size, alloc_descriptor descriptor)
+{
+  return GC_MALLOC_EXPLICITLY_TYPED(size, descriptor);
+}
+
+size_t alloc_size(const void* pointer)
+{
+  void* base = pointer ? GC_base((void*)pointer) : NULL;
+  return base ? GC_size(base) : 0;
+}
+
+void alloc_add_root(void* start, size_t size)
+{
+  (void)start;
+  (void)size;
+}
+
+void alloc_collect(void)
+{
+  GC_gcollect();
+}
+
+// atomic memory, the only kind system calls may write to, is never protected
+size_t alloc_fread(void* pointer, size_t size, FILE* stream)
+{
+  return fread(pointer, 1, size, stream);
+}
+
+void alloc_set_oom_fn(alloc_oom_fn fn)
+{
+  GC_set_oom_fn(fn);
+}
+
+void alloc_set_max_heap_size(size_t bytes)
+{
+  GC_set_max_heap_size(bytes);
+}
+
+bool alloc_enable_incremental(unsigned long pause_target_ms)
+{
+  GC_enable_incremental();
+  GC_set_time_limit(pause_target_ms);
+  return GC_is_incremental_mode();
+}
+
+bool alloc_register_weak_link(void** link, void* object)
+{
+  return GC_general_register_disappearing_link(link, object) == GC_SUCCESS;
+}
+
+void alloc_clear_weak_link(void** link)
+{
+  GC_unregister_disappearing_link(link);
+  *link = NULL;
+}
+
+struct alloc_heap_stats alloc_get_heap_stats(void)
+{
+  struct GC_prof_stats_s prof;
+  GC_get_prof_stats(&prof, sizeof prof);
+  return (struct alloc_heap_stats) {
+      .heap_size = prof.heapsize_full - prof.unmapped_bytes,
+      .free_bytes = prof.free_bytes_full - prof.unmapped_bytes,
+      .total_bytes = prof.allocd_bytes_before_gc + prof.bytes_allocd_since_gc,
+  };
+}
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Everything the interpreter allocates comes from one of two collectors,
+// picked when configuring (gc-c-jlox_GC):
+//
+//   boehm    the vendored conservative Boehm GC (the default)
+//   precise  a mark-sweep collector of our own (ALLOC_PRECISE), see precise.c
+//
+// Allocation kinds. Memory that cannot hold pointers (string text, source
+// code, numbers) is allocated atomic, so the collector never scans it.
+// Structures that mix pointers with other data (objects, environments, AST
+// nodes) are allocated with a type descriptor, so the collector scans only
+// the words that hold pointers. Everything else (lists, tables) is untyped:
+// any word of it may be a pointer.
+//
+// Function pointers and pointers to memory the collector doesn't own (JIT
+// code) need not be in a layout.
+//
+// The precise collector doesn't scan static data, so file-scope variables
+// that point into the heap must be passed to alloc_add_root once; Boehm finds
+// them itself and ignores the call.
+//
+// Either collector may write-protect heap pages to find the ones written
+// between collections (the precise one always, Boehm in incremental mode),
+// and a system call that writes to a protected page fails with EFAULT. So
+// system calls may only write to atomic memory, which Boehm never protects,
+// and only through alloc_fread, the one place that unprotects it first.
+// Reading into malloc'd memory is fine; such a call must be marked
+// "outside the heap" on its line, or the heap_reads test fails.
+
+#ifndef ALLOC_PRECISE
+// also redirects pthread_create in threaded builds, so new threads are
+// registered with the collector
+#  include <gc.h>
+#  include <gc_typed.h>
+#endif
+
+#define ALLOC_LAYOUT_MAX_WORDS 32
+#define ALLOC_WORD_BITS (sizeof(uintptr_t) * 8)
+
+// which words of a structure may point into the GC heap
+struct alloc_layout {
+  uintptr_t bitmap[ALLOC_LAYOUT_MAX_WORDS / ALLOC_WORD_BITS + 1];
+  size_t size;
+};
+
+#define ALLOC_LAYOUT_POINTER(layout, type, field) \
+  alloc_layout_pointer((layout), offsetof(type, field))
+
+#ifdef ALLOC_PRECISE
+typedef const struct alloc_layout* alloc_descriptor;
+// The precise collector scans the C stack from the caller's frame down, so
+// this must run first thing in main.
+#  define ALLOC_INIT() alloc_init(__builtin_frame_address(0))
+void alloc_init(void* stack_base);
+#else
+typedef GC_descr alloc_descriptor;
+#  define ALLOC_INIT() GC_INIT()
+#endif
+
+// returns what the allocation that failed should return (or doesn't return)
+typedef void* (*alloc_oom_fn)(size_t bytes);
+
+struct alloc_heap_stats {
+  size_t heap_size;
+  size_t free_bytes;
+  // allocated since the program started
+  size_t total_bytes;
+};
+
+// cleared memory any word of which may be a pointer
+void* alloc_untyped(size_t size);
+// keeps the contents up to the smaller size; the new part is cleared
+void* alloc_realloc(void* pointer, size_t size);
+// unlike alloc_untyped, atomic memory is not cleared
+void* alloc_atomic(size_t size);
+// room for `length` characters, with a NUL at the start and after the end
+char* alloc_string(size_t length);
+char* alloc_strdup(const char* s);
+
+// a layout of `size` bytes with no pointers yet
+void alloc_layout_init(struct alloc_layout* layout, size_t size);
+void alloc_layout_pointer(struct alloc_layout* layout, size_t offset);
+alloc_descriptor alloc_layout_descriptor(struct alloc_layout* layout);
+void* alloc_typed(size_t size, alloc_descriptor descriptor);
+
+// the size of the allocation `pointer` points into, 0 if it isn't one
+size_t alloc_size(const void* pointer);
+void alloc_add_root(void* start, size_t size);
+void alloc_collect(void);
+// fread into atomic heap memory
+size_t alloc_fread(void* pointer, size_t size, FILE* stream);
+void alloc_set_oom_fn(alloc_oom_fn fn);
+void alloc_set_max_heap_size(size_t bytes);
+// Makes the collector incremental, aiming to keep each pause under the
+// target. Returns false if it can't be.
+bool alloc_enable_incremental(unsigned long pause_target_ms);
+struct alloc_heap_stats alloc_get_heap_stats(void);
+
+// Weak references. `link` must already point to `object`; once nothing but
+// weak links reaches the object, the collector sets them to NULL. A link
+// must be a word of a heap allocation that its layout leaves out (or of an
+// atomic one), so that it doesn't keep the object alive itself, and it is
+// forgotten when that allocation is collected. Returns false if there was no
+// memory to register it.
+bool alloc_register_weak_link(void** link, void* object);
+// sets a registered link to NULL for good
+void alloc_clear_weak_link(void** link);
+
+#ifdef ALLOC_PRECISE
+enum alloc_event
+{
+  ALLOC_EVENT_START,
+  ALLOC_EVENT_END,
+};
+
+// called at the start and end of every collection
+typedef void (*alloc_event_hook)(enum alloc_event event);
+void alloc_set_event_hook(alloc_event_hook hook);
+#endif
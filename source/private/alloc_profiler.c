@@ -0,0 +1,271 @@
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
+#include <private/hash/fnv.h>
+#include <private/hash/table.h>
+#include <private/list.h>
+#include <private/strutils.h>
+#include <private/threads.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct alloc_profile_node;
+
+DECLARE_NAMED_LIST(alloc_profile_node_list, struct alloc_profile_node*);
+
+// call tree node: one per distinct (call path, function, line)
+struct alloc_profile_node {
+  struct alloc_profile_node* parent;
+  const char* function;
+  size_t line;
+  size_t count;
+  size_t bytes;
+  struct alloc_profile_node_list children;
+};
+
+struct alloc_profile_frame {
+  const char* function;
+  size_t line;
+  struct alloc_profile_node* parent;
+  // resolved lazily from (parent, function, line); NULL after a line change
+  struct alloc_profile_node* node;
+};
+
+DECLARE_NAMED_LIST(alloc_profile_frame_list, struct alloc_profile_frame);
+
+struct alloc_profile_site {
+  const char* function;
+  size_t line;
+  size_t count;
+  size_t bytes;
+};
+
+DECLARE_NAMED_LIST(alloc_profile_site_list, struct alloc_profile_site*);
+
+static bool Enabled = false;
+// only the thread that enabled the profiler is recorded; the frame stack
+// follows a single interpreter
+THREADS_OWNER(Owner);
+// set while the profiler allocates for itself, so that those allocations
+// are not recorded (and the frame stack is not read mid-resize)
+static bool Busy = false;
+static struct alloc_profile_node Root;
+static struct alloc_profile_frame_list Frames;
+
+static struct alloc_profile_node* frame_node(struct alloc_profile_frame* frame);
+static void collect_sites(struct alloc_profile_node* node,
+                          struct hash_table* table,
+                          struct alloc_profile_site_list* sites);
+static int compare_sites(const void* a, const void* b);
+static void fprint_collapsed_node(FILE* fp, struct alloc_profile_node* node);
+static void fprint_stack(FILE* fp, struct alloc_profile_node* node);
+
+void alloc_profiler_enable(void)
+{
+  if (!Enabled) {
+    alloc_add_root(&Root, sizeof Root);
+    alloc_add_root(&Frames, sizeof Frames);
+  }
+  Enabled = true;
+  THREADS_CLAIM(Owner);
+  LIST_INIT(&Root.children);
+  LIST_INIT(&Frames);
+}
+
+bool alloc_profiler_enabled(void)
+{
+  return Enabled;
+}
+
+void alloc_profiler_enter(const char* function)
+{
+  if (!Enabled || !THREADS_OWNS(Owner)) {
+    return;
+  }
+  Busy = true;
+  struct alloc_profile_node* parent = &Root;
+  if (Frames.length > 0) {
+    parent = frame_node(&Frames.pointer[Frames.length - 1]);
+  }
+  LIST_PUSH(&Frames,
+            ((struct alloc_profile_frame) {
+                .function = function,
+                .line = 0,
+                .parent = parent,
+                .node = NULL,
+            }));
+  Busy = false;
+}
+
+void alloc_profiler_leave(void)
+{
+  if (!Enabled || !THREADS_OWNS(Owner) || Frames.length == 0) {
+    return;
+  }
+  --Frames.length;
+}
+
+size_t alloc_profiler_depth(void)
+{
+  return Enabled && THREADS_OWNS(Owner) ? (size_t)Frames.length : 0;
+}
+
+void alloc_profiler_unwind(size_t depth)
+{
+  if (!Enabled || !THREADS_OWNS(Owner)) {
+    return;
+  }
+  if ((size_t)Frames.length > depth) {
+    Frames.length = (long)depth;
+  }
+  // the jump may have left a profiler allocation half done
+  Busy = false;
+}
+
+void alloc_profiler_set_line(size_t line)
+{
+  if (!Enabled || !THREADS_OWNS(Owner) || Frames.length == 0) {
+    return;
+  }
+  struct alloc_profile_frame* frame = &Frames.pointer[Frames.length - 1];
+  if (frame->line != line) {
+    frame->line = line;
+    frame->node = NULL;
+  }
+}
+
+void alloc_profiler_record(size_t bytes)
+{
+  if (!Enabled || Busy || !THREADS_OWNS(Owner) || Frames.length == 0) {
+    return;
+  }
+  Busy = true;
+  struct alloc_profile_node* node =
+      frame_node(&Frames.pointer[Frames.length - 1]);
+  ++node->count;
+  node->bytes += bytes;
+  Busy = false;
+}
+
+void alloc_profiler_fprint(FILE* fp)
+{
+  Busy = true;
+  struct hash_table* table = hash_table_new(hash_fnv1a);
+  struct alloc_profile_site_list sites;
+  LIST_INIT(&sites);
+  collect_sites(&Root, table, &sites);
+  qsort(sites.pointer,
+        (size_t)sites.length,
+        sizeof(struct alloc_profile_site*),
+        compare_sites);
+
+  fprintf(fp, "--- ALLOC PROFILE ---\n");
+  fprintf(fp, "%14s %12s %6s  %s\n", "bytes", "count", "line", "function");
+  for (long i = 0; i < sites.length; ++i) {
+    fprintf(fp,
+            "%14zu %12zu %6zu  %s\n",
+            sites.pointer[i]->bytes,
+            sites.pointer[i]->count,
+            sites.pointer[i]->line,
+            sites.pointer[i]->function);
+  }
+  fprintf(fp, "--- END ALLOC PROFILE ---\n");
+  Busy = false;
+}
+
+void alloc_profiler_fprint_collapsed(FILE* fp)
+{
+  for (long i = 0; i < Root.children.length; ++i) {
+    fprint_collapsed_node(fp, Root.children.pointer[i]);
+  }
+}
+
+static struct alloc_profile_node* frame_node(struct alloc_profile_frame* frame)
+{
+  if (frame->node) {
+    return frame->node;
+  }
+  struct alloc_profile_node_list* children = &frame->parent->children;
+  for (long i = 0; i < children->length; ++i) {
+    struct alloc_profile_node* child = children->pointer[i];
+    if (child->line == frame->line
+        && strcmp(child->function, frame->function) == 0)
+    {
+      frame->node = child;
+      return child;
+    }
+  }
+
+  struct alloc_profile_node* node =
+      alloc_untyped(sizeof(struct alloc_profile_node));
+  node->parent = frame->parent;
+  node->function = frame->function;
+  node->line = frame->line;
+  node->count = 0;
+  node->bytes = 0;
+  LIST_INIT(&node->children);
+  LIST_PUSH(children, node);
+  frame->node = node;
+  return node;
+}
+
+static void collect_sites(struct alloc_profile_node* node,
+                          struct hash_table* table,
+                          struct alloc_profile_site_list* sites)
+{
+  if (node->count > 0) {
+    char* key = alloc_printf("%s:%zu", node->function, node->line);
+    void** value = hash_table_try_get(table, key, strlen(key));
+    struct alloc_profile_site* site;
+    if (value) {
+      site = *value;
+    } else {
+      site = alloc_untyped(sizeof(struct alloc_profile_site));
+      site->function = node->function;
+      site->line = node->line;
+      site->count = 0;
+      site->bytes = 0;
+      hash_table_insert(table, key, site);
+      LIST_PUSH(sites, site);
+    }
+    site->count += node->count;
+    site->bytes += node->bytes;
+  }
+  for (long i = 0; i < node->children.length; ++i) {
+    collect_sites(node->children.pointer[i], table, sites);
+  }
+}
+
+static int compare_sites(const void* a, const void* b)
+{
+  const struct alloc_profile_site* left = *(struct alloc_profile_site* const*)a;
+  const struct alloc_profile_site* right =
+      *(struct alloc_profile_site* const*)b;
+  if (left->bytes != right->bytes) {
+    return left->bytes < right->bytes ? 1 : -1;
+  }
+  if (left->line != right->line) {
+    return left->line < right->line ? -1 : 1;
+  }
+  return strcmp(left->function, right->function);
+}
+
+static void fprint_collapsed_node(FILE* fp, struct alloc_profile_node* node)
+{
+  if (node->bytes > 0) {
+    fprint_stack(fp, node);
+    fprintf(fp, " %zu\n", node->bytes);
+  }
+  for (long i = 0; i < node->children.length; ++i) {
+    fprint_collapsed_node(fp, node->children.pointer[i]);
+  }
+}
+
+static void fprint_stack(FILE* fp, struct alloc_profile_node* node)
+{
+  if (node->parent && node->parent != &Root) {
+    fprint_stack(fp, node->parent);
+    fprintf(fp, ";");
+  }
+  fprintf(fp, "%s:%zu", node->function, node->line);
+}
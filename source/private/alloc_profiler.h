@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Attributes runtime heap allocations to the Lox function and source line
+// executing at the time. The interpreter reports function entry/exit and
+// statement lines; allocation sites report their sizes.
+
+void alloc_profiler_enable(void);
+bool alloc_profiler_enabled(void);
+void alloc_profiler_enter(const char* function);
+void alloc_profiler_leave(void);
+// For code that unwinds without leaving each function (the interpreter's
+// out-of-memory recovery): the depth to come back to, and the way back.
+size_t alloc_profiler_depth(void);
+void alloc_profiler_unwind(size_t depth);
+void alloc_profiler_set_line(size_t line);
+void alloc_profiler_record(size_t bytes);
+// sorted table of (function, line) sites by bytes allocated
+void alloc_profiler_fprint(FILE* fp);
+// one "frame;frame;frame bytes" line per call path, for flame graph tools
+void alloc_profiler_fprint_collapsed(FILE* fp);
@@ -0,0 +1,273 @@
+#include <lib.h>
+#include <private/alloc.h>
+#include <private/aot.h>
+#include <private/interpreter.h>
+#include <private/natives.h>
+#include <private/operators.h>
+#include <private/runtime_error.h>
+#include <private/strutils.h>
+#include <private/symbol.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <time.h>
+
+// what a compiled Lox function keeps in its native_function's data
+struct aot_closure {
+  struct token* name;
+  struct token* params;
+  aot_body body;
+  struct environment* closure;
+};
+
+static struct environment* Globals = NULL;
+// what natives are given as their interpreter: clock's start time, and the
+// globals as heapSnapshot's roots (compiled calls keep no frames)
+static struct interpreter Runtime;
+static long CallDepth = 0;
+static long MaxCallDepth = 0;
+// as in interpreter_push_frame, calls are also refused once the C stack has
+// grown StackBudget bytes past StackBase, since a compiled function's frame
+// grows with its body
+static uintptr_t StackBase = 0;
+static size_t StackBudget = 0;
+// a tail call left by aot_tail_call for aot_call to run; the marker is what
+// the current body returns meanwhile
+static struct aot_closure* PendingClosure = NULL;
+static struct environment* PendingEnvironment = NULL;
+static struct object TailCall;
+
+static _Noreturn void aot_fail(struct runtime_error* err);
+static struct native_function check_call(struct object* callee,
+                                         struct token* paren,
+                                         long count);
+static struct object* call_native(struct native_function function,
+                                  long count,
+                                  struct object** arguments);
+static struct environment* bind_arguments(struct aot_closure* closure,
+                                          long count,
+                                          struct object** arguments);
+static struct object* aot_closure_entry(struct interpreter* interpreter,
+                                        struct object_list* arguments);
+
+void aot_init(struct token* tokens, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    if (tokens[i].type == TOKEN_IDENTIFIER) {
+      tokens[i].symbol = symbol_intern(tokens[i].lexeme);
+    }
+  }
+  MaxCallDepth = interpreter_default_max_call_depth();
+  // called first thing in main, so this is close enough to the stack's base
+  char base;
+  StackBase = (uintptr_t)&base;
+  StackBudget = interpreter_stack_budget();
+  alloc_add_root(&Globals, sizeof Globals);
+  alloc_add_root(&PendingClosure, sizeof PendingClosure);
+  alloc_add_root(&PendingEnvironment, sizeof PendingEnvironment);
+  Globals = environment_new();
+  Runtime.globals = Globals;
+  Runtime.environment = Globals;
+  Runtime.init_time = time(NULL);
+  LIST_INIT(&Runtime.frames);
+  natives_define(Globals);
+}
+
+void aot_set_max_call_depth(long max_call_depth)
+{
+  long limit = interpreter_default_max_call_depth();
+  MaxCallDepth = max_call_depth < limit ? max_call_depth : limit;
+}
+
+struct environment* aot_globals(void)
+{
+  return Globals;
+}
+
+void aot_define(struct environment* environment,
+                struct token* name,
+                struct object* value)
+{
+  environment_define(environment, name->lexeme, value);
+}
+
+struct object* aot_get(struct environment* environment,
+                       struct token* name,
+                       struct environment_cache* cache)
+{
+  struct environment_lookup_result result =
+      environment_get_cached(environment, name, cache);
+  if (ENVIRONMENT_LOOKUP_RESULT_IS_ERROR(&result)) {
+    aot_fail(ENVIRONMENT_LOOKUP_RESULT_GET_ERROR(&result));
+  }
+  return ENVIRONMENT_LOOKUP_RESULT_GET_OK(&result);
+}
+
+struct object* aot_assign(struct environment* environment,
+                          struct token* name,
+                          struct environment_cache* cache,
+                          struct object* value)
+{
+  struct runtime_error* err =
+      environment_assign_cached(environment, name, value, cache);
+  if (err) {
+    aot_fail(err);
+  }
+  return value;
+}
+
+struct object* aot_binary(struct token* op,
+                          struct object* left,
+                          struct object* right)
+{
+  struct runtime_error* err;
+  struct object* value = operator_binary(op, left, right, &err);
+  if (!value) {
+    aot_fail(err);
+  }
+  return value;
+}
+
+struct object* aot_unary(struct token* op, struct object* right)
+{
+  struct runtime_error* err;
+  struct object* value = operator_unary(op, right, &err);
+  if (!value) {
+    aot_fail(err);
+  }
+  return value;
+}
+
+bool aot_truthy(struct object* obj)
+{
+  return operator_is_truthy(obj);
+}
+
+void aot_print(struct object* obj)
+{
+  if (OBJECT_IS_NATIVE_FUNCTION(obj) && OBJECT_AS_NATIVE_FUNCTION(obj).data) {
+    struct aot_closure* closure = OBJECT_AS_NATIVE_FUNCTION(obj).data;
+    printf("<fn %s>\n", closure->name->lexeme);
+    return;
+  }
+  printf("%s\n", operator_stringify(obj));
+}
+
+struct object* aot_function(struct token* name,
+                            struct token* params,
+                            long arity,
+                            aot_body body,
+                            struct environment* closure)
+{
+  struct aot_closure* data = alloc_untyped(sizeof(struct aot_closure));
+  data->name = name;
+  data->params = params;
+  data->body = body;
+  data->closure = closure;
+  struct object* function = OBJECT_NATIVE_FUNCTION(arity, aot_closure_entry);
+  OBJECT_AS_NATIVE_FUNCTION(function).data = data;
+  return function;
+}
+
+struct object* aot_call(struct object* callee,
+                        struct token* paren,
+                        long count,
+                        struct object** arguments)
+{
+  struct native_function function = check_call(callee, paren, count);
+  if (!function.data) {
+    return call_native(function, count, arguments);
+  }
+
+  char here;
+  uintptr_t top = (uintptr_t)&here;
+  size_t stack_used = StackBase > top ? StackBase - top : top - StackBase;
+  if (CallDepth >= MaxCallDepth || stack_used > StackBudget) {
+    aot_fail(runtime_error_new(paren, "Stack overflow."));
+  }
+  struct aot_closure* closure = function.data;
+  struct environment* environment = bind_arguments(closure, count, arguments);
+  ++CallDepth;
+  struct object* result;
+  while ((result = closure->body(environment)) == &TailCall) {
+    closure = PendingClosure;
+    environment = PendingEnvironment;
+    PendingClosure = NULL;
+    PendingEnvironment = NULL;
+  }
+  --CallDepth;
+  return result;
+}
+
+struct object* aot_tail_call(struct object* callee,
+                             struct token* paren,
+                             long count,
+                             struct object** arguments)
+{
+  struct native_function function = check_call(callee, paren, count);
+  if (!function.data) {
+    return call_native(function, count, arguments);
+  }
+  PendingClosure = function.data;
+  PendingEnvironment = bind_arguments(PendingClosure, count, arguments);
+  return &TailCall;
+}
+
+static _Noreturn void aot_fail(struct runtime_error* err)
+{
+  fflush(stdout);
+  library_runtime_error(err);
+  exit(EX_SOFTWARE);
+}
+
+static struct native_function check_call(struct object* callee,
+                                         struct token* paren,
+                                         long count)
+{
+  if (!OBJECT_IS_NATIVE_FUNCTION(callee)) {
+    aot_fail(runtime_error_new(paren, "Can only call functions and classes."));
+  }
+  struct native_function function = OBJECT_AS_NATIVE_FUNCTION(callee);
+  if (count != function.arity) {
+    aot_fail(runtime_error_new(
+        paren,
+        alloc_printf("Expected %li arguments but got %li.",
+                     function.arity,
+                     count)));
+  }
+  return function;
+}
+
+static struct object* call_native(struct native_function function,
+                                  long count,
+                                  struct object** arguments)
+{
+  struct object_list list = {
+      .pointer = arguments,
+      .length = count,
+      .capacity = count,
+  };
+  return function.func(&Runtime, &list);
+}
+
+static struct environment* bind_arguments(struct aot_closure* closure,
+                                          long count,
+                                          struct object** arguments)
+{
+  struct environment* environment = environment_new_enclosed(closure->closure);
+  for (long i = 0; i < count; ++i) {
+    environment_define(environment, closure->params[i].lexeme, arguments[i]);
+  }
+  return environment;
+}
+
+// Compiled functions are called through aot_call, which reads their
+// aot_closure; this only gives them a distinct native function pointer.
+static struct object* aot_closure_entry(struct interpreter* interpreter,
+                                        struct object_list* arguments)
+{
+  (void)interpreter;
+  (void)arguments;
+  abort();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <private/environment.h>
+#include <private/object.h>
+#include <private/token.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Runtime for the C programs written by --emit-c (see emit_c.h). Variables
+// live in the same environments the interpreter uses, and operators come from
+// operators.h, so a compiled script behaves like the interpreted one. A
+// runtime error is reported the way the interpreter reports it and ends the
+// program with EX_SOFTWARE.
+
+// the body of a compiled Lox function, run in an environment that holds its
+// parameters; returns the function's result
+typedef struct object* (*aot_body)(struct environment* environment);
+
+// interns the program's identifier tokens and sets up the globals
+void aot_init(struct token* tokens, size_t count);
+// as interpreter_set_max_call_depth; the default is the interpreter's
+void aot_set_max_call_depth(long max_call_depth);
+struct environment* aot_globals(void);
+
+void aot_define(struct environment* environment,
+                struct token* name,
+                struct object* value);
+struct object* aot_get(struct environment* environment,
+                       struct token* name,
+                       struct environment_cache* cache);
+struct object* aot_assign(struct environment* environment,
+                          struct token* name,
+                          struct environment_cache* cache,
+                          struct object* value);
+
+struct object* aot_binary(struct token* op,
+                          struct object* left,
+                          struct object* right);
+struct object* aot_unary(struct token* op, struct object* right);
+bool aot_truthy(struct object* obj);
+void aot_print(struct object* obj);
+
+// a Lox function value; params points at `arity` parameter name tokens
+struct object* aot_function(struct token* name,
+                            struct token* params,
+                            long arity,
+                            aot_body body,
+                            struct environment* closure);
+struct object* aot_call(struct object* callee,
+                        struct token* paren,
+                        long count,
+                        struct object** arguments);
+// `return callee(arguments)` in a compiled function. A compiled callee isn't
+// called here: it is left for the aot_call running the current function,
+// which runs it in the same C frame, so a chain of tail calls doesn't grow
+// the stack or the call depth (as in interpreter_call). The result must be
+// returned as is.
+struct object* aot_tail_call(struct object* callee,
+                             struct token* paren,
+                             long count,
+                             struct object** arguments);
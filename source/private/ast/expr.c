@@ -1,14 +1,63 @@
-#include <gc.h>
+#include <private/alloc.h>
 #include <private/ast/expr.h>
+#include <private/gc_stats.h>
+#include <private/object.h>
+#include <private/threads.h>
+#include <stdbool.h>
 
 #include "private/token.h"
 
+static void describe_nodes(void);
+
+// where each node type keeps its pointers
+static alloc_descriptor Descriptors[EXPR_VARIABLE + 1];
+THREADS_ONCE(Described);
+
+static void* expr_alloc(size_t size, enum expr_type type)
+{
+  THREADS_CALL_ONCE(Described, describe_nodes);
+  struct expr* expr = alloc_typed(size, Descriptors[type]);
+  gc_stats_count_allocation(GC_STATS_KIND_EXPR, size);
+  expr->type = type;
+  expr->eval = NULL;
+  return expr;
+}
+
 struct assign_expr* expr_new_assign(struct token name, struct expr* value)
 {
-  struct assign_expr* expr = GC_MALLOC(sizeof(struct assign_expr));
-  expr->base.type = EXPR_ASSIGN;
+  struct assign_expr* expr =
+      expr_alloc(sizeof(struct assign_expr), EXPR_ASSIGN);
   expr->name = name;
   expr->value = value;
+  expr->cache = ENVIRONMENT_CACHE_EMPTY;
+  expr->increment = false;
+  expr->step = 0;
+
+  if (value->type != EXPR_BINARY) {
+    return expr;
+  }
+  struct binary_expr* binary = (struct binary_expr*)value;
+  if (binary->operands != BINARY_OPERANDS_VARIABLE_CONSTANT
+      || ((struct variable_expr*)binary->left)->name.symbol != name.symbol)
+  {
+    return expr;
+  }
+  struct object* constant = ((struct literal_expr*)binary->right)->value;
+  if (!OBJECT_IS_NUMBER(constant)) {
+    return expr;
+  }
+  switch (binary->op.type) {
+    case TOKEN_PLUS:
+      expr->increment = true;
+      expr->step = OBJECT_AS_NUMBER(constant);
+      break;
+    case TOKEN_MINUS:
+      expr->increment = true;
+      expr->step = -OBJECT_AS_NUMBER(constant);
+      break;
+    default:
+      break;
+  }
   return expr;
 }
 
@@ -16,11 +65,20 @@ struct binary_expr* expr_new_binary(struct expr* left,
                                     struct token op,
                                     struct expr* right)
 {
-  struct binary_expr* expr = GC_MALLOC(sizeof(struct binary_expr));
-  expr->base.type = EXPR_BINARY;
+  struct binary_expr* expr =
+      expr_alloc(sizeof(struct binary_expr), EXPR_BINARY);
   expr->left = left;
   expr->op = op;
   expr->right = right;
+  expr->operands = BINARY_OPERANDS_ANY;
+  if (left->type == EXPR_VARIABLE && right->type == EXPR_LITERAL) {
+    expr->operands = BINARY_OPERANDS_VARIABLE_CONSTANT;
+  } else if (left->type == EXPR_VARIABLE && right->type == EXPR_VARIABLE) {
+    expr->operands = BINARY_OPERANDS_VARIABLES;
+  }
+  expr->specialization = BINARY_GENERIC;
+  expr->despecializations = 0;
+  expr->hoisted = NULL;
   return expr;
 }
 
@@ -28,26 +86,28 @@ struct call_expr* expr_new_call(struct expr* callee,
                                 struct token paren,
                                 struct expr_list* arguments)
 {
-  struct call_expr* expr = GC_MALLOC(sizeof(struct call_expr));
-  expr->base.type = EXPR_CALL;
+  struct call_expr* expr = expr_alloc(sizeof(struct call_expr), EXPR_CALL);
   expr->callee = callee;
   expr->paren = paren;
   expr->arguments = arguments;
+  expr->inline_callee = NULL;
+  expr->inlined = NULL;
+  expr->deoptimizations = 0;
   return expr;
 }
 
 struct grouping_expr* expr_new_grouping(struct expr* expression)
 {
-  struct grouping_expr* expr = GC_MALLOC(sizeof(struct grouping_expr));
-  expr->base.type = EXPR_GROUPING;
+  struct grouping_expr* expr =
+      expr_alloc(sizeof(struct grouping_expr), EXPR_GROUPING);
   expr->expression = expression;
   return expr;
 }
 
 struct literal_expr* expr_new_literal(struct object* value)
 {
-  struct literal_expr* expr = GC_MALLOC(sizeof(struct literal_expr));
-  expr->base.type = EXPR_LITERAL;
+  struct literal_expr* expr =
+      expr_alloc(sizeof(struct literal_expr), EXPR_LITERAL);
   expr->value = value;
   return expr;
 }
@@ -56,8 +116,8 @@ struct logical_expr* expr_new_logical(struct expr* left,
                                       struct token op,
                                       struct expr* right)
 {
-  struct logical_expr* expr = GC_MALLOC(sizeof(struct logical_expr));
-  expr->base.type = EXPR_LOGICAL;
+  struct logical_expr* expr =
+      expr_alloc(sizeof(struct logical_expr), EXPR_LOGICAL);
   expr->left = left;
   expr->op = op;
   expr->right = right;
@@ -66,17 +126,67 @@ struct logical_expr* expr_new_logical(struct expr* left,
 
 struct unary_expr* expr_new_unary(struct token op, struct expr* right)
 {
-  struct unary_expr* expr = GC_MALLOC(sizeof(struct unary_expr));
-  expr->base.type = EXPR_UNARY;
+  struct unary_expr* expr = expr_alloc(sizeof(struct unary_expr), EXPR_UNARY);
   expr->op = op;
   expr->right = right;
+  expr->hoisted = NULL;
   return expr;
 }
 
 struct variable_expr* expr_new_variable(struct token name)
 {
-  struct variable_expr* expr = GC_MALLOC(sizeof(struct variable_expr));
-  expr->base.type = EXPR_VARIABLE;
+  struct variable_expr* expr =
+      expr_alloc(sizeof(struct variable_expr), EXPR_VARIABLE);
   expr->name = name;
+  expr->cache = ENVIRONMENT_CACHE_EMPTY;
   return expr;
 }
+
+static void describe_nodes(void)
+{
+  struct alloc_layout layout;
+
+  alloc_layout_init(&layout, sizeof(struct assign_expr));
+  token_layout(&layout, offsetof(struct assign_expr, name));
+  ALLOC_LAYOUT_POINTER(&layout, struct assign_expr, value);
+  Descriptors[EXPR_ASSIGN] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct binary_expr));
+  ALLOC_LAYOUT_POINTER(&layout, struct binary_expr, left);
+  token_layout(&layout, offsetof(struct binary_expr, op));
+  ALLOC_LAYOUT_POINTER(&layout, struct binary_expr, right);
+  ALLOC_LAYOUT_POINTER(&layout, struct binary_expr, hoisted);
+  Descriptors[EXPR_BINARY] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct call_expr));
+  ALLOC_LAYOUT_POINTER(&layout, struct call_expr, callee);
+  token_layout(&layout, offsetof(struct call_expr, paren));
+  ALLOC_LAYOUT_POINTER(&layout, struct call_expr, arguments);
+  ALLOC_LAYOUT_POINTER(&layout, struct call_expr, inline_callee);
+  ALLOC_LAYOUT_POINTER(&layout, struct call_expr, inlined);
+  Descriptors[EXPR_CALL] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct grouping_expr));
+  ALLOC_LAYOUT_POINTER(&layout, struct grouping_expr, expression);
+  Descriptors[EXPR_GROUPING] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct literal_expr));
+  ALLOC_LAYOUT_POINTER(&layout, struct literal_expr, value);
+  Descriptors[EXPR_LITERAL] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct logical_expr));
+  ALLOC_LAYOUT_POINTER(&layout, struct logical_expr, left);
+  token_layout(&layout, offsetof(struct logical_expr, op));
+  ALLOC_LAYOUT_POINTER(&layout, struct logical_expr, right);
+  Descriptors[EXPR_LOGICAL] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct unary_expr));
+  token_layout(&layout, offsetof(struct unary_expr, op));
+  ALLOC_LAYOUT_POINTER(&layout, struct unary_expr, right);
+  ALLOC_LAYOUT_POINTER(&layout, struct unary_expr, hoisted);
+  Descriptors[EXPR_UNARY] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct variable_expr));
+  token_layout(&layout, offsetof(struct variable_expr, name));
+  Descriptors[EXPR_VARIABLE] = alloc_layout_descriptor(&layout);
+}
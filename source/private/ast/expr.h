@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <private/environment.h>
 #include <private/list.h>
 #include <private/token.h>
 
@@ -16,8 +17,18 @@ enum expr_type
   EXPR_VARIABLE,
 };
 
+struct expr;
+struct interpreter;
+struct interpret_result;
+
+// Evaluates an expression of one particular shape. The interpreter binds one
+// to each node the first time it is evaluated (closure compilation).
+typedef struct interpret_result (*expr_eval_fn)(struct interpreter* interpreter,
+                                                struct expr* expr);
+
 struct expr {
   enum expr_type type;
+  expr_eval_fn eval;
 };
 
 DECLARE_NAMED_LIST(expr_list, struct expr*);
@@ -26,6 +37,39 @@ struct assign_expr {
   struct expr base;
   struct token name;
   struct expr* value;
+  struct environment_cache cache;
+  // `name = name + constant` (or `- constant`), run as a single in-place
+  // update of the variable by `step`
+  bool increment;
+  double step;
+};
+
+// What a binary_expr has been rewritten to by the interpreter after seeing
+// its operand types (quickening). Specialized nodes guard their operand
+// types and fall back to BINARY_GENERIC when the guard fails.
+enum binary_specialization
+{
+  BINARY_GENERIC,
+  BINARY_NUMBER_ADD,
+  BINARY_NUMBER_SUBTRACT,
+  BINARY_NUMBER_MULTIPLY,
+  BINARY_NUMBER_DIVIDE,
+  BINARY_NUMBER_LESS,
+  BINARY_NUMBER_LESS_EQUAL,
+  BINARY_NUMBER_GREATER,
+  BINARY_NUMBER_GREATER_EQUAL,
+  BINARY_STRING_CONCAT,
+};
+
+// Operand shapes recognized when a binary_expr is built, so the interpreter
+// can fetch both operands without dispatching on them.
+enum binary_operands
+{
+  BINARY_OPERANDS_ANY,
+  // a variable on the left and a literal on the right, e.g. `i < 10`
+  BINARY_OPERANDS_VARIABLE_CONSTANT,
+  // a variable on both sides, e.g. `a + b`
+  BINARY_OPERANDS_VARIABLES,
 };
 
 struct binary_expr {
@@ -33,13 +77,26 @@ struct binary_expr {
   struct expr* left;
   struct token op;
   struct expr* right;
+  enum binary_operands operands;
+  enum binary_specialization specialization;
+  // guard failures so far; sites that keep failing stay generic
+  unsigned char despecializations;
+  // value for the current run of the loop this was hoisted out of
+  struct object* hoisted;
 };
 
+struct inlined_call;
+
 struct call_expr {
   struct expr base;
   struct expr* callee;
   struct token paren;
   struct expr_list* arguments;
+  // inlining state (see inliner.h): the callee last seen here, its inlined
+  // body if it could be inlined, and how often the callee has changed since
+  struct object* inline_callee;
+  struct inlined_call* inlined;
+  unsigned char deoptimizations;
 };
 
 struct grouping_expr {
@@ -63,11 +120,14 @@ struct unary_expr {
   struct expr base;
   struct token op;
   struct expr* right;
+  // value for the current run of the loop this was hoisted out of
+  struct object* hoisted;
 };
 
 struct variable_expr {
   struct expr base;
   struct token name;
+  struct environment_cache cache;
 };
 
 struct assign_expr* expr_new_assign(struct token name, struct expr* value);
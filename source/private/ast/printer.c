@@ -1,4 +1,4 @@
-#include <gc.h>
+#include <private/alloc.h>
 #include <private/ast/printer.h>
 #include <private/list.h>
 #include <private/strutils.h>
@@ -40,7 +40,7 @@ static char* print_expr_list(struct ast_printer* printer,
 {
   // "[]\0"
   size_t len = 3;
-  struct string_list* strings = GC_MALLOC(sizeof(struct string_list));
+  struct string_list* strings = alloc_untyped(sizeof(struct string_list));
   LIST_INIT(strings);
   for (long i = 0; i < list->length; i++) {
     LIST_PUSH(strings, expr_accept_ast_printer(list->pointer[i], printer));
@@ -50,7 +50,7 @@ static char* print_expr_list(struct ast_printer* printer,
       len += 2;
     }
   }
-  char* result = GC_MALLOC(len);
+  char* result = alloc_string(len - 1);
   char* cursor = result;
   strcpy(cursor, "[");
   cursor += 1;
@@ -103,7 +103,7 @@ static char* ast_printer_visit_literal_expr(struct ast_printer* printer,
 {
   (void)printer;
   size_t len = object_snprint(NULL, 0, expr->value);
-  char* str = GC_MALLOC(len + 1);
+  char* str = alloc_string(len);
   object_snprint(str, len + 1, expr->value);
   return str;
 }
@@ -1,9 +1,27 @@
-#include <gc.h>
+#include <private/alloc.h>
 #include <private/ast/stmt.h>
+#include <private/gc_stats.h>
+#include <private/threads.h>
+
+static void describe_statements(void);
+
+// where each statement type keeps its pointers
+static alloc_descriptor Descriptors[STMT_WHILE + 1];
+THREADS_ONCE(Described);
+
+static void* stmt_alloc(size_t size, enum stmt_type type)
+{
+  THREADS_CALL_ONCE(Described, describe_statements);
+  struct stmt* stmt = alloc_typed(size, Descriptors[type]);
+  gc_stats_count_allocation(GC_STATS_KIND_STMT, size);
+  stmt->type = type;
+  stmt->line = 0;
+  return stmt;
+}
 
 struct stmt_list* stmt_list_new(void)
 {
-  struct stmt_list* list = GC_MALLOC(sizeof(struct stmt_list));
+  struct stmt_list* list = alloc_untyped(sizeof(struct stmt_list));
   list->pointer = NULL;
   list->length = 0;
   list->capacity = 0;
@@ -12,16 +30,17 @@ struct stmt_list* stmt_list_new(void)
 
 struct block_stmt* stmt_new_block(struct stmt_list* statements)
 {
-  struct block_stmt* stmt = GC_MALLOC(sizeof(struct block_stmt));
-  stmt->base.type = STMT_BLOCK;
+  struct block_stmt* stmt = stmt_alloc(sizeof(struct block_stmt), STMT_BLOCK);
   stmt->statements = statements;
+  stmt->code = NULL;
+  stmt->escape = SCOPE_ESCAPE_UNKNOWN;
   return stmt;
 }
 
 struct expression_stmt* stmt_new_expression(struct expr* expression)
 {
-  struct expression_stmt* stmt = GC_MALLOC(sizeof(struct expression_stmt));
-  stmt->base.type = STMT_EXPRESSION;
+  struct expression_stmt* stmt =
+      stmt_alloc(sizeof(struct expression_stmt), STMT_EXPRESSION);
   stmt->expression = expression;
   return stmt;
 }
@@ -30,11 +49,16 @@ struct function_stmt* stmt_new_function(struct token name,
                                         struct token_list* params,
                                         struct stmt_list* body)
 {
-  struct function_stmt* stmt = GC_MALLOC(sizeof(struct function_stmt));
-  stmt->base.type = STMT_FUNCTION;
+  struct function_stmt* stmt =
+      stmt_alloc(sizeof(struct function_stmt), STMT_FUNCTION);
   stmt->name = name;
   stmt->params = params;
   stmt->body = body;
+  stmt->code = NULL;
+  stmt->escape = SCOPE_ESCAPE_UNKNOWN;
+  stmt->calls = 0;
+  stmt->jit_failed = false;
+  stmt->jit_code = NULL;
   return stmt;
 }
 
@@ -42,8 +66,7 @@ struct if_stmt* stmt_new_if(struct expr* condition,
                             struct stmt* then_branch,
                             struct stmt* else_branch)
 {
-  struct if_stmt* stmt = GC_MALLOC(sizeof(struct if_stmt));
-  stmt->base.type = STMT_IF;
+  struct if_stmt* stmt = stmt_alloc(sizeof(struct if_stmt), STMT_IF);
   stmt->condition = condition;
   stmt->then_branch = then_branch;
   stmt->else_branch = else_branch;
@@ -52,16 +75,15 @@ struct if_stmt* stmt_new_if(struct expr* condition,
 
 struct print_stmt* stmt_new_print(struct expr* expression)
 {
-  struct print_stmt* stmt = GC_MALLOC(sizeof(struct print_stmt));
-  stmt->base.type = STMT_PRINT;
+  struct print_stmt* stmt = stmt_alloc(sizeof(struct print_stmt), STMT_PRINT);
   stmt->expression = expression;
   return stmt;
 }
 
 struct return_stmt* stmt_new_return(struct token keyword, struct expr* value)
 {
-  struct return_stmt* stmt = GC_MALLOC(sizeof(struct return_stmt));
-  stmt->base.type = STMT_RETURN;
+  struct return_stmt* stmt =
+      stmt_alloc(sizeof(struct return_stmt), STMT_RETURN);
   stmt->keyword = keyword;
   stmt->value = value;
   return stmt;
@@ -69,8 +91,7 @@ struct return_stmt* stmt_new_return(struct token keyword, struct expr* value)
 
 struct var_stmt* stmt_new_var(struct token name, struct expr* initializer)
 {
-  struct var_stmt* stmt = GC_MALLOC(sizeof(struct var_stmt));
-  stmt->base.type = STMT_VAR;
+  struct var_stmt* stmt = stmt_alloc(sizeof(struct var_stmt), STMT_VAR);
   stmt->name = name;
   stmt->initializer = initializer;
   return stmt;
@@ -78,9 +99,57 @@ struct var_stmt* stmt_new_var(struct token name, struct expr* initializer)
 
 struct while_stmt* stmt_new_while(struct expr* condition, struct stmt* body)
 {
-  struct while_stmt* stmt = GC_MALLOC(sizeof(struct while_stmt));
-  stmt->base.type = STMT_WHILE;
+  struct while_stmt* stmt = stmt_alloc(sizeof(struct while_stmt), STMT_WHILE);
   stmt->condition = condition;
   stmt->body = body;
+  stmt->invariants = NULL;
   return stmt;
 }
+
+static void describe_statements(void)
+{
+  struct alloc_layout layout;
+
+  alloc_layout_init(&layout, sizeof(struct block_stmt));
+  ALLOC_LAYOUT_POINTER(&layout, struct block_stmt, statements);
+  ALLOC_LAYOUT_POINTER(&layout, struct block_stmt, code);
+  Descriptors[STMT_BLOCK] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct expression_stmt));
+  ALLOC_LAYOUT_POINTER(&layout, struct expression_stmt, expression);
+  Descriptors[STMT_EXPRESSION] = alloc_layout_descriptor(&layout);
+
+  // jit_code points outside the GC heap
+  alloc_layout_init(&layout, sizeof(struct function_stmt));
+  token_layout(&layout, offsetof(struct function_stmt, name));
+  ALLOC_LAYOUT_POINTER(&layout, struct function_stmt, params);
+  ALLOC_LAYOUT_POINTER(&layout, struct function_stmt, body);
+  ALLOC_LAYOUT_POINTER(&layout, struct function_stmt, code);
+  Descriptors[STMT_FUNCTION] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct if_stmt));
+  ALLOC_LAYOUT_POINTER(&layout, struct if_stmt, condition);
+  ALLOC_LAYOUT_POINTER(&layout, struct if_stmt, then_branch);
+  ALLOC_LAYOUT_POINTER(&layout, struct if_stmt, else_branch);
+  Descriptors[STMT_IF] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct print_stmt));
+  ALLOC_LAYOUT_POINTER(&layout, struct print_stmt, expression);
+  Descriptors[STMT_PRINT] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct return_stmt));
+  token_layout(&layout, offsetof(struct return_stmt, keyword));
+  ALLOC_LAYOUT_POINTER(&layout, struct return_stmt, value);
+  Descriptors[STMT_RETURN] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct var_stmt));
+  token_layout(&layout, offsetof(struct var_stmt, name));
+  ALLOC_LAYOUT_POINTER(&layout, struct var_stmt, initializer);
+  Descriptors[STMT_VAR] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct while_stmt));
+  ALLOC_LAYOUT_POINTER(&layout, struct while_stmt, condition);
+  ALLOC_LAYOUT_POINTER(&layout, struct while_stmt, body);
+  ALLOC_LAYOUT_POINTER(&layout, struct while_stmt, invariants);
+  Descriptors[STMT_WHILE] = alloc_layout_descriptor(&layout);
+}
@@ -20,15 +20,38 @@ enum stmt_type
 
 struct stmt {
   enum stmt_type type;
+  // line of the first token of the statement, set by the parser
+  size_t line;
 };
 
 DECLARE_NAMED_LIST(stmt_list, struct stmt*);
 
 struct stmt_list* stmt_list_new(void);
 
+// A statement list flattened for the interpreter's dispatch loop: one record
+// per statement, terminated by a record whose stmt is NULL.
+struct stmt_code {
+  // label of the statement's handler, in threaded-dispatch builds
+  const void* handler;
+  struct stmt* stmt;
+};
+
+// whether a closure may capture the scope a block or function body runs in
+// (see escape.h)
+enum scope_escape
+{
+  SCOPE_ESCAPE_UNKNOWN,
+  SCOPE_ESCAPE_NO,
+  SCOPE_ESCAPE_YES,
+};
+
 struct block_stmt {
   struct stmt base;
   struct stmt_list* statements;
+  // flattened statements, built on first execution
+  struct stmt_code* code;
+  // analyzed on first execution
+  enum scope_escape escape;
 };
 
 struct expression_stmt {
@@ -41,6 +64,14 @@ struct function_stmt {
   struct token name;
   struct token_list* params;
   struct stmt_list* body;
+  // flattened body, built on first call
+  struct stmt_code* code;
+  // analyzed when the declaration is first executed
+  enum scope_escape escape;
+  // JIT state: calls counted so far, and the machine code once compiled
+  unsigned long calls;
+  bool jit_failed;
+  void (*jit_code)(void);
 };
 
 struct if_stmt {
@@ -67,10 +98,15 @@ struct var_stmt {
   struct expr* initializer;
 };
 
+struct expr_list;
+
 struct while_stmt {
   struct stmt base;
   struct expr* condition;
   struct stmt* body;
+  // subexpressions hoisted out of the loop (see hoist.h), found on first
+  // execution
+  struct expr_list* invariants;
 };
 
 struct block_stmt* stmt_new_block(struct stmt_list* statements);
@@ -0,0 +1,525 @@
+#include <private/alloc.h>
+#include <private/ast/expr.h>
+#include <private/emit_c.h>
+#include <private/hash/fnv.h>
+#include <private/hash/table.h>
+#include <private/list.h>
+#include <private/object.h>
+#include <private/strutils.h>
+#include <private/token_type.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define INDENT_WIDTH 2
+
+DECLARE_NAMED_LIST(string_list, char*);
+
+struct c_emitter {
+  // initializers of Tokens[] and Constants[], and the C functions written
+  // so far, innermost first
+  struct string_list tokens;
+  struct string_list constants;
+  struct string_list functions;
+  // index + 1 into constants, by initializer, so equal literals share one
+  struct hash_table* constant_indices;
+  size_t caches;
+  // the C function being written: temporaries used, current environment
+  // (env_<depth>) and indentation
+  size_t temps;
+  size_t depth;
+  size_t indent;
+  bool in_function;
+};
+
+EXPR_DECLARE_ACCEPT_FOR(char*, c_emitter);
+STMT_DECLARE_ACCEPT_FOR(char*, c_emitter);
+
+static char* c_emitter_visit_assign_expr(struct c_emitter* emitter,
+                                         struct assign_expr* expr);
+static char* c_emitter_visit_binary_expr(struct c_emitter* emitter,
+                                         struct binary_expr* expr);
+static char* c_emitter_visit_call_expr(struct c_emitter* emitter,
+                                       struct call_expr* expr);
+static char* c_emitter_visit_grouping_expr(struct c_emitter* emitter,
+                                           struct grouping_expr* expr);
+static char* c_emitter_visit_literal_expr(struct c_emitter* emitter,
+                                          struct literal_expr* expr);
+static char* c_emitter_visit_logical_expr(struct c_emitter* emitter,
+                                          struct logical_expr* expr);
+static char* c_emitter_visit_unary_expr(struct c_emitter* emitter,
+                                        struct unary_expr* expr);
+static char* c_emitter_visit_variable_expr(struct c_emitter* emitter,
+                                           struct variable_expr* expr);
+
+static char* c_emitter_visit_block_stmt(struct c_emitter* emitter,
+                                        struct block_stmt* stmt);
+static char* c_emitter_visit_expression_stmt(struct c_emitter* emitter,
+                                             struct expression_stmt* stmt);
+static char* c_emitter_visit_function_stmt(struct c_emitter* emitter,
+                                           struct function_stmt* stmt);
+static char* c_emitter_visit_if_stmt(struct c_emitter* emitter,
+                                     struct if_stmt* stmt);
+static char* c_emitter_visit_print_stmt(struct c_emitter* emitter,
+                                        struct print_stmt* stmt);
+static char* c_emitter_visit_return_stmt(struct c_emitter* emitter,
+                                         struct return_stmt* stmt);
+static char* c_emitter_visit_var_stmt(struct c_emitter* emitter,
+                                      struct var_stmt* stmt);
+static char* c_emitter_visit_while_stmt(struct c_emitter* emitter,
+                                        struct while_stmt* stmt);
+
+static char* emit_statements(struct c_emitter* emitter,
+                             struct stmt_list* statements);
+static char* emit_call(struct c_emitter* emitter,
+                       struct call_expr* expr,
+                       const char* runtime_function);
+static char* token_ref(struct c_emitter* emitter, struct token* token);
+static char* cache_ref(struct c_emitter* emitter);
+static size_t temps(struct c_emitter* emitter, size_t count);
+static char* indentation(struct c_emitter* emitter);
+static char* c_string(const char* text);
+static char* join(struct string_list* strings);
+
+EXPR_DEFINE_ACCEPT_FOR(char*, c_emitter)
+STMT_DEFINE_ACCEPT_FOR(char*, c_emitter)
+
+void emit_c(FILE* out,
+            struct stmt_list* statements,
+            const char* source,
+            long max_call_depth)
+{
+  struct c_emitter emitter = {
+      .caches = 0,
+      .temps = 0,
+      .depth = 0,
+      .indent = 1,
+      .in_function = false,
+  };
+  LIST_INIT(&emitter.tokens);
+  LIST_INIT(&emitter.constants);
+  LIST_INIT(&emitter.functions);
+  emitter.constant_indices = hash_table_new(hash_fnv1a);
+  emitter.constant_indices->borrow_keys = true;
+  char* body = emit_statements(&emitter, statements);
+
+  fprintf(out, "// Generated by gc-c-jlox --emit-c from %s.\n", source);
+  fprintf(out,
+          "#include <private/alloc.h>\n"
+          "#include <private/aot.h>\n"
+          "#include <stdbool.h>\n"
+          "#include <stddef.h>\n\n");
+  fprintf(out, "static struct token Tokens[] = {\n");
+  for (long i = 0; i < emitter.tokens.length; ++i) {
+    fprintf(out, "    %s,\n", emitter.tokens.pointer[i]);
+  }
+  if (emitter.tokens.length == 0) {
+    fprintf(out, "    {.type = TOKEN_EOF},\n");
+  }
+  fprintf(out, "};\n");
+  fprintf(out,
+          "static struct environment_cache Caches[%zu];\n",
+          emitter.caches > 0 ? emitter.caches : 1);
+  fprintf(out,
+          "static struct object* Constants[%ld];\n\n",
+          emitter.constants.length > 0 ? emitter.constants.length : 1);
+  for (long i = 0; i < emitter.functions.length; ++i) {
+    fprintf(out, "%s\n", emitter.functions.pointer[i]);
+  }
+
+  fprintf(out,
+          "int main(void)\n{\n"
+          "  ALLOC_INIT();\n"
+          "  alloc_add_root(Constants, sizeof Constants);\n");
+  fprintf(out, "  aot_init(Tokens, %ld);\n", emitter.tokens.length);
+  if (max_call_depth > 0) {
+    fprintf(out, "  aot_set_max_call_depth(%ld);\n", max_call_depth);
+  }
+  for (long i = 0; i < emitter.constants.length; ++i) {
+    fprintf(out, "  Constants[%ld] = %s;\n", i, emitter.constants.pointer[i]);
+  }
+  fprintf(out,
+          "  struct environment* env_0 = aot_globals();\n"
+          "  struct object* t[%zu];\n"
+          "  (void)t;\n"
+          "%s"
+          "  return 0;\n"
+          "}\n",
+          emitter.temps > 0 ? emitter.temps : 1,
+          body);
+}
+
+// Operands go through temporaries with the comma operator so they are
+// evaluated left to right, which C does not otherwise promise.
+
+static char* c_emitter_visit_assign_expr(struct c_emitter* emitter,
+                                         struct assign_expr* expr)
+{
+  return alloc_printf("aot_assign(env_%zu, %s, %s, %s)",
+                      emitter->depth,
+                      token_ref(emitter, &expr->name),
+                      cache_ref(emitter),
+                      expr_accept_c_emitter(expr->value, emitter));
+}
+
+static char* c_emitter_visit_binary_expr(struct c_emitter* emitter,
+                                         struct binary_expr* expr)
+{
+  size_t t = temps(emitter, 2);
+  char* left = expr_accept_c_emitter(expr->left, emitter);
+  char* right = expr_accept_c_emitter(expr->right, emitter);
+  return alloc_printf("(t[%zu] = %s, t[%zu] = %s, aot_binary(%s, t[%zu], "
+                      "t[%zu]))",
+                      t,
+                      left,
+                      t + 1,
+                      right,
+                      token_ref(emitter, &expr->op),
+                      t,
+                      t + 1);
+}
+
+static char* c_emitter_visit_call_expr(struct c_emitter* emitter,
+                                       struct call_expr* expr)
+{
+  return emit_call(emitter, expr, "aot_call");
+}
+
+// a call through aot_call or aot_tail_call
+static char* emit_call(struct c_emitter* emitter,
+                       struct call_expr* expr,
+                       const char* runtime_function)
+{
+  long count = expr->arguments->length;
+  size_t t = temps(emitter, (size_t)count + 1);
+  struct string_list parts;
+  LIST_INIT(&parts);
+  LIST_PUSH(&parts,
+            alloc_printf("(t[%zu] = %s, ",
+                         t,
+                         expr_accept_c_emitter(expr->callee, emitter)));
+  for (long i = 0; i < count; ++i) {
+    LIST_PUSH(&parts,
+              alloc_printf(
+                  "t[%zu] = %s, ",
+                  t + 1 + (size_t)i,
+                  expr_accept_c_emitter(expr->arguments->pointer[i], emitter)));
+  }
+  LIST_PUSH(&parts,
+            alloc_printf("%s(t[%zu], %s, %ld, &t[%zu]))",
+                         runtime_function,
+                         t,
+                         token_ref(emitter, &expr->paren),
+                         count,
+                         t + 1));
+  return join(&parts);
+}
+
+static char* c_emitter_visit_grouping_expr(struct c_emitter* emitter,
+                                           struct grouping_expr* expr)
+{
+  return alloc_printf("(%s)",
+                      expr_accept_c_emitter(expr->expression, emitter));
+}
+
+static char* c_emitter_visit_literal_expr(struct c_emitter* emitter,
+                                          struct literal_expr* expr)
+{
+  struct object* value = expr->value;
+  char* initializer;
+  // nil, true and false are singletons, which need no constant
+  switch (value->type) {
+    case OBJECT_TYPE_STRING:
+      initializer = alloc_printf("OBJECT_STRING((char*)%s)",
+                                 c_string(OBJECT_AS_STRING(value)));
+      break;
+    case OBJECT_TYPE_NUMBER:
+      initializer =
+          alloc_printf("OBJECT_NUMBER(%.17g)", OBJECT_AS_NUMBER(value));
+      break;
+    case OBJECT_TYPE_BOOL:
+      return alloc_printf("OBJECT_BOOL(%s)",
+                          OBJECT_AS_BOOL(value) ? "true" : "false");
+    default:
+      return "OBJECT_NULL()";
+  }
+  void** found = hash_table_try_get(
+      emitter->constant_indices, initializer, strlen(initializer));
+  long index;
+  if (found) {
+    index = (long)(uintptr_t)*found - 1;
+  } else {
+    LIST_PUSH(&emitter->constants, initializer);
+    index = emitter->constants.length - 1;
+    hash_table_insert(
+        emitter->constant_indices, initializer, (void*)(uintptr_t)(index + 1));
+  }
+  return alloc_printf("Constants[%ld]", index);
+}
+
+static char* c_emitter_visit_logical_expr(struct c_emitter* emitter,
+                                          struct logical_expr* expr)
+{
+  size_t t = temps(emitter, 1);
+  char* left = expr_accept_c_emitter(expr->left, emitter);
+  char* right = expr_accept_c_emitter(expr->right, emitter);
+  return alloc_printf("(%saot_truthy(t[%zu] = %s) ? t[%zu] : %s)",
+                      expr->op.type == TOKEN_OR ? "" : "!",
+                      t,
+                      left,
+                      t,
+                      right);
+}
+
+static char* c_emitter_visit_unary_expr(struct c_emitter* emitter,
+                                        struct unary_expr* expr)
+{
+  return alloc_printf("aot_unary(%s, %s)",
+                      token_ref(emitter, &expr->op),
+                      expr_accept_c_emitter(expr->right, emitter));
+}
+
+static char* c_emitter_visit_variable_expr(struct c_emitter* emitter,
+                                           struct variable_expr* expr)
+{
+  return alloc_printf("aot_get(env_%zu, %s, %s)",
+                      emitter->depth,
+                      token_ref(emitter, &expr->name),
+                      cache_ref(emitter));
+}
+
+static char* c_emitter_visit_block_stmt(struct c_emitter* emitter,
+                                        struct block_stmt* stmt)
+{
+  char* open = alloc_printf("%s{\n", indentation(emitter));
+  ++emitter->indent;
+  char* environment =
+      alloc_printf("%sstruct environment* env_%zu = "
+                   "environment_new_enclosed(env_%zu);\n",
+                   indentation(emitter),
+                   emitter->depth + 1,
+                   emitter->depth);
+  ++emitter->depth;
+  char* body = emit_statements(emitter, stmt->statements);
+  --emitter->depth;
+  --emitter->indent;
+  return alloc_printf(
+      "%s%s%s%s}\n", open, environment, body, indentation(emitter));
+}
+
+static char* c_emitter_visit_expression_stmt(struct c_emitter* emitter,
+                                             struct expression_stmt* stmt)
+{
+  return alloc_printf("%s(void)%s;\n",
+                      indentation(emitter),
+                      expr_accept_c_emitter(stmt->expression, emitter));
+}
+
+static char* c_emitter_visit_function_stmt(struct c_emitter* emitter,
+                                           struct function_stmt* stmt)
+{
+  struct c_emitter outer = *emitter;
+  emitter->temps = 0;
+  emitter->depth = 0;
+  emitter->indent = 1;
+  emitter->in_function = true;
+  char* body = emit_statements(emitter, stmt->body);
+  long id = emitter->functions.length;
+  LIST_PUSH(&emitter->functions,
+            alloc_printf("// fun %s, line %zu\n"
+                         "static struct object* lox_fn_%ld("
+                         "struct environment* env_0)\n"
+                         "{\n"
+                         "  (void)env_0;\n"
+                         "  struct object* t[%zu];\n"
+                         "  (void)t;\n"
+                         "%s"
+                         "  return OBJECT_NULL();\n"
+                         "}\n",
+                         stmt->name.lexeme,
+                         stmt->base.line,
+                         id,
+                         emitter->temps > 0 ? emitter->temps : 1,
+                         body));
+  emitter->temps = outer.temps;
+  emitter->depth = outer.depth;
+  emitter->indent = outer.indent;
+  emitter->in_function = outer.in_function;
+
+  char* params = "NULL";
+  for (long i = 0; i < stmt->params->length; ++i) {
+    char* ref = token_ref(emitter, &stmt->params->pointer[i]);
+    if (i == 0) {
+      params = ref;
+    }
+  }
+  char* name = token_ref(emitter, &stmt->name);
+  return alloc_printf(
+      "%saot_define(env_%zu, %s, aot_function(%s, %s, %ld, lox_fn_%ld, "
+      "env_%zu));\n",
+      indentation(emitter),
+      emitter->depth,
+      name,
+      name,
+      params,
+      stmt->params->length,
+      id,
+      emitter->depth);
+}
+
+static char* c_emitter_visit_if_stmt(struct c_emitter* emitter,
+                                     struct if_stmt* stmt)
+{
+  char* condition = expr_accept_c_emitter(stmt->condition, emitter);
+  ++emitter->indent;
+  char* then_branch = stmt_accept_c_emitter(stmt->then_branch, emitter);
+  char* else_branch = stmt->else_branch
+      ? stmt_accept_c_emitter(stmt->else_branch, emitter)
+      : NULL;
+  --emitter->indent;
+  char* indent = indentation(emitter);
+  if (!else_branch) {
+    return alloc_printf("%sif (aot_truthy(%s)) {\n%s%s}\n",
+                        indent,
+                        condition,
+                        then_branch,
+                        indent);
+  }
+  return alloc_printf("%sif (aot_truthy(%s)) {\n%s%s} else {\n%s%s}\n",
+                      indent,
+                      condition,
+                      then_branch,
+                      indent,
+                      else_branch,
+                      indent);
+}
+
+static char* c_emitter_visit_print_stmt(struct c_emitter* emitter,
+                                        struct print_stmt* stmt)
+{
+  return alloc_printf("%saot_print(%s);\n",
+                      indentation(emitter),
+                      expr_accept_c_emitter(stmt->expression, emitter));
+}
+
+static char* c_emitter_visit_return_stmt(struct c_emitter* emitter,
+                                         struct return_stmt* stmt)
+{
+  if (!emitter->in_function) {
+    return alloc_printf("%sreturn 0;\n", indentation(emitter));
+  }
+  if (stmt->value && stmt->value->type == EXPR_CALL) {
+    return alloc_printf(
+        "%sreturn %s;\n",
+        indentation(emitter),
+        emit_call(emitter, (struct call_expr*)stmt->value, "aot_tail_call"));
+  }
+  return alloc_printf(
+      "%sreturn %s;\n",
+      indentation(emitter),
+      stmt->value ? expr_accept_c_emitter(stmt->value, emitter)
+                  : "OBJECT_NULL()");
+}
+
+static char* c_emitter_visit_var_stmt(struct c_emitter* emitter,
+                                      struct var_stmt* stmt)
+{
+  char* initializer = stmt->initializer
+      ? expr_accept_c_emitter(stmt->initializer, emitter)
+      : "OBJECT_NULL()";
+  return alloc_printf("%saot_define(env_%zu, %s, %s);\n",
+                      indentation(emitter),
+                      emitter->depth,
+                      token_ref(emitter, &stmt->name),
+                      initializer);
+}
+
+static char* c_emitter_visit_while_stmt(struct c_emitter* emitter,
+                                        struct while_stmt* stmt)
+{
+  char* condition = expr_accept_c_emitter(stmt->condition, emitter);
+  ++emitter->indent;
+  char* body = stmt_accept_c_emitter(stmt->body, emitter);
+  --emitter->indent;
+  char* indent = indentation(emitter);
+  return alloc_printf(
+      "%swhile (aot_truthy(%s)) {\n%s%s}\n", indent, condition, body, indent);
+}
+
+static char* emit_statements(struct c_emitter* emitter,
+                             struct stmt_list* statements)
+{
+  struct string_list code;
+  LIST_INIT(&code);
+  for (long i = 0; i < statements->length; ++i) {
+    LIST_PUSH(&code, stmt_accept_c_emitter(statements->pointer[i], emitter));
+  }
+  return join(&code);
+}
+
+static char* token_ref(struct c_emitter* emitter, struct token* token)
+{
+  LIST_PUSH(&emitter->tokens,
+            alloc_printf("{.type = %s, .lexeme = %s, .line = %zu}",
+                         TOKEN_TYPE_STRINGS[token->type],
+                         c_string(token->lexeme),
+                         token->line));
+  return alloc_printf("&Tokens[%ld]", emitter->tokens.length - 1);
+}
+
+static char* cache_ref(struct c_emitter* emitter)
+{
+  return alloc_printf("&Caches[%zu]", emitter->caches++);
+}
+
+// reserves `count` consecutive temporaries and returns the first
+static size_t temps(struct c_emitter* emitter, size_t count)
+{
+  size_t first = emitter->temps;
+  emitter->temps += count;
+  return first;
+}
+
+static char* indentation(struct c_emitter* emitter)
+{
+  size_t width = emitter->indent * INDENT_WIDTH;
+  char* spaces = alloc_atomic(width + 1);
+  memset(spaces, ' ', width);
+  spaces[width] = '\0';
+  return spaces;
+}
+
+// text as a C string literal
+static char* c_string(const char* text)
+{
+  struct string_list parts;
+  LIST_INIT(&parts);
+  LIST_PUSH(&parts, "\"");
+  for (const unsigned char* c = (const unsigned char*)text; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      LIST_PUSH(&parts, alloc_printf("\\%c", *c));
+    } else if (*c < 0x20 || *c >= 0x7f || *c == '?') {
+      LIST_PUSH(&parts, alloc_printf("\\%03o", *c));
+    } else {
+      LIST_PUSH(&parts, alloc_printf("%c", *c));
+    }
+  }
+  LIST_PUSH(&parts, "\"");
+  return join(&parts);
+}
+
+static char* join(struct string_list* strings)
+{
+  size_t length = 0;
+  for (long i = 0; i < strings->length; ++i) {
+    length += strlen(strings->pointer[i]);
+  }
+  char* result = alloc_atomic(length + 1);
+  char* cursor = result;
+  for (long i = 0; i < strings->length; ++i) {
+    size_t part = strlen(strings->pointer[i]);
+    memcpy(cursor, strings->pointer[i], part);
+    cursor += part;
+  }
+  *cursor = '\0';
+  return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <private/ast/stmt.h>
+#include <stdio.h>
+
+// Translates a parsed program into a C program built on the runtime in aot.h.
+// Every Lox function becomes a C function and every statement straight-line
+// C, so the result runs with no interpreter dispatch. Compile it against the
+// gc-c-jlox_runtime library, e.g.
+//
+//   cc -Isource -Igc-8.0.4/include out.c libgc-c-jlox_runtime.a libgc-lib.a
+//
+// (with the precise collector: cc -DALLOC_PRECISE -Isource out.c
+// libgc-c-jlox_runtime.a)
+//
+// `source` is only used in the header comment. A max_call_depth above 0 is
+// compiled in (see aot_set_max_call_depth).
+void emit_c(FILE* out,
+            struct stmt_list* statements,
+            const char* source,
+            long max_call_depth);
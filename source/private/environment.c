@@ -1,36 +1,68 @@
-#include <gc.h>
+#include <assert.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/environment.h>
+#include <private/gc_stats.h>
 #include <private/hash/fnv.h>
 #include <private/hash/table.h>
+#include <private/symbol.h>
+#include <private/threads.h>
 #include <string.h>
 
 #include "private/object.h"
 #include "private/strutils.h"
 
+#define NAMES_MASK_BIT(hash) (1ULL << ((hash) >> 58))
+
+// where an environment keeps its pointers
+static alloc_descriptor Descriptor;
+THREADS_ONCE(Described);
+
+static void describe_environment(void);
+static struct environment* environment_alloc(struct environment* enclosing);
+static struct object** environment_global_slot(struct environment* environment,
+                                               size_t symbol);
+static void environment_reserve_globals(struct environment* environment,
+                                        size_t length);
+static struct object** environment_find(struct environment* environment,
+                                        struct environment_cache* cache,
+                                        const char* name);
+static struct runtime_error* undefined_variable(struct token* name);
+
 struct environment* environment_new(void)
 {
-  struct environment* environment = GC_MALLOC(sizeof(struct environment));
-  environment->enclosing = NULL;
-  environment->values = hash_table_new(hash_fnv1a);
+  struct environment* environment = environment_alloc(NULL);
+  environment_reserve_globals(environment, symbol_count());
   return environment;
 }
 
 struct environment* environment_new_enclosed(struct environment* enclosing)
 {
-  struct environment* environment = GC_MALLOC(sizeof(struct environment));
-  environment->enclosing = enclosing;
+  struct environment* environment = environment_alloc(enclosing);
   environment->values = hash_table_new(hash_fnv1a);
+  // names are token lexemes (or literals), which outlive the environment
+  environment->values->borrow_keys = true;
   return environment;
 }
 
 void environment_dump(struct environment* environment)
 {
   printf("--- ENVIRONMENT ---\n");
-  for (size_t i = 0; i < environment->values->cap; ++i) {
-    if (environment->values->data[i].key) {
-      printf("%s: ", environment->values->data[i].key);
-      object_print(environment->values->data[i].value);
-      printf("\n");
+  if (ENVIRONMENT_IS_GLOBAL(environment)) {
+    for (size_t i = 0; i < environment->globals_length; ++i) {
+      if (environment->globals[i]) {
+        printf("%s: ", symbol_name(i));
+        object_print(environment->globals[i]);
+        printf("\n");
+      }
+    }
+  } else {
+    for (size_t i = 0; i < environment->values->cap; ++i) {
+      if (environment->values->data[i].key) {
+        printf("%s: ", environment->values->data[i].key);
+        object_print(environment->values->data[i].value);
+        printf("\n");
+      }
     }
   }
   if (environment->enclosing) {
@@ -41,45 +73,227 @@ void environment_dump(struct environment* environment)
   printf("--- END ENVIRONMENT ---\n");
 }
 
+void environment_capture(struct environment* environment)
+{
+  while (environment && !environment->captured) {
+    environment->captured = true;
+    environment = environment->enclosing;
+  }
+}
+
+void environment_reset(struct environment* environment,
+                       struct environment* enclosing)
+{
+  assert(!environment->captured && !ENVIRONMENT_IS_GLOBAL(environment));
+  environment->enclosing = enclosing;
+  environment->names_mask = 0;
+  hash_table_clear(environment->values);
+}
+
+struct environment* environment_pool_take(struct environment_pool* pool,
+                                          struct environment* enclosing)
+{
+  struct environment* environment = pool->free;
+  if (!environment) {
+    return environment_new_enclosed(enclosing);
+  }
+  pool->free = environment->enclosing;
+  --pool->length;
+  environment->enclosing = enclosing;
+  return environment;
+}
+
+void environment_pool_give(struct environment_pool* pool,
+                           struct environment* environment)
+{
+  if (pool->length >= ENVIRONMENT_POOL_MAX) {
+    return;
+  }
+  // emptied now rather than on reuse, so the pool keeps no values alive
+  environment_reset(environment, pool->free);
+  pool->free = environment;
+  ++pool->length;
+}
+
 void environment_define(struct environment* environment,
                         const char* name,
                         struct object* value)
 {
-  hash_table_insert(environment->values, name, value);
+  if (ENVIRONMENT_IS_GLOBAL(environment)) {
+    size_t symbol = symbol_intern(name);
+    environment_reserve_globals(environment, symbol + 1);
+    environment->globals[symbol] = value;
+    return;
+  }
+  uint64_t hash = hash_fnv1a(name, strlen(name));
+  environment->names_mask |= NAMES_MASK_BIT(hash);
+  hash_table_insert_hashed(environment->values, name, hash, value);
 }
 
 struct environment_lookup_result environment_get(
     struct environment* environment, struct token* name)
 {
-  struct object** result = (struct object**)hash_table_try_get(
-      environment->values, name->lexeme, strlen(name->lexeme));
-  if (result) {
-    return ENVIRONMENT_LOOKUP_OK(*result);
-  }
-
-  if (environment->enclosing != NULL) {
-    return environment_get(environment->enclosing, name);
-  }
-
-  return ENVIRONMENT_LOOKUP_ERROR(runtime_error_new(
-      name, alloc_printf("Undefined variable '%s'.", name->lexeme)));
+  struct environment_cache cache = ENVIRONMENT_CACHE_EMPTY;
+  return environment_get_cached(environment, name, &cache);
 }
 
 struct runtime_error* environment_assign(struct environment* environment,
                                          struct token* name,
                                          struct object* value)
 {
-  struct object** loc = (struct object**)hash_table_try_get(
-      environment->values, name->lexeme, strlen(name->lexeme));
+  struct environment_cache cache = ENVIRONMENT_CACHE_EMPTY;
+  return environment_assign_cached(environment, name, value, &cache);
+}
+
+struct environment_lookup_result environment_get_cached(
+    struct environment* environment,
+    struct token* name,
+    struct environment_cache* cache)
+{
+  struct object** result = environment_find_cached(environment, name, cache);
+  if (result) {
+    return ENVIRONMENT_LOOKUP_OK(*result);
+  }
+  return ENVIRONMENT_LOOKUP_ERROR(undefined_variable(name));
+}
+
+struct runtime_error* environment_assign_cached(
+    struct environment* environment,
+    struct token* name,
+    struct object* value,
+    struct environment_cache* cache)
+{
+  struct object** loc = environment_find_cached(environment, name, cache);
   if (loc) {
     *loc = value;
     return NULL;
   }
+  return undefined_variable(name);
+}
+
+static void describe_environment(void)
+{
+  struct alloc_layout layout;
+  alloc_layout_init(&layout, sizeof(struct environment));
+  ALLOC_LAYOUT_POINTER(&layout, struct environment, enclosing);
+  ALLOC_LAYOUT_POINTER(&layout, struct environment, values);
+  ALLOC_LAYOUT_POINTER(&layout, struct environment, globals);
+  Descriptor = alloc_layout_descriptor(&layout);
+}
+
+static struct environment* environment_alloc(struct environment* enclosing)
+{
+  THREADS_CALL_ONCE(Described, describe_environment);
+  struct environment* environment =
+      alloc_typed(sizeof(struct environment), Descriptor);
+  gc_stats_count_allocation(GC_STATS_KIND_ENVIRONMENT,
+                            sizeof(struct environment));
+  alloc_profiler_record(sizeof(struct environment));
+  environment->enclosing = enclosing;
+  environment->values = NULL;
+  environment->globals = NULL;
+  environment->globals_length = 0;
+  environment->names_mask = 0;
+  environment->captured = false;
+  return environment;
+}
+
+static struct object** environment_global_slot(struct environment* environment,
+                                               size_t symbol)
+{
+  if (symbol < environment->globals_length && environment->globals[symbol]) {
+    return &environment->globals[symbol];
+  }
+  return NULL;
+}
+
+static void environment_reserve_globals(struct environment* environment,
+                                        size_t length)
+{
+  if (length <= environment->globals_length) {
+    return;
+  }
+  size_t new_length = environment->globals_length == 0
+      ? length
+      : environment->globals_length;
+  while (new_length < length) {
+    new_length *= 2;
+  }
+  environment->globals = alloc_realloc(environment->globals,
+                                    new_length * sizeof(struct object*));
+  alloc_profiler_record(new_length * sizeof(struct object*));
+  memset(environment->globals + environment->globals_length,
+         0,
+         (new_length - environment->globals_length) * sizeof(struct object*));
+  environment->globals_length = new_length;
+}
+
+static struct object** environment_find(struct environment* environment,
+                                        struct environment_cache* cache,
+                                        const char* name)
+{
+  uint64_t bit = NAMES_MASK_BIT(cache->hash);
+  for (cache->depth = 0; environment; environment = environment->enclosing) {
+    if (ENVIRONMENT_IS_GLOBAL(environment)) {
+      cache->slot = cache->symbol;
+      return environment_global_slot(environment, cache->symbol);
+    }
+    if (environment->names_mask & bit) {
+      long found = hash_table_find_slot(
+          environment->values, name, cache->length, cache->hash);
+      if (found >= 0) {
+        cache->slot = (size_t)found;
+        return (struct object**)&environment->values->data[found].value;
+      }
+    }
+    ++cache->depth;
+  }
+  return NULL;
+}
 
-  if (environment->enclosing != NULL) {
-    return environment_assign(environment->enclosing, name, value);
+struct object** environment_find_cached(
+    struct environment* environment,
+    struct token* name,
+    struct environment_cache* cache)
+{
+  if (!cache->prepared) {
+    cache->length = strlen(name->lexeme);
+    cache->hash = hash_fnv1a(name->lexeme, cache->length);
+    cache->symbol = name->symbol != SYMBOL_NONE ? name->symbol
+                                                : symbol_intern(name->lexeme);
+    cache->prepared = true;
   }
 
+  if (cache->valid) {
+    uint64_t bit = NAMES_MASK_BIT(cache->hash);
+    struct environment* target = environment;
+    size_t depth = 0;
+    while (target && depth < cache->depth && !(target->names_mask & bit)) {
+      target = target->enclosing;
+      ++depth;
+    }
+    if (target && depth == cache->depth) {
+      if (ENVIRONMENT_IS_GLOBAL(target)) {
+        struct object** loc = environment_global_slot(target, cache->symbol);
+        if (loc) {
+          return loc;
+        }
+      } else if (cache->slot < target->values->cap) {
+        struct hash_bucket* bucket = &target->values->data[cache->slot];
+        if (bucket->key && strcmp(bucket->key, name->lexeme) == 0) {
+          return (struct object**)&bucket->value;
+        }
+      }
+    }
+  }
+
+  struct object** loc = environment_find(environment, cache, name->lexeme);
+  cache->valid = loc != NULL;
+  return loc;
+}
+
+static struct runtime_error* undefined_variable(struct token* name)
+{
   return runtime_error_new(
       name, alloc_printf("Undefined variable '%s'.", name->lexeme));
 }
@@ -4,12 +4,58 @@
 #include <private/object.h>
 #include <private/runtime_error.h>
 #include <private/token.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+// The outermost (global) environment has no hash table: its variables live
+// in `globals`, indexed by symbol ID (see private/symbol.h), where NULL means
+// undefined. Every other environment keeps its variables in `values`.
 struct environment {
   struct environment* enclosing;
   struct hash_table* values;
+  struct object** globals;
+  size_t globals_length;
+  // one bit per defined name, chosen by the top bits of the name's hash;
+  // a clear bit proves the name is not defined here without probing values
+  uint64_t names_mask;
+  // set once a closure may refer to this environment, after which it must
+  // not be reused by environment_reset
+  bool captured;
 };
 
+#define ENVIRONMENT_IS_GLOBAL(environment) ((environment)->values == NULL)
+
+// most environments a pool keeps; the rest are left to the collector
+#define ENVIRONMENT_POOL_MAX 64
+
+// Environments of finished scopes that nothing captured, kept for reuse so
+// that calls and blocks don't allocate. They are linked through enclosing.
+struct environment_pool {
+  struct environment* free;
+  size_t length;
+};
+
+// Per-site cache of where a name was last found: `depth` enclosing links up
+// from the current environment, in bucket `slot` of that table (or at index
+// `symbol` of the global table). It is used only if no environment on the
+// way has the name's bit in its names_mask and the slot still holds the
+// name.
+struct environment_cache {
+  bool prepared;
+  bool valid;
+  uint64_t hash;
+  size_t length;
+  size_t symbol;
+  size_t depth;
+  size_t slot;
+};
+
+#define ENVIRONMENT_CACHE_EMPTY \
+  (struct environment_cache) \
+  { \
+    .prepared = false, .valid = false \
+  }
+
 enum environment_lookup_result_type
 {
   ENVIRONMENT_LOOKUP_RESULT_OK,
@@ -43,9 +89,22 @@ struct environment_lookup_result {
 #define ENVIRONMENT_LOOKUP_RESULT_GET_OK(res) ((res)->u.o)
 #define ENVIRONMENT_LOOKUP_RESULT_GET_ERROR(res) ((res)->u.e)
 
+// creates a global environment
 struct environment* environment_new(void);
 struct environment* environment_new_enclosed(struct environment* enclosing);
 void environment_dump(struct environment* environment);
+// marks the environment and everything it encloses as captured by a closure
+void environment_capture(struct environment* environment);
+// empties an uncaptured, non-global environment for reuse under a new
+// enclosing environment
+void environment_reset(struct environment* environment,
+                       struct environment* enclosing);
+// an empty environment under `enclosing`, from the pool if it has one
+struct environment* environment_pool_take(struct environment_pool* pool,
+                                          struct environment* enclosing);
+// returns an environment that no closure captured to the pool
+void environment_pool_give(struct environment_pool* pool,
+                           struct environment* environment);
 void environment_define(struct environment* environment,
                         const char* name,
                         struct object* value);
@@ -54,3 +113,16 @@ struct environment_lookup_result environment_get(
 struct runtime_error* environment_assign(struct environment* environment,
                                          struct token* name,
                                          struct object* value);
+struct environment_lookup_result environment_get_cached(
+    struct environment* environment,
+    struct token* name,
+    struct environment_cache* cache);
+struct runtime_error* environment_assign_cached(
+    struct environment* environment,
+    struct token* name,
+    struct object* value,
+    struct environment_cache* cache);
+// the storage for a variable, or NULL if it is undefined
+struct object** environment_find_cached(struct environment* environment,
+                                        struct token* name,
+                                        struct environment_cache* cache);
@@ -0,0 +1,48 @@
+#include <private/assertions.h>
+#include <private/escape.h>
+
+static bool declares_function(struct stmt* stmt);
+static bool list_declares_function(struct stmt_list* statements);
+
+bool escape_scope_escapes(enum scope_escape* escape,
+                          struct stmt_list* statements)
+{
+  if (*escape == SCOPE_ESCAPE_UNKNOWN) {
+    *escape = list_declares_function(statements) ? SCOPE_ESCAPE_YES
+                                                 : SCOPE_ESCAPE_NO;
+  }
+  return *escape == SCOPE_ESCAPE_YES;
+}
+
+static bool declares_function(struct stmt* stmt)
+{
+  switch (stmt->type) {
+    case STMT_FUNCTION:
+      return true;
+    case STMT_BLOCK:
+      return list_declares_function(((struct block_stmt*)stmt)->statements);
+    case STMT_IF: {
+      struct if_stmt* if_stmt = (struct if_stmt*)stmt;
+      return declares_function(if_stmt->then_branch)
+          || (if_stmt->else_branch && declares_function(if_stmt->else_branch));
+    }
+    case STMT_WHILE:
+      return declares_function(((struct while_stmt*)stmt)->body);
+    case STMT_EXPRESSION:
+    case STMT_PRINT:
+    case STMT_RETURN:
+    case STMT_VAR:
+      return false;
+  }
+  ASSERT_UNREACHABLE();
+}
+
+static bool list_declares_function(struct stmt_list* statements)
+{
+  for (long i = 0; i < statements->length; ++i) {
+    if (declares_function(statements->pointer[i])) {
+      return true;
+    }
+  }
+  return false;
+}
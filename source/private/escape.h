@@ -0,0 +1,17 @@
+#pragma once
+
+#include <private/ast/stmt.h>
+#include <stdbool.h>
+
+// Escape analysis for scopes.
+//
+// The environment a function body or block runs in can outlive the run only
+// if a closure captures it, and only a function declaration makes closures.
+// So a scope whose statements declare no function, at any depth, cannot
+// escape: its environment is garbage once the run is over, and the
+// interpreter hands it back to its environment pool instead.
+
+// whether a closure may capture the scope `statements` run in; worked out
+// once and kept in *escape
+bool escape_scope_escapes(enum scope_escape* escape,
+                          struct stmt_list* statements);
@@ -0,0 +1,266 @@
+#include <limits.h>
+#include <private/alloc.h>
+#include <private/gc_stats.h>
+#include <private/threads.h>
+#include <private/timing.h>
+#include <stdbool.h>
+
+const char* GC_STATS_KIND_STRINGS[] = {
+#define VARIANT(x, name) name,
+#include "gc_stats_kind.inl"
+#undef VARIANT
+};
+
+const unsigned long long GC_STATS_PAUSE_BUCKET_LIMITS_NS[] = {
+    100000ULL,
+    250000ULL,
+    500000ULL,
+    1000000ULL,
+    2500000ULL,
+    5000000ULL,
+    10000000ULL,
+    25000000ULL,
+    50000000ULL,
+    ULLONG_MAX,
+};
+
+static bool Enabled = false;
+static size_t Collections = 0;
+static size_t PeakHeapSize = 0;
+static size_t Pauses = 0;
+static unsigned long long TotalPauseNs = 0;
+static unsigned long long MaxPauseNs = 0;
+static size_t PauseHistogram[GC_STATS_PAUSE_BUCKETS];
+// start of the pause in progress, 0 if none
+static unsigned long long PauseStartNs = 0;
+// last time a stopped mark checked whether to give up (see on_mark_progress)
+static unsigned long long MarkProgressNs = 0;
+#ifndef ALLOC_PRECISE
+// between GC_EVENT_START and GC_EVENT_END: a full, stop-the-world collection
+static bool InCollection = false;
+#endif
+static struct gc_stats_kind_counter KindCounters[GC_STATS_KIND_COUNT];
+static gc_stats_pause_hook PauseHook = NULL;
+
+#ifdef ALLOC_PRECISE
+static void on_collection_event(enum alloc_event event);
+#else
+static void on_collection_event(GC_EventType event);
+static int GC_CALLBACK on_mark_progress(void);
+static void on_heap_resize(GC_word new_size);
+#endif
+static void begin_pause(unsigned long long start);
+static void end_pause(unsigned long long end);
+static void update_peak_heap_size(void);
+
+void gc_stats_enable(void)
+{
+  if (Enabled) {
+    return;
+  }
+  Enabled = true;
+#ifdef ALLOC_PRECISE
+  alloc_set_event_hook(on_collection_event);
+#else
+  GC_set_on_collection_event(on_collection_event);
+  GC_set_on_heap_resize(on_heap_resize);
+  GC_set_stop_func(on_mark_progress);
+#endif
+}
+
+void gc_stats_set_pause_hook(gc_stats_pause_hook hook)
+{
+  PauseHook = hook;
+}
+
+bool gc_stats_enabled(void)
+{
+  return Enabled;
+}
+
+void gc_stats_count_allocation(enum gc_stats_kind kind, size_t size)
+{
+  THREADS_ADD(KindCounters[kind].count, 1);
+  THREADS_ADD(KindCounters[kind].bytes, size);
+}
+
+struct gc_stats gc_stats_get(void)
+{
+  struct alloc_heap_stats heap = alloc_get_heap_stats();
+  update_peak_heap_size();
+  if (PauseStartNs) {
+    // the program is running, so the last stopped mark was abandoned
+    end_pause(MarkProgressNs);
+  }
+
+  struct gc_stats stats = {
+      .collections = Collections,
+      .total_bytes = heap.total_bytes,
+      .heap_size = heap.heap_size,
+      .peak_heap_size = PeakHeapSize,
+      .free_bytes = heap.free_bytes,
+      .pauses = Pauses,
+      .total_pause_ns = TotalPauseNs,
+      .max_pause_ns = MaxPauseNs,
+  };
+  for (size_t i = 0; i < GC_STATS_KIND_COUNT; ++i) {
+    stats.kinds[i] = KindCounters[i];
+  }
+  for (size_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i) {
+    stats.pause_histogram[i] = PauseHistogram[i];
+  }
+  return stats;
+}
+
+void gc_stats_fprint(FILE* fp)
+{
+  struct gc_stats stats = gc_stats_get();
+  double mean_pause_ms = stats.pauses == 0
+      ? 0.0
+      : (double)stats.total_pause_ns / (double)stats.pauses / 1e6;
+
+  fprintf(fp, "--- GC STATS ---\n");
+  fprintf(fp, "collections: %zu\n", stats.collections);
+  fprintf(fp, "total allocated: %zu bytes\n", stats.total_bytes);
+  fprintf(fp, "heap size: %zu bytes\n", stats.heap_size);
+  fprintf(fp, "peak heap size: %zu bytes\n", stats.peak_heap_size);
+  fprintf(fp, "free bytes: %zu bytes\n", stats.free_bytes);
+  fprintf(fp,
+          "pause time: total %.3f ms, max %.3f ms, mean %.3f ms\n",
+          (double)stats.total_pause_ns / 1e6,
+          (double)stats.max_pause_ns / 1e6,
+          mean_pause_ms);
+  fprintf(fp, "pauses: %zu\n", stats.pauses);
+  for (size_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i) {
+    if (i + 1 < GC_STATS_PAUSE_BUCKETS) {
+      fprintf(fp,
+              "  <= %7.3f ms %10zu\n",
+              (double)GC_STATS_PAUSE_BUCKET_LIMITS_NS[i] / 1e6,
+              stats.pause_histogram[i]);
+    } else {
+      fprintf(fp,
+              "  >  %7.3f ms %10zu\n",
+              (double)GC_STATS_PAUSE_BUCKET_LIMITS_NS[i - 1] / 1e6,
+              stats.pause_histogram[i]);
+    }
+  }
+  fprintf(fp, "allocations by kind:\n");
+  for (size_t i = 0; i < GC_STATS_KIND_COUNT; ++i) {
+    fprintf(fp,
+            "  %-16s %10zu allocations %12zu bytes\n",
+            GC_STATS_KIND_STRINGS[i],
+            stats.kinds[i].count,
+            stats.kinds[i].bytes);
+  }
+  fprintf(fp, "--- END GC STATS ---\n");
+}
+
+#ifdef ALLOC_PRECISE
+
+// the precise collector always stops the program for a whole collection
+static void on_collection_event(enum alloc_event event)
+{
+  switch (event) {
+    case ALLOC_EVENT_START:
+      begin_pause(timing_now_ns());
+      break;
+    case ALLOC_EVENT_END:
+      ++Collections;
+      end_pause(timing_now_ns());
+      update_peak_heap_size();
+      break;
+  }
+}
+
+#else
+
+// Called with the GC lock held, so only lock-free getters may be used here.
+//
+// A full collection runs from GC_EVENT_START to GC_EVENT_END. In incremental
+// mode the collector instead marks a little at a time from allocations and
+// then tries to finish with the world stopped, sending only
+// GC_EVENT_MARK_START; if that stopped mark runs past the time limit it is
+// abandoned without an event, otherwise the collection finishes with
+// GC_EVENT_RECLAIM_END.
+static void on_collection_event(GC_EventType event)
+{
+  switch (event) {
+    case GC_EVENT_START:
+      InCollection = true;
+      begin_pause(timing_now_ns());
+      break;
+    case GC_EVENT_MARK_START:
+      if (!InCollection) {
+        if (PauseStartNs) {
+          end_pause(MarkProgressNs);
+        }
+        begin_pause(timing_now_ns());
+      }
+      break;
+    case GC_EVENT_RECLAIM_END:
+      if (!InCollection && PauseStartNs) {
+        ++Collections;
+        end_pause(timing_now_ns());
+      }
+      break;
+    case GC_EVENT_END:
+      InCollection = false;
+      ++Collections;
+      end_pause(timing_now_ns());
+      break;
+    default:
+      break;
+  }
+}
+
+// Polled by stopped marks to decide whether to give up; it never does, but
+// the last poll is as close as we get to the end of an abandoned mark.
+static int GC_CALLBACK on_mark_progress(void)
+{
+  MarkProgressNs = timing_now_ns();
+  return 0;
+}
+
+#endif
+
+static void begin_pause(unsigned long long start)
+{
+  PauseStartNs = start;
+  MarkProgressNs = start;
+}
+
+static void end_pause(unsigned long long end)
+{
+  unsigned long long pause = end - PauseStartNs;
+  ++Pauses;
+  TotalPauseNs += pause;
+  if (pause > MaxPauseNs) {
+    MaxPauseNs = pause;
+  }
+  size_t bucket = 0;
+  while (pause > GC_STATS_PAUSE_BUCKET_LIMITS_NS[bucket]) {
+    ++bucket;
+  }
+  ++PauseHistogram[bucket];
+  if (PauseHook) {
+    PauseHook(PauseStartNs, end);
+  }
+  PauseStartNs = 0;
+}
+
+#ifndef ALLOC_PRECISE
+static void on_heap_resize(GC_word new_size)
+{
+  if (new_size > PeakHeapSize) {
+    PeakHeapSize = new_size;
+  }
+}
+#endif
+
+static void update_peak_heap_size(void)
+{
+  size_t heap_size = alloc_get_heap_stats().heap_size;
+  if (heap_size > PeakHeapSize) {
+    PeakHeapSize = heap_size;
+  }
+}
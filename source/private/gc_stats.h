@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+enum gc_stats_kind
+{
+#define VARIANT(x, name) x,
+#include "gc_stats_kind.inl"
+#undef VARIANT
+  GC_STATS_KIND_COUNT,
+};
+
+extern const char* GC_STATS_KIND_STRINGS[];
+
+// upper bounds of the pause histogram's buckets, in nanoseconds; the last
+// bucket takes everything longer
+#define GC_STATS_PAUSE_BUCKETS 10
+extern const unsigned long long GC_STATS_PAUSE_BUCKET_LIMITS_NS[];
+
+struct gc_stats_kind_counter {
+  size_t count;
+  size_t bytes;
+};
+
+struct gc_stats {
+  size_t collections;
+  size_t total_bytes;
+  size_t heap_size;
+  size_t peak_heap_size;
+  size_t free_bytes;
+  // A pause is wall-clock time the collector runs without returning to the
+  // program: a whole collection normally, or one stopped mark (and the sweep
+  // that finishes it) in incremental mode, where a collection takes several
+  // pauses. Times are in nanoseconds.
+  size_t pauses;
+  unsigned long long total_pause_ns;
+  unsigned long long max_pause_ns;
+  size_t pause_histogram[GC_STATS_PAUSE_BUCKETS];
+  struct gc_stats_kind_counter kinds[GC_STATS_KIND_COUNT];
+};
+
+// called after every pause with its start and end in timing_now_ns()
+// time, while the GC lock is held
+typedef void (*gc_stats_pause_hook)(unsigned long long start_ns,
+                                    unsigned long long end_ns);
+
+void gc_stats_enable(void);
+void gc_stats_set_pause_hook(gc_stats_pause_hook hook);
+bool gc_stats_enabled(void);
+void gc_stats_count_allocation(enum gc_stats_kind kind, size_t size);
+struct gc_stats gc_stats_get(void);
+void gc_stats_fprint(FILE* fp);
@@ -0,0 +1,10 @@
+VARIANT(GC_STATS_KIND_STRING, "string")
+VARIANT(GC_STATS_KIND_NUMBER, "number")
+VARIANT(GC_STATS_KIND_BOOL, "bool")
+VARIANT(GC_STATS_KIND_NULL, "nil")
+VARIANT(GC_STATS_KIND_NATIVE_FUNCTION, "native function")
+VARIANT(GC_STATS_KIND_FUNCTION, "function")
+VARIANT(GC_STATS_KIND_WEAK_MAP, "weak map")
+VARIANT(GC_STATS_KIND_ENVIRONMENT, "environment")
+VARIANT(GC_STATS_KIND_EXPR, "expr")
+VARIANT(GC_STATS_KIND_STMT, "stmt")
@@ -1,4 +1,5 @@
-#include <gc.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/hash/table.h>
 #include <string.h>
 
@@ -14,24 +15,41 @@ static void insert_raw(struct hash_bucket* buckets,
 
 struct hash_table* hash_table_new(hash_function function)
 {
-  struct hash_table* table = GC_MALLOC(sizeof(struct hash_table));
+  struct hash_table* table = alloc_untyped(sizeof(struct hash_table));
+  alloc_profiler_record(sizeof(struct hash_table));
   table->data = NULL;
   table->len = 0;
   table->cap = 0;
   table->function = function;
+  table->borrow_keys = false;
   return table;
 }
 
 void hash_table_insert(struct hash_table* table, const char* key, void* value)
 {
-  if (table->len == 0 || (double)table->len / (double)table->cap > MAX_LOAD) {
+  hash_table_insert_hashed(
+      table, key, table->function(key, strlen(key)), value);
+}
+
+void hash_table_insert_hashed(struct hash_table* table,
+                              const char* key,
+                              uint64_t hash,
+                              void* value)
+{
+  long slot = hash_table_find_slot(table, key, strlen(key), hash);
+  if (slot >= 0) {
+    table->data[slot].value = value;
+    return;
+  }
+  if (table->cap == 0 || (double)table->len / (double)table->cap > MAX_LOAD) {
     rehash(table);
   }
-  insert_raw(table->data,
-             table->cap,
-             table->function(key, strlen(key)),
-             GC_STRDUP(key),
-             value);
+  char* stored = (char*)key;
+  if (!table->borrow_keys) {
+    stored = alloc_strdup(key);
+    alloc_profiler_record(strlen(key) + 1);
+  }
+  insert_raw(table->data, table->cap, hash, stored, value);
   ++table->len;
 }
 
@@ -49,16 +67,41 @@ void** hash_table_try_get(struct hash_table* table,
   if (table->len == 0) {
     return NULL;
   }
-  uint64_t hash = table->function(key_begin, key_len) % table->cap;
+  long slot = hash_table_find_slot(
+      table, key_begin, key_len, table->function(key_begin, key_len));
+  if (slot < 0) {
+    return NULL;
+  }
+  return &table->data[slot].value;
+}
+
+void hash_table_clear(struct hash_table* table)
+{
+  for (size_t i = 0; i < table->cap; ++i) {
+    table->data[i].key = NULL;
+    table->data[i].value = NULL;
+  }
+  table->len = 0;
+}
+
+long hash_table_find_slot(struct hash_table* table,
+                          const char* key_begin,
+                          size_t key_len,
+                          uint64_t hash)
+{
+  if (table->len == 0) {
+    return -1;
+  }
+  hash %= table->cap;
   while (table->data[hash].key) {
     if (key_len == strlen(table->data[hash].key)
         && strncmp(table->data[hash].key, key_begin, key_len) == 0)
     {
-      return &table->data[hash].value;
+      return (long)hash;
     }
     hash = (hash + 1) % table->cap;
   }
-  return NULL;
+  return -1;
 }
 
 static void rehash(struct hash_table* table)
@@ -70,7 +113,8 @@ static void rehash(struct hash_table* table)
     table->cap *= 2;
   }
   struct hash_bucket* newdata =
-      GC_MALLOC(table->cap * sizeof(struct hash_bucket));
+      alloc_untyped(table->cap * sizeof(struct hash_bucket));
+  alloc_profiler_record(table->cap * sizeof(struct hash_bucket));
   for (size_t i = 0; i < table->cap; ++i) {
     newdata[i].key = NULL;
   }
@@ -98,6 +142,6 @@ static void insert_raw(struct hash_bucket* buckets,
   while (buckets[hash].key) {
     hash = (hash + 1) % cap;
   }
-  buckets[hash].key = GC_STRDUP(key);
+  buckets[hash].key = key;
   buckets[hash].value = value;
 }
@@ -16,13 +16,30 @@ struct hash_table {
   hash_function function;
   size_t len;
   size_t cap;
+  // keys are copied on insert unless the caller promises they outlive the
+  // table
+  bool borrow_keys;
 };
 
 struct hash_table* hash_table_new(hash_function function);
 void hash_table_insert(struct hash_table* table, const char* key, void* value);
+// same as hash_table_insert, with the key already hashed by the table's
+// hash function
+void hash_table_insert_hashed(struct hash_table* table,
+                              const char* key,
+                              uint64_t hash,
+                              void* value);
 bool hash_table_contains(struct hash_table* table,
                          const char* key_begin,
                          size_t key_len);
 void** hash_table_try_get(struct hash_table* table,
                           const char* key_begin,
                           size_t key_len);
+// removes every entry but keeps the bucket array
+void hash_table_clear(struct hash_table* table);
+// index into table->data of the bucket holding the key, or -1; the key must
+// already be hashed by the table's hash function
+long hash_table_find_slot(struct hash_table* table,
+                          const char* key_begin,
+                          size_t key_len,
+                          uint64_t hash);
@@ -0,0 +1,380 @@
+#include <private/alloc.h>
+#include <private/environment.h>
+#include <private/hash/fnv.h>
+#include <private/hash/table.h>
+#include <private/heap_snapshot.h>
+#include <private/list.h>
+#include <private/operators.h>
+#include <private/strutils.h>
+#include <private/symbol.h>
+#include <private/weak_map.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NODE_FIELD_COUNT 6
+
+// indices into node_types and edge_types in the snapshot's meta
+enum node_type
+{
+  NODE_TYPE_HIDDEN = 0,
+  NODE_TYPE_STRING = 2,
+  NODE_TYPE_OBJECT = 3,
+  NODE_TYPE_CLOSURE = 5,
+  NODE_TYPE_NUMBER = 7,
+  NODE_TYPE_NATIVE = 8,
+  NODE_TYPE_SYNTHETIC = 9,
+};
+
+enum edge_type
+{
+  EDGE_TYPE_CONTEXT = 0,
+  EDGE_TYPE_PROPERTY = 2,
+  EDGE_TYPE_INTERNAL = 3,
+  EDGE_TYPE_WEAK = 6,
+};
+
+enum node_kind
+{
+  NODE_KIND_ROOT,
+  NODE_KIND_ENVIRONMENT,
+  NODE_KIND_OBJECT,
+};
+
+struct node {
+  enum node_kind kind;
+  void* pointer;
+  enum node_type type;
+  size_t name;
+  size_t self_size;
+  size_t edge_count;
+};
+
+struct edge {
+  enum edge_type type;
+  size_t name;
+  size_t to;
+};
+
+DECLARE_NAMED_LIST(node_list, struct node);
+DECLARE_NAMED_LIST(edge_list, struct edge);
+DECLARE_NAMED_LIST(string_list, const char*);
+
+struct snapshot {
+  struct node_list nodes;
+  struct edge_list edges;
+  // node index + 1, by "%p" of the node's pointer
+  struct hash_table* node_indices;
+  struct string_list strings;
+  // string index + 1, by the string
+  struct hash_table* string_indices;
+};
+
+volatile sig_atomic_t HeapSnapshotRequested = 0;
+static const char* SignalPath = NULL;
+
+static void request_snapshot(int signal_number);
+static size_t intern_string(struct snapshot* snapshot, const char* string);
+static size_t node_for(struct snapshot* snapshot,
+                       enum node_kind kind,
+                       void* pointer);
+static void add_edge(struct snapshot* snapshot,
+                     enum edge_type type,
+                     const char* name,
+                     enum node_kind kind,
+                     void* pointer);
+static void describe_environment(struct snapshot* snapshot, struct node* node);
+static void describe_object(struct snapshot* snapshot, struct node* node);
+static void fprint_snapshot(FILE* fp, struct snapshot* snapshot);
+
+bool heap_snapshot_write(struct interpreter* interpreter, const char* path)
+{
+  FILE* fp = fopen(path, "we");
+  if (!fp) {
+    return false;
+  }
+
+  struct snapshot snapshot;
+  LIST_INIT(&snapshot.nodes);
+  LIST_INIT(&snapshot.edges);
+  snapshot.node_indices = hash_table_new(hash_fnv1a);
+  LIST_INIT(&snapshot.strings);
+  snapshot.string_indices = hash_table_new(hash_fnv1a);
+  // string 0 is the empty name
+  intern_string(&snapshot, "");
+
+  node_for(&snapshot, NODE_KIND_ROOT, NULL);
+  snapshot.nodes.pointer[0].name = intern_string(&snapshot, "(root)");
+  add_edge(&snapshot,
+           EDGE_TYPE_PROPERTY,
+           "globals",
+           NODE_KIND_ENVIRONMENT,
+           interpreter->globals);
+  add_edge(&snapshot,
+           EDGE_TYPE_PROPERTY,
+           "scope",
+           NODE_KIND_ENVIRONMENT,
+           interpreter->environment);
+  for (long i = 0; i < interpreter->frames.length; ++i) {
+    struct call_frame* frame = &interpreter->frames.pointer[i];
+    add_edge(&snapshot,
+             EDGE_TYPE_PROPERTY,
+             alloc_printf("frame %ld caller scope", i),
+             NODE_KIND_ENVIRONMENT,
+             frame->environment);
+    add_edge(&snapshot,
+             EDGE_TYPE_PROPERTY,
+             alloc_printf("frame %ld callee", i),
+             NODE_KIND_OBJECT,
+             frame->callee);
+  }
+  snapshot.nodes.pointer[0].edge_count = (size_t)snapshot.edges.length;
+
+  // nodes are described in the order they were found, so each node's edges
+  // follow the previous node's, as the format requires
+  for (long i = 1; i < snapshot.nodes.length; ++i) {
+    long edges_before = snapshot.edges.length;
+    struct node node = snapshot.nodes.pointer[i];
+    if (node.kind == NODE_KIND_ENVIRONMENT) {
+      describe_environment(&snapshot, &node);
+    } else {
+      describe_object(&snapshot, &node);
+    }
+    node.edge_count = (size_t)(snapshot.edges.length - edges_before);
+    // the list may have grown while describing
+    snapshot.nodes.pointer[i] = node;
+  }
+
+  fprint_snapshot(fp, &snapshot);
+  return fclose(fp) == 0;
+}
+
+bool heap_snapshot_on_signal(int signal_number, const char* path)
+{
+  SignalPath = path;
+  return signal(signal_number, request_snapshot) != SIG_ERR;
+}
+
+void heap_snapshot_write_requested(struct interpreter* interpreter)
+{
+  HeapSnapshotRequested = 0;
+  if (!heap_snapshot_write(interpreter, SignalPath)) {
+    fprintf(stderr, "Could not write a heap snapshot to '%s'\n", SignalPath);
+  }
+}
+
+static void request_snapshot(int signal_number)
+{
+  (void)signal_number;
+  HeapSnapshotRequested = 1;
+}
+
+static size_t intern_string(struct snapshot* snapshot, const char* string)
+{
+  void** found =
+      hash_table_try_get(snapshot->string_indices, string, strlen(string));
+  if (found) {
+    return (size_t)(uintptr_t)*found - 1;
+  }
+  size_t index = (size_t)snapshot->strings.length;
+  LIST_PUSH(&snapshot->strings, string);
+  hash_table_insert(
+      snapshot->string_indices, string, (void*)(uintptr_t)(index + 1));
+  return index;
+}
+
+// the index of the node for `pointer`, adding it (to be described later) if
+// it is new
+static size_t node_for(struct snapshot* snapshot,
+                       enum node_kind kind,
+                       void* pointer)
+{
+  char key[2 * sizeof(void*) + 3];
+  snprintf(key, sizeof key, "%p", pointer);
+  void** found = hash_table_try_get(snapshot->node_indices, key, strlen(key));
+  if (found) {
+    return (size_t)(uintptr_t)*found - 1;
+  }
+  size_t index = (size_t)snapshot->nodes.length;
+  LIST_PUSH(&snapshot->nodes,
+            ((struct node) {
+                .kind = kind,
+                .pointer = pointer,
+                .type = NODE_TYPE_SYNTHETIC,
+                .name = 0,
+                .self_size = 0,
+                .edge_count = 0,
+            }));
+  hash_table_insert(
+      snapshot->node_indices, key, (void*)(uintptr_t)(index + 1));
+  return index;
+}
+
+static void add_edge(struct snapshot* snapshot,
+                     enum edge_type type,
+                     const char* name,
+                     enum node_kind kind,
+                     void* pointer)
+{
+  if (!pointer) {
+    return;
+  }
+  struct edge edge = {
+      .type = type,
+      .name = intern_string(snapshot, name),
+      .to = node_for(snapshot, kind, pointer),
+  };
+  LIST_PUSH(&snapshot->edges, edge);
+}
+
+static void describe_environment(struct snapshot* snapshot, struct node* node)
+{
+  struct environment* environment = node->pointer;
+  node->type = NODE_TYPE_OBJECT;
+  node->self_size = alloc_size(environment);
+  if (ENVIRONMENT_IS_GLOBAL(environment)) {
+    node->name = intern_string(snapshot, "Globals");
+    node->self_size += alloc_size(environment->globals);
+    for (size_t i = 0; i < environment->globals_length; ++i) {
+      add_edge(snapshot,
+               EDGE_TYPE_CONTEXT,
+               symbol_name(i),
+               NODE_KIND_OBJECT,
+               environment->globals[i]);
+    }
+  } else {
+    struct hash_table* values = environment->values;
+    node->name = intern_string(snapshot, "Environment");
+    node->self_size += alloc_size(values) + alloc_size(values->data);
+    for (size_t i = 0; i < values->cap; ++i) {
+      if (!values->data[i].key) {
+        continue;
+      }
+      add_edge(snapshot,
+               EDGE_TYPE_CONTEXT,
+               values->data[i].key,
+               NODE_KIND_OBJECT,
+               values->data[i].value);
+    }
+  }
+  add_edge(snapshot,
+           EDGE_TYPE_INTERNAL,
+           "enclosing",
+           NODE_KIND_ENVIRONMENT,
+           environment->enclosing);
+}
+
+static void describe_object(struct snapshot* snapshot, struct node* node)
+{
+  struct object* obj = node->pointer;
+  node->self_size = alloc_size(obj);
+  switch (obj->type) {
+    case OBJECT_TYPE_STRING:
+      node->type = NODE_TYPE_STRING;
+      node->name = intern_string(snapshot, OBJECT_AS_STRING(obj));
+      node->self_size += alloc_size(OBJECT_AS_STRING(obj));
+      break;
+    case OBJECT_TYPE_NUMBER:
+      node->type = NODE_TYPE_NUMBER;
+      node->name = intern_string(snapshot, operator_stringify(obj));
+      break;
+    case OBJECT_TYPE_BOOL:
+    case OBJECT_TYPE_NULL:
+      node->type = NODE_TYPE_HIDDEN;
+      node->name = intern_string(snapshot, operator_stringify(obj));
+      break;
+    case OBJECT_TYPE_NATIVE_FUNCTION:
+      node->type = NODE_TYPE_NATIVE;
+      node->name = intern_string(snapshot, operator_stringify(obj));
+      break;
+    case OBJECT_TYPE_FUNCTION:
+      node->type = NODE_TYPE_CLOSURE;
+      node->name = intern_string(
+          snapshot, OBJECT_AS_FUNCTION(obj).declaration->name.lexeme);
+      add_edge(snapshot,
+               EDGE_TYPE_INTERNAL,
+               "context",
+               NODE_KIND_ENVIRONMENT,
+               OBJECT_AS_FUNCTION(obj).closure);
+      break;
+    case OBJECT_TYPE_WEAK_MAP: {
+      struct weak_map* map = OBJECT_AS_WEAK_MAP(obj);
+      node->type = NODE_TYPE_OBJECT;
+      node->name = intern_string(snapshot, "WeakMap");
+      node->self_size += alloc_size(map) + alloc_size(map->buckets);
+      for (size_t i = 0; i < map->capacity; ++i) {
+        for (struct weak_map_entry* entry = map->buckets[i]; entry;
+             entry = entry->next)
+        {
+          if (!entry->key) {
+            continue;
+          }
+          node->self_size += alloc_size(entry);
+          add_edge(
+              snapshot, EDGE_TYPE_WEAK, "key", NODE_KIND_OBJECT, entry->key);
+          add_edge(snapshot,
+                   EDGE_TYPE_INTERNAL,
+                   "value",
+                   NODE_KIND_OBJECT,
+                   entry->value);
+        }
+      }
+      break;
+    }
+  }
+}
+
+static void fprint_snapshot(FILE* fp, struct snapshot* snapshot)
+{
+  fprintf(fp,
+          "{\"snapshot\":{\"meta\":{"
+          "\"node_fields\":[\"type\",\"name\",\"id\",\"self_size\","
+          "\"edge_count\",\"trace_node_id\"],"
+          "\"node_types\":[[\"hidden\",\"array\",\"string\",\"object\","
+          "\"code\",\"closure\",\"regexp\",\"number\",\"native\","
+          "\"synthetic\",\"concatenated string\",\"sliced string\","
+          "\"symbol\",\"bigint\"],"
+          "\"string\",\"number\",\"number\",\"number\",\"number\"],"
+          "\"edge_fields\":[\"type\",\"name_or_index\",\"to_node\"],"
+          "\"edge_types\":[[\"context\",\"element\",\"property\","
+          "\"internal\",\"hidden\",\"shortcut\",\"weak\"],"
+          "\"string_or_number\",\"node\"],"
+          "\"trace_function_info_fields\":[],\"trace_node_fields\":[],"
+          "\"sample_fields\":[],\"location_fields\":[]},"
+          "\"node_count\":%ld,\"edge_count\":%ld,"
+          "\"trace_function_count\":0},\n",
+          snapshot->nodes.length,
+          snapshot->edges.length);
+
+  fprintf(fp, "\"nodes\":[");
+  for (long i = 0; i < snapshot->nodes.length; ++i) {
+    struct node* node = &snapshot->nodes.pointer[i];
+    // ids only need to be unique; V8 uses odd ones for heap objects
+    fprintf(fp,
+            "%s%d,%zu,%ld,%zu,%zu,0",
+            i == 0 ? "\n" : ",\n",
+            (int)node->type,
+            node->name,
+            2 * i + 1,
+            node->self_size,
+            node->edge_count);
+  }
+  fprintf(fp, "],\n\"edges\":[");
+  for (long i = 0; i < snapshot->edges.length; ++i) {
+    struct edge* edge = &snapshot->edges.pointer[i];
+    fprintf(fp,
+            "%s%d,%zu,%zu",
+            i == 0 ? "\n" : ",\n",
+            (int)edge->type,
+            edge->name,
+            edge->to * NODE_FIELD_COUNT);
+  }
+  fprintf(fp,
+          "],\n\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],"
+          "\"locations\":[],\n\"strings\":[");
+  for (long i = 0; i < snapshot->strings.length; ++i) {
+    fprintf(fp, i == 0 ? "\n" : ",\n");
+    fprint_json_string(fp, snapshot->strings.pointer[i]);
+  }
+  fprintf(fp, "]}\n");
+}
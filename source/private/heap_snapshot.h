@@ -0,0 +1,45 @@
+#pragma once
+
+#include <private/interpreter.h>
+#include <signal.h>
+#include <stdbool.h>
+
+// Writes what an interpreter can reach as a Chrome DevTools heap snapshot
+// (.heapsnapshot JSON: load it in the Memory tab, which computes retained
+// sizes and dominators). The graph starts at a synthetic "(root)" node with
+// edges to the globals, the current scope and, for each active call, the
+// caller's scope and the callee.
+//
+//   node                    type       name
+//   global environment      object     Globals
+//   other environments      object     Environment
+//   Lox functions           closure    the function's name
+//   native functions        native     <native fn>
+//   strings                 string     the string
+//   numbers                 number     the number
+//   booleans, nil           hidden     true, false, nil
+//   weak maps               object     WeakMap
+//
+// Environments have a "context" edge per variable, named after it, and an
+// "internal" edge "enclosing"; functions have an "internal" edge "context"
+// to their closure. A weak map has a "weak" edge "key" and an "internal" edge
+// "value" per entry. self_size is what the collector allocated for the node,
+// including an environment's table, a string's characters and a weak map's
+// entries. Function declarations are code and are left out.
+
+bool heap_snapshot_write(struct interpreter* interpreter, const char* path);
+
+// Makes the signal request a snapshot to `path` (overwritten each time). The
+// handler only sets HeapSnapshotRequested; the next interpreter to reach a
+// safe point (a loop iteration or a call) writes the snapshot.
+bool heap_snapshot_on_signal(int signal_number, const char* path);
+void heap_snapshot_write_requested(struct interpreter* interpreter);
+
+extern volatile sig_atomic_t HeapSnapshotRequested;
+
+#define HEAP_SNAPSHOT_POLL(interpreter) \
+  do { \
+    if (HeapSnapshotRequested) { \
+      heap_snapshot_write_requested(interpreter); \
+    } \
+  } while (false)
@@ -0,0 +1,277 @@
+#include <private/alloc.h>
+#include <private/assertions.h>
+#include <private/hoist.h>
+#include <private/symbol.h>
+#include <string.h>
+
+struct loop_analysis {
+  // indexed by symbol: declared or assigned somewhere in the loop
+  bool* assigned;
+  size_t symbols;
+  bool calls;
+  struct expr_list* invariants;
+};
+
+static void find_assignments_stmt(struct loop_analysis* loop,
+                                  struct stmt* stmt);
+static void find_assignments_expr(struct loop_analysis* loop,
+                                  struct expr* expr);
+static void mark_assigned(struct loop_analysis* loop, struct token* name);
+static void hoist_stmt(struct loop_analysis* loop, struct stmt* stmt);
+static void hoist_expr(struct loop_analysis* loop, struct expr* expr);
+static void hoist_operands(struct loop_analysis* loop, struct expr* expr);
+static bool is_invariant(struct loop_analysis* loop, struct expr* expr);
+
+struct expr_list* hoist_invariants(struct while_stmt* loop)
+{
+  struct loop_analysis analysis = {
+      .symbols = symbol_count(),
+      .calls = false,
+  };
+  analysis.assigned = alloc_atomic(analysis.symbols);
+  memset(analysis.assigned, 0, analysis.symbols);
+  analysis.invariants = alloc_untyped(sizeof(struct expr_list));
+  LIST_INIT(analysis.invariants);
+
+  find_assignments_expr(&analysis, loop->condition);
+  find_assignments_stmt(&analysis, loop->body);
+  hoist_operands(&analysis, loop->condition);
+  hoist_stmt(&analysis, loop->body);
+  return analysis.invariants;
+}
+
+struct object** hoist_slot(struct expr* expr)
+{
+  switch (expr->type) {
+    case EXPR_BINARY:
+      return &((struct binary_expr*)expr)->hoisted;
+    case EXPR_UNARY:
+      return &((struct unary_expr*)expr)->hoisted;
+    default:
+      ASSERT_UNREACHABLE();
+  }
+}
+
+static void find_assignments_stmt(struct loop_analysis* loop,
+                                  struct stmt* stmt)
+{
+  switch (stmt->type) {
+    case STMT_BLOCK: {
+      struct stmt_list* statements = ((struct block_stmt*)stmt)->statements;
+      for (long i = 0; i < statements->length; ++i) {
+        find_assignments_stmt(loop, statements->pointer[i]);
+      }
+      break;
+    }
+    case STMT_EXPRESSION:
+      find_assignments_expr(loop,
+                            ((struct expression_stmt*)stmt)->expression);
+      break;
+    case STMT_FUNCTION: {
+      struct function_stmt* function = (struct function_stmt*)stmt;
+      mark_assigned(loop, &function->name);
+      for (long i = 0; i < function->body->length; ++i) {
+        find_assignments_stmt(loop, function->body->pointer[i]);
+      }
+      break;
+    }
+    case STMT_IF: {
+      struct if_stmt* if_stmt = (struct if_stmt*)stmt;
+      find_assignments_expr(loop, if_stmt->condition);
+      find_assignments_stmt(loop, if_stmt->then_branch);
+      if (if_stmt->else_branch) {
+        find_assignments_stmt(loop, if_stmt->else_branch);
+      }
+      break;
+    }
+    case STMT_PRINT:
+      find_assignments_expr(loop, ((struct print_stmt*)stmt)->expression);
+      break;
+    case STMT_RETURN: {
+      struct return_stmt* return_stmt = (struct return_stmt*)stmt;
+      if (return_stmt->value) {
+        find_assignments_expr(loop, return_stmt->value);
+      }
+      break;
+    }
+    case STMT_VAR: {
+      struct var_stmt* var = (struct var_stmt*)stmt;
+      mark_assigned(loop, &var->name);
+      if (var->initializer) {
+        find_assignments_expr(loop, var->initializer);
+      }
+      break;
+    }
+    case STMT_WHILE: {
+      struct while_stmt* while_stmt = (struct while_stmt*)stmt;
+      find_assignments_expr(loop, while_stmt->condition);
+      find_assignments_stmt(loop, while_stmt->body);
+      break;
+    }
+  }
+}
+
+static void find_assignments_expr(struct loop_analysis* loop,
+                                  struct expr* expr)
+{
+  switch (expr->type) {
+    case EXPR_ASSIGN: {
+      struct assign_expr* assign = (struct assign_expr*)expr;
+      mark_assigned(loop, &assign->name);
+      find_assignments_expr(loop, assign->value);
+      break;
+    }
+    case EXPR_BINARY:
+      find_assignments_expr(loop, ((struct binary_expr*)expr)->left);
+      find_assignments_expr(loop, ((struct binary_expr*)expr)->right);
+      break;
+    case EXPR_CALL: {
+      struct call_expr* call = (struct call_expr*)expr;
+      loop->calls = true;
+      find_assignments_expr(loop, call->callee);
+      for (long i = 0; i < call->arguments->length; ++i) {
+        find_assignments_expr(loop, call->arguments->pointer[i]);
+      }
+      break;
+    }
+    case EXPR_GROUPING:
+      find_assignments_expr(loop, ((struct grouping_expr*)expr)->expression);
+      break;
+    case EXPR_LITERAL:
+      break;
+    case EXPR_LOGICAL:
+      find_assignments_expr(loop, ((struct logical_expr*)expr)->left);
+      find_assignments_expr(loop, ((struct logical_expr*)expr)->right);
+      break;
+    case EXPR_UNARY:
+      find_assignments_expr(loop, ((struct unary_expr*)expr)->right);
+      break;
+    case EXPR_VARIABLE:
+      break;
+  }
+}
+
+static void mark_assigned(struct loop_analysis* loop, struct token* name)
+{
+  // symbols interned after the analysis started can't be read in the loop
+  if (name->symbol < loop->symbols) {
+    loop->assigned[name->symbol] = true;
+  }
+}
+
+static void hoist_stmt(struct loop_analysis* loop, struct stmt* stmt)
+{
+  switch (stmt->type) {
+    case STMT_BLOCK: {
+      struct stmt_list* statements = ((struct block_stmt*)stmt)->statements;
+      for (long i = 0; i < statements->length; ++i) {
+        hoist_stmt(loop, statements->pointer[i]);
+      }
+      break;
+    }
+    case STMT_EXPRESSION:
+      hoist_expr(loop, ((struct expression_stmt*)stmt)->expression);
+      break;
+    case STMT_IF: {
+      struct if_stmt* if_stmt = (struct if_stmt*)stmt;
+      hoist_operands(loop, if_stmt->condition);
+      hoist_stmt(loop, if_stmt->then_branch);
+      if (if_stmt->else_branch) {
+        hoist_stmt(loop, if_stmt->else_branch);
+      }
+      break;
+    }
+    case STMT_PRINT:
+      hoist_expr(loop, ((struct print_stmt*)stmt)->expression);
+      break;
+    case STMT_RETURN: {
+      struct return_stmt* return_stmt = (struct return_stmt*)stmt;
+      if (return_stmt->value) {
+        hoist_expr(loop, return_stmt->value);
+      }
+      break;
+    }
+    case STMT_VAR: {
+      struct var_stmt* var = (struct var_stmt*)stmt;
+      if (var->initializer) {
+        hoist_expr(loop, var->initializer);
+      }
+      break;
+    }
+    case STMT_FUNCTION:
+    case STMT_WHILE:
+      break;
+  }
+}
+
+static void hoist_expr(struct loop_analysis* loop, struct expr* expr)
+{
+  if ((expr->type == EXPR_BINARY || expr->type == EXPR_UNARY)
+      && is_invariant(loop, expr))
+  {
+    LIST_PUSH(loop->invariants, expr);
+    return;
+  }
+  hoist_operands(loop, expr);
+}
+
+static void hoist_operands(struct loop_analysis* loop, struct expr* expr)
+{
+  switch (expr->type) {
+    case EXPR_ASSIGN:
+      hoist_expr(loop, ((struct assign_expr*)expr)->value);
+      break;
+    case EXPR_BINARY:
+      hoist_expr(loop, ((struct binary_expr*)expr)->left);
+      hoist_expr(loop, ((struct binary_expr*)expr)->right);
+      break;
+    case EXPR_CALL: {
+      struct call_expr* call = (struct call_expr*)expr;
+      hoist_expr(loop, call->callee);
+      for (long i = 0; i < call->arguments->length; ++i) {
+        hoist_expr(loop, call->arguments->pointer[i]);
+      }
+      break;
+    }
+    case EXPR_GROUPING:
+      hoist_expr(loop, ((struct grouping_expr*)expr)->expression);
+      break;
+    case EXPR_LOGICAL:
+      hoist_expr(loop, ((struct logical_expr*)expr)->left);
+      hoist_expr(loop, ((struct logical_expr*)expr)->right);
+      break;
+    case EXPR_UNARY:
+      hoist_expr(loop, ((struct unary_expr*)expr)->right);
+      break;
+    case EXPR_LITERAL:
+    case EXPR_VARIABLE:
+      break;
+  }
+}
+
+static bool is_invariant(struct loop_analysis* loop, struct expr* expr)
+{
+  switch (expr->type) {
+    case EXPR_ASSIGN:
+    case EXPR_CALL:
+      return false;
+    case EXPR_BINARY:
+      return is_invariant(loop, ((struct binary_expr*)expr)->left)
+          && is_invariant(loop, ((struct binary_expr*)expr)->right);
+    case EXPR_GROUPING:
+      return is_invariant(loop, ((struct grouping_expr*)expr)->expression);
+    case EXPR_LITERAL:
+      return true;
+    case EXPR_LOGICAL:
+      return is_invariant(loop, ((struct logical_expr*)expr)->left)
+          && is_invariant(loop, ((struct logical_expr*)expr)->right);
+    case EXPR_UNARY:
+      return is_invariant(loop, ((struct unary_expr*)expr)->right);
+    case EXPR_VARIABLE: {
+      size_t symbol = ((struct variable_expr*)expr)->name.symbol;
+      return !loop->calls && symbol < loop->symbols
+          && !loop->assigned[symbol];
+    }
+  }
+  ASSERT_UNREACHABLE();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <private/ast/expr.h>
+#include <private/ast/stmt.h>
+
+// Loop-invariant code motion for while loops.
+//
+// A binary or unary expression in a loop is invariant when everything it
+// reads is a literal or a variable that nothing in the loop declares or
+// assigns. If the loop makes any calls, a callee could assign any variable,
+// so only expressions of literals are invariant. The interpreter evaluates an
+// invariant expression the first time each run of the loop reaches it and
+// reuses the value for the rest of the run; since operators have no side
+// effects, only the repeated work goes away. Computing it lazily keeps runtime
+// errors where they would have happened.
+//
+// Nested loops and function bodies are left to their own analysis, and the
+// condition of a while or if is never hoisted as a whole, since the
+// interpreter tests those without going through expr->eval.
+
+// the outermost invariant expressions in loop
+struct expr_list* hoist_invariants(struct while_stmt* loop);
+// where a hoisted expression keeps its value
+struct object** hoist_slot(struct expr* expr);
@@ -0,0 +1,126 @@
+#include <private/alloc.h>
+#include <private/inliner.h>
+
+static struct inlined_call* inline_function(struct function_stmt* function,
+                                            long argument_count);
+static struct expr* inline_expr(struct expr* expr,
+                                struct token_list* params,
+                                struct literal_expr** arguments,
+                                long* budget);
+
+static bool Enabled = true;
+
+void inliner_set_enabled(bool enabled)
+{
+  Enabled = enabled;
+}
+
+struct inlined_call* inliner_lookup(struct call_expr* call,
+                                    struct object* callee)
+{
+  if (call->inline_callee == callee) {
+    return call->inlined;
+  }
+  if (!Enabled || call->callee->type != EXPR_VARIABLE) {
+    return NULL;
+  }
+  if (call->inline_callee) {
+    // the variable was rebound: deoptimize
+    call->inlined = NULL;
+    if (call->deoptimizations == INLINER_MAX_DEOPTIMIZATIONS) {
+      return NULL;
+    }
+    ++call->deoptimizations;
+  }
+  call->inline_callee = callee;
+  if (OBJECT_IS_FUNCTION(callee)) {
+    call->inlined = inline_function(OBJECT_AS_FUNCTION(callee).declaration,
+                                    call->arguments->length);
+  }
+  return call->inlined;
+}
+
+static struct inlined_call* inline_function(struct function_stmt* function,
+                                            long argument_count)
+{
+  long arity = function->params->length;
+  if (arity != argument_count || arity > INLINER_MAX_PARAMS
+      || function->body->length != 1
+      || function->body->pointer[0]->type != STMT_RETURN)
+  {
+    return NULL;
+  }
+  struct return_stmt* ret = (struct return_stmt*)function->body->pointer[0];
+  if (!ret->value) {
+    return NULL;
+  }
+
+  struct inlined_call* inlined = alloc_untyped(sizeof(struct inlined_call));
+  inlined->arguments = alloc_untyped(sizeof(struct literal_expr*) * (arity + 1));
+  for (long i = 0; i < arity; ++i) {
+    inlined->arguments[i] = expr_new_literal(OBJECT_NULL());
+  }
+  long budget = INLINER_MAX_NODES;
+  inlined->body =
+      inline_expr(ret->value, function->params, inlined->arguments, &budget);
+  return inlined->body ? inlined : NULL;
+}
+
+// Copies expr with parameter reads replaced by the argument literals. NULL if
+// expr is too big or has a node that can't be inlined.
+static struct expr* inline_expr(struct expr* expr,
+                                struct token_list* params,
+                                struct literal_expr** arguments,
+                                long* budget)
+{
+  if (--*budget < 0) {
+    return NULL;
+  }
+  switch (expr->type) {
+    case EXPR_ASSIGN:
+    case EXPR_CALL:
+      return NULL;
+    case EXPR_BINARY: {
+      struct binary_expr* binary = (struct binary_expr*)expr;
+      struct expr* left = inline_expr(binary->left, params, arguments, budget);
+      struct expr* right =
+          left ? inline_expr(binary->right, params, arguments, budget) : NULL;
+      return right ? (struct expr*)expr_new_binary(left, binary->op, right)
+                   : NULL;
+    }
+    case EXPR_GROUPING: {
+      struct expr* inner = inline_expr(((struct grouping_expr*)expr)->expression,
+                                       params,
+                                       arguments,
+                                       budget);
+      return inner ? (struct expr*)expr_new_grouping(inner) : NULL;
+    }
+    case EXPR_LITERAL:
+      return expr;
+    case EXPR_LOGICAL: {
+      struct logical_expr* logical = (struct logical_expr*)expr;
+      struct expr* left = inline_expr(logical->left, params, arguments, budget);
+      struct expr* right =
+          left ? inline_expr(logical->right, params, arguments, budget) : NULL;
+      return right ? (struct expr*)expr_new_logical(left, logical->op, right)
+                   : NULL;
+    }
+    case EXPR_UNARY: {
+      struct unary_expr* unary = (struct unary_expr*)expr;
+      struct expr* right = inline_expr(unary->right, params, arguments, budget);
+      return right ? (struct expr*)expr_new_unary(unary->op, right) : NULL;
+    }
+    case EXPR_VARIABLE: {
+      struct token name = ((struct variable_expr*)expr)->name;
+      // the last of duplicate parameters wins, as in the environment
+      for (long i = params->length - 1; i >= 0; --i) {
+        if (params->pointer[i].symbol == name.symbol) {
+          return (struct expr*)arguments[i];
+        }
+      }
+      // resolved in the closure, with a cache of its own
+      return (struct expr*)expr_new_variable(name);
+    }
+  }
+  return NULL;
+}
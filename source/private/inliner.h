@@ -0,0 +1,38 @@
+#pragma once
+
+#include <private/ast/expr.h>
+#include <private/ast/stmt.h>
+#include <private/object.h>
+
+// Inlining of small functions at their call sites.
+//
+// A function whose body is a single `return <expr>;`, where expr has at most
+// INLINER_MAX_NODES nodes and makes no calls (so the function cannot be
+// recursive), is inlined at call sites that name it through a variable. The
+// call site gets its own copy of expr in which every read of a parameter is
+// a literal; a call fills those literals with the arguments and evaluates the
+// copy in the function's closure, with no environment, frame or block.
+//
+// The copy is only valid for the function object it was made from. When the
+// variable is rebound to something else the site is deoptimized back to an
+// ordinary call, and after INLINER_MAX_DEOPTIMIZATIONS rebinds it stays that
+// way.
+//
+// The JIT compiles the same kind of function; once it has taken a callee over
+// (see jit_takes_over), calls to it go to the machine code instead.
+
+#define INLINER_MAX_NODES 16
+#define INLINER_MAX_PARAMS 8
+#define INLINER_MAX_DEOPTIMIZATIONS 4
+
+struct inlined_call {
+  struct expr* body;
+  // one per parameter, in order
+  struct literal_expr** arguments;
+};
+
+void inliner_set_enabled(bool enabled);
+// The inlined body of callee at call, inlining it on first sight; NULL when
+// the call has to be made normally.
+struct inlined_call* inliner_lookup(struct call_expr* call,
+                                    struct object* callee);
@@ -1,27 +1,52 @@
+#ifdef INTERPRETER_THREADS
+// for pthread_getattr_np
+#  define _GNU_SOURCE
+#endif
+
 #include <assert.h>
-#include <gc.h>
 #include <lib.h>
-#include <math.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/assertions.h>
 #include <private/ast/debug.h>
+#include <private/escape.h>
+#include <private/heap_snapshot.h>
+#include <private/hoist.h>
+#include <private/inliner.h>
 #include <private/interpreter.h>
+#include <private/jit.h>
+#include <private/natives.h>
+#include <private/operators.h>
 #include <private/runtime_error.h>
 #include <private/strutils.h>
+#include <private/threads.h>
+#include <private/timing.h>
+#include <private/trace.h>
+#include <setjmp.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <time.h>
 
+#ifdef INTERPRETER_THREADS
+#  include <pthread.h>
+#endif
+
 #include "private/environment.h"
 
-#define NUMBER_DELTA 0.000001
+// C stack assumed when the limit is unknown or unlimited, and the part of
+// the limit kept free for natives, the collector and error reporting
+#define DEFAULT_STACK_SIZE (8 * 1024 * 1024)
+#define STACK_MARGIN (256 * 1024)
+// guard failures after which a binary_expr is no longer specialized
+#define MAX_DESPECIALIZATIONS 4
 
 // #define INTERPRETER_DEBUG
 
-static struct object* lox_clock(struct interpreter* interpreter,
-                                struct object_list* parameters)
-{
-  return OBJECT_NUMBER(time(NULL) - interpreter->init_time);
-}
+#if defined(INTERPRETER_THREADED_DISPATCH) && defined(INTERPRETER_DEBUG)
+// the debug output lives in interpreter_execute, which threading bypasses
+#  undef INTERPRETER_THREADED_DISPATCH
+#endif
 
 enum interpret_result_type
 {
@@ -50,12 +75,21 @@ struct interpret_result {
 
 static struct interpret_result evaluate(struct interpreter* interpreter,
                                         struct expr* expression);
+static expr_eval_fn compile(struct expr* expr);
 
 enum execution_result_type
 {
   EXECUTION_RESULT_TYPE_NONE,
   EXECUTION_RESULT_TYPE_RUNTIME_ERROR,
   EXECUTION_RESULT_TYPE_RETURN,
+  // `return f(...)` of a Lox function: the caller's interpreter_call runs
+  // the callee in place of the returning function
+  EXECUTION_RESULT_TYPE_TAIL_CALL,
+};
+
+struct tail_call {
+  struct object* callee;
+  struct object_list* arguments;
 };
 
 struct execution_result {
@@ -63,6 +97,7 @@ struct execution_result {
   union {
     struct runtime_error* runtime_error;
     struct object* return_value;
+    struct tail_call tail_call;
   } u;
 };
 
@@ -83,16 +118,13 @@ struct execution_result {
   { \
     .type = EXECUTION_RESULT_TYPE_RETURN, .u = {.return_value = (value) } \
   }
+#define EXECUTION_RESULT_TAIL_CALL(callee_, arguments_) \
+  (struct execution_result) \
+  { \
+    .type = EXECUTION_RESULT_TYPE_TAIL_CALL, \
+    .u = {.tail_call = {.callee = (callee_), .arguments = (arguments_) } } \
+  }
 
-static const char* stringify(struct object* obj);
-
-static bool is_truthy(struct object* obj);
-static bool is_equal(struct object* left, struct object* right);
-static struct runtime_error* check_number_operand(struct token* op,
-                                                  struct object* operand);
-static struct runtime_error* check_number_operands(struct token* op,
-                                                   struct object* left,
-                                                   struct object* right);
 
 #ifdef INTERPRETER_DEBUG
 static void interpreter_dump_environment(struct interpreter* interpreter);
@@ -102,6 +134,26 @@ static struct interpret_result interpreter_visit_assign_expr(
     struct interpreter* interpreter, struct assign_expr* expr);
 static struct interpret_result interpreter_visit_binary_expr(
     struct interpreter* interpreter, struct binary_expr* expr);
+static struct runtime_error* load_variable(struct interpreter* interpreter,
+                                           struct expr* expr,
+                                           struct object** value);
+static struct interpret_result assign_value(struct interpreter* interpreter,
+                                            struct assign_expr* expr);
+static struct runtime_error* binary_operands(struct interpreter* interpreter,
+                                             struct binary_expr* expr,
+                                             struct object** left,
+                                             struct object** right);
+static struct interpret_result binary_apply(struct binary_expr* expr,
+                                            struct object* left,
+                                            struct object* right);
+static struct runtime_error* evaluate_condition(
+    struct interpreter* interpreter, struct expr* condition, bool* truthy);
+static struct interpret_result binary_generic(struct binary_expr* expr,
+                                              struct object* left,
+                                              struct object* right);
+static void binary_specialize(struct binary_expr* expr,
+                              struct object* left,
+                              struct object* right);
 static struct interpret_result interpreter_visit_call_expr(
     struct interpreter* interpreter, struct call_expr* expr);
 static struct interpret_result interpreter_visit_grouping_expr(
@@ -115,9 +167,35 @@ static struct interpret_result interpreter_visit_unary_expr(
 static struct interpret_result interpreter_visit_variable_expr(
     struct interpreter* interpreter, struct variable_expr* expr);
 
+static struct runtime_error* interpreter_load_callee(
+    struct interpreter* interpreter,
+    struct call_expr* expr,
+    struct object** callee);
+static struct runtime_error* interpreter_prepare_call(
+    struct interpreter* interpreter,
+    struct call_expr* expr,
+    struct object* callee,
+    struct object_list** arguments);
+static bool interpreter_call_inlined(struct interpreter* interpreter,
+                                     struct call_expr* expr,
+                                     struct object* callee,
+                                     struct interpret_result* result);
 static struct interpret_result interpreter_call(struct interpreter* interpreter,
                                                 struct object* callee,
-                                                struct object_list* arguments);
+                                                struct object_list* arguments,
+                                                struct token* call_site);
+static struct runtime_error* interpreter_push_frame(
+    struct interpreter* interpreter,
+    struct object* callee,
+    struct token* call_site);
+static size_t stack_budget(void);
+static void interpreter_release_environment(struct interpreter* interpreter,
+                                            struct environment* environment);
+static void* on_out_of_memory(size_t bytes);
+
+// where an allocation failure on this thread jumps to; set while interpret
+// runs a script
+static THREADS_LOCAL jmp_buf* Recovery = NULL;
 
 static struct execution_result interpreter_visit_block_stmt(
     struct interpreter* interpreter, struct block_stmt* stmt);
@@ -141,110 +219,174 @@ struct execution_result interpreter_execute(struct interpreter* interpreter,
 static struct execution_result interpreter_execute_block(
     struct interpreter* interpreter,
     struct stmt_list* statements,
+    struct stmt_code** code,
     struct environment* environment);
+static struct execution_result interpreter_run(struct interpreter* interpreter,
+                                               struct stmt_list* statements,
+                                               struct stmt_code** code);
+static struct stmt_code* flatten(struct stmt_list* statements,
+                                 const void* const* handlers,
+                                 const void* halt);
 
 EXPR_DEFINE_ACCEPT_FOR(struct interpret_result, interpreter)
 STMT_DEFINE_ACCEPT_FOR(struct execution_result, interpreter)
 
-static struct interpret_result evaluate(struct interpreter* interpreter,
-                                        struct expr* expression)
+#define EVAL_VISITOR(node) \
+  static struct interpret_result eval_##node(struct interpreter* interpreter, \
+                                             struct expr* expr) \
+  { \
+    return interpreter_visit_##node(interpreter, (struct node*)expr); \
+  }
+
+EVAL_VISITOR(binary_expr)
+EVAL_VISITOR(call_expr)
+EVAL_VISITOR(logical_expr)
+EVAL_VISITOR(unary_expr)
+#undef EVAL_VISITOR
+
+static struct interpret_result eval_assign(struct interpreter* interpreter,
+                                           struct expr* expr)
 {
-#ifdef INTERPRETER_DEBUG
-  printf("[INTP] Evaluating expression: ");
-  expr_debug(expression);
-  printf("\n");
-#endif
-  struct interpret_result result =
-      expr_accept_interpreter(expression, interpreter);
-#ifdef INTERPRETER_DEBUG
-  if (result.type == INTERPRET_RESULT_OK) {
-    printf("[INTP] ==> ");
-    object_print(result.u.ok);
-    printf("\n");
+  return assign_value(interpreter, (struct assign_expr*)expr);
+}
+
+static struct interpret_result eval_increment(struct interpreter* interpreter,
+                                              struct expr* expr)
+{
+  struct assign_expr* assign = (struct assign_expr*)expr;
+  struct object** slot = environment_find_cached(
+      interpreter->environment, &assign->name, &assign->cache);
+  if (slot && OBJECT_IS_NUMBER(*slot)) {
+    *slot = object_new_number(OBJECT_AS_NUMBER(*slot) + assign->step);
+    return INTERPRET_OK(*slot);
   }
-#endif
-  return result;
+  // not a number (or undefined): let the generic path report it
+  return assign_value(interpreter, assign);
 }
 
-static const char* stringify(struct object* obj)
+static struct interpret_result eval_binary_variable_constant(
+    struct interpreter* interpreter, struct expr* expr)
 {
-  switch (obj->type) {
-    case OBJECT_TYPE_STRING:
-      return OBJECT_AS_STRING(obj);
-    case OBJECT_TYPE_NUMBER:
-      return alloc_printf("%lg", OBJECT_AS_NUMBER(obj));
-    case OBJECT_TYPE_BOOL:
-      return alloc_printf("%s", OBJECT_AS_BOOL(obj) ? "true" : "false");
-    case OBJECT_TYPE_NULL:
-      return "nil";
-    case OBJECT_TYPE_NATIVE_FUNCTION:
-      return "<native fn>";
+  struct binary_expr* binary = (struct binary_expr*)expr;
+  struct object* left;
+  struct runtime_error* err = load_variable(interpreter, binary->left, &left);
+  if (err) {
+    return INTERPRET_ERROR(err);
   }
-  assert(false && "impossible object type");
+  return binary_apply(
+      binary, left, ((struct literal_expr*)binary->right)->value);
 }
 
-static bool is_truthy(struct object* obj)
+static struct interpret_result eval_binary_variables(
+    struct interpreter* interpreter, struct expr* expr)
 {
-  if (OBJECT_IS_NULL(obj)) {
-    return false;
+  struct binary_expr* binary = (struct binary_expr*)expr;
+  struct object* left;
+  struct object* right;
+  struct runtime_error* err = load_variable(interpreter, binary->left, &left);
+  if (err == NULL) {
+    err = load_variable(interpreter, binary->right, &right);
   }
-  if (OBJECT_IS_BOOL(obj)) {
-    return OBJECT_AS_BOOL(obj);
+  if (err) {
+    return INTERPRET_ERROR(err);
   }
-  return true;
+  return binary_apply(binary, left, right);
 }
 
-static bool is_equal(struct object* left, struct object* right)
+static struct interpret_result eval_grouping(struct interpreter* interpreter,
+                                             struct expr* expr)
 {
-  if (OBJECT_IS_NULL(left) && OBJECT_IS_NULL(right)) {
-    return true;
+  return evaluate(interpreter, ((struct grouping_expr*)expr)->expression);
+}
+
+// Evaluates an expression hoisted out of a loop once per run of the loop;
+// visit_while_stmt clears the value when the run starts.
+static struct interpret_result eval_hoisted(struct interpreter* interpreter,
+                                            struct expr* expr)
+{
+  struct object** value = hoist_slot(expr);
+  if (*value) {
+    return INTERPRET_OK(*value);
   }
-  if (OBJECT_IS_NULL(left)) {
-    return false;
+  struct interpret_result result = compile(expr)(interpreter, expr);
+  if (result.type == INTERPRET_RESULT_OK) {
+    *value = result.u.ok;
   }
+  return result;
+}
 
-  switch (left->type) {
-    case OBJECT_TYPE_NULL:
-      return OBJECT_IS_NULL(right);
-    case OBJECT_TYPE_BOOL:
-      return OBJECT_IS_BOOL(right)
-          && OBJECT_AS_BOOL(left) == OBJECT_AS_BOOL(right);
-    case OBJECT_TYPE_STRING:
-      return OBJECT_IS_STRING(right)
-          && strcmp(OBJECT_AS_STRING(left), OBJECT_AS_STRING(right)) == 0;
-    case OBJECT_TYPE_NUMBER:
-      return OBJECT_IS_NUMBER(right)
-          && fabs(OBJECT_AS_NUMBER(left) - OBJECT_AS_NUMBER(right))
-          < NUMBER_DELTA;
-    case OBJECT_TYPE_NATIVE_FUNCTION:
-      return OBJECT_IS_NATIVE_FUNCTION(right)
-          && OBJECT_AS_NATIVE_FUNCTION(left).func
-          == OBJECT_AS_NATIVE_FUNCTION(right).func;
-    case OBJECT_TYPE_FUNCTION:
-      return OBJECT_IS_FUNCTION(right)
-          && OBJECT_AS_FUNCTION(left).declaration
-          == OBJECT_AS_FUNCTION(right).declaration;
-  }
-  assert(false);
-}
-
-static struct runtime_error* check_number_operand(struct token* op,
-                                                  struct object* operand)
-{
-  if (OBJECT_IS_NUMBER(operand)) {
-    return NULL;
+static struct interpret_result eval_literal(struct interpreter* interpreter,
+                                            struct expr* expr)
+{
+  (void)interpreter;
+  return INTERPRET_OK(((struct literal_expr*)expr)->value);
+}
+
+static struct interpret_result eval_variable(struct interpreter* interpreter,
+                                             struct expr* expr)
+{
+  struct object* value;
+  struct runtime_error* err = load_variable(interpreter, expr, &value);
+  if (err) {
+    return INTERPRET_ERROR(err);
   }
-  return runtime_error_new(op, "Operand must be a number.");
+  return INTERPRET_OK(value);
 }
 
-static struct runtime_error* check_number_operands(struct token* op,
-                                                   struct object* left,
-                                                   struct object* right)
+// Picks the evaluator for a node's shape.
+static expr_eval_fn compile(struct expr* expr)
 {
-  if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) {
-    return NULL;
+  switch (expr->type) {
+    case EXPR_ASSIGN:
+      return ((struct assign_expr*)expr)->increment ? eval_increment
+                                                    : eval_assign;
+    case EXPR_BINARY:
+      switch (((struct binary_expr*)expr)->operands) {
+        case BINARY_OPERANDS_ANY:
+          return eval_binary_expr;
+        case BINARY_OPERANDS_VARIABLE_CONSTANT:
+          return eval_binary_variable_constant;
+        case BINARY_OPERANDS_VARIABLES:
+          return eval_binary_variables;
+      }
+      break;
+    case EXPR_CALL:
+      return eval_call_expr;
+    case EXPR_GROUPING:
+      return eval_grouping;
+    case EXPR_LITERAL:
+      return eval_literal;
+    case EXPR_LOGICAL:
+      return eval_logical_expr;
+    case EXPR_UNARY:
+      return eval_unary_expr;
+    case EXPR_VARIABLE:
+      return eval_variable;
+  }
+  ASSERT_UNREACHABLE();
+}
+
+static struct interpret_result evaluate(struct interpreter* interpreter,
+                                        struct expr* expression)
+{
+#ifdef INTERPRETER_DEBUG
+  printf("[INTP] Evaluating expression: ");
+  expr_debug(expression);
+  printf("\n");
+  struct interpret_result result =
+      expr_accept_interpreter(expression, interpreter);
+  if (result.type == INTERPRET_RESULT_OK) {
+    printf("[INTP] ==> ");
+    object_print(result.u.ok);
+    printf("\n");
   }
-  return runtime_error_new(op, "Operands must be numbers.");
+  return result;
+#else
+  if (expression->eval == NULL) {
+    expression->eval = compile(expression);
+  }
+  return expression->eval(interpreter, expression);
+#endif
 }
 
 #ifdef INTERPRETER_DEBUG
@@ -256,13 +398,22 @@ static void interpreter_dump_environment(struct interpreter* interpreter)
 
 static struct interpret_result interpreter_visit_assign_expr(
     struct interpreter* interpreter, struct assign_expr* expr)
+{
+  if (expr->increment) {
+    return eval_increment(interpreter, &expr->base);
+  }
+  return assign_value(interpreter, expr);
+}
+
+static struct interpret_result assign_value(struct interpreter* interpreter,
+                                            struct assign_expr* expr)
 {
   struct interpret_result value = evaluate(interpreter, expr->value);
   if (value.type == INTERPRET_RESULT_ERROR) {
     return value;
   }
-  struct runtime_error* err =
-      environment_assign(interpreter->environment, &expr->name, value.u.ok);
+  struct runtime_error* err = environment_assign_cached(
+      interpreter->environment, &expr->name, value.u.ok, &expr->cache);
   if (err) {
     return INTERPRET_ERROR(err);
   }
@@ -272,113 +423,217 @@ static struct interpret_result interpreter_visit_assign_expr(
 static struct interpret_result interpreter_visit_binary_expr(
     struct interpreter* interpreter, struct binary_expr* expr)
 {
+  struct object* left;
+  struct object* right;
+  struct runtime_error* err = binary_operands(interpreter, expr, &left, &right);
+  if (err) {
+    return INTERPRET_ERROR(err);
+  }
+  return binary_apply(expr, left, right);
+}
+
+static struct runtime_error* binary_operands(struct interpreter* interpreter,
+                                             struct binary_expr* expr,
+                                             struct object** left,
+                                             struct object** right)
+{
+  struct runtime_error* err;
+  switch (expr->operands) {
+    case BINARY_OPERANDS_ANY:
+      break;
+    case BINARY_OPERANDS_VARIABLE_CONSTANT:
+      *right = ((struct literal_expr*)expr->right)->value;
+      return load_variable(interpreter, expr->left, left);
+    case BINARY_OPERANDS_VARIABLES:
+      if ((err = load_variable(interpreter, expr->left, left))) {
+        return err;
+      }
+      return load_variable(interpreter, expr->right, right);
+  }
+
   struct interpret_result left_result = evaluate(interpreter, expr->left);
   if (left_result.type == INTERPRET_RESULT_ERROR) {
-    return left_result;
+    return left_result.u.err;
   }
   struct interpret_result right_result = evaluate(interpreter, expr->right);
   if (right_result.type == INTERPRET_RESULT_ERROR) {
-    return right_result;
+    return right_result.u.err;
   }
-  struct object* left = left_result.u.ok;
-  struct object* right = right_result.u.ok;
+  *left = left_result.u.ok;
+  *right = right_result.u.ok;
+  return NULL;
+}
 
-  struct runtime_error* err;
-  switch (expr->op.type) {
-    case TOKEN_BANG_EQUAL:
-      return INTERPRET_OK(object_new_bool(!is_equal(left, right)));
-    case TOKEN_EQUAL_EQUAL:
-      return INTERPRET_OK(object_new_bool(is_equal(left, right)));
-    case TOKEN_GREATER:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_bool(OBJECT_AS_NUMBER(left) > OBJECT_AS_NUMBER(right)));
-    case TOKEN_GREATER_EQUAL:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_bool(OBJECT_AS_NUMBER(left) >= OBJECT_AS_NUMBER(right)));
-    case TOKEN_LESS:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_bool(OBJECT_AS_NUMBER(left) < OBJECT_AS_NUMBER(right)));
-    case TOKEN_LESS_EQUAL:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_bool(OBJECT_AS_NUMBER(left) <= OBJECT_AS_NUMBER(right)));
-    case TOKEN_MINUS:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_number(OBJECT_AS_NUMBER(left) - OBJECT_AS_NUMBER(right)));
-    case TOKEN_PLUS:
-      if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) {
-        return INTERPRET_OK(object_new_number(OBJECT_AS_NUMBER(left)
-                                              + OBJECT_AS_NUMBER(right)));
-      }
+static struct interpret_result binary_apply(struct binary_expr* expr,
+                                            struct object* left,
+                                            struct object* right)
+{
+#define NUMBER_SPECIALIZATION(specialization, make, op) \
+  case specialization: \
+    if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) { \
+      return INTERPRET_OK( \
+          make(OBJECT_AS_NUMBER(left) op OBJECT_AS_NUMBER(right))); \
+    } \
+    break
+
+  switch (expr->specialization) {
+    case BINARY_GENERIC:
+      break;
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_ADD, object_new_number, +);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_SUBTRACT, object_new_number, -);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_MULTIPLY, object_new_number, *);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_DIVIDE, object_new_number, /);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_LESS, object_new_bool, <);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_LESS_EQUAL, object_new_bool, <=);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_GREATER, object_new_bool, >);
+    NUMBER_SPECIALIZATION(BINARY_NUMBER_GREATER_EQUAL, object_new_bool, >=);
+    case BINARY_STRING_CONCAT:
       if (OBJECT_IS_STRING(left) && OBJECT_IS_STRING(right)) {
         return INTERPRET_OK(object_new_string(alloc_printf(
             "%s%s", OBJECT_AS_STRING(left), OBJECT_AS_STRING(right))));
       }
-      return INTERPRET_ERROR(runtime_error_new(
-          &expr->op, "Operands must be two numbers or two strings."));
-    case TOKEN_SLASH:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
+      break;
+  }
+#undef NUMBER_SPECIALIZATION
+
+  if (expr->specialization != BINARY_GENERIC) {
+    expr->specialization = BINARY_GENERIC;
+    ++expr->despecializations;
+  }
+  struct interpret_result result = binary_generic(expr, left, right);
+  if (result.type == INTERPRET_RESULT_OK
+      && expr->despecializations < MAX_DESPECIALIZATIONS)
+  {
+    binary_specialize(expr, left, right);
+  }
+  return result;
+}
+
+// Evaluates the condition of an if or while. Number comparisons that have
+// been quickened are decided here without allocating a bool object.
+static struct runtime_error* evaluate_condition(
+    struct interpreter* interpreter, struct expr* condition, bool* truthy)
+{
+  if (condition->type == EXPR_BINARY) {
+    struct binary_expr* expr = (struct binary_expr*)condition;
+    struct object* left;
+    struct object* right;
+    struct runtime_error* err =
+        binary_operands(interpreter, expr, &left, &right);
+    if (err) {
+      return err;
+    }
+    if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) {
+      double a = OBJECT_AS_NUMBER(left);
+      double b = OBJECT_AS_NUMBER(right);
+      switch (expr->specialization) {
+        case BINARY_NUMBER_LESS:
+          *truthy = a < b;
+          return NULL;
+        case BINARY_NUMBER_LESS_EQUAL:
+          *truthy = a <= b;
+          return NULL;
+        case BINARY_NUMBER_GREATER:
+          *truthy = a > b;
+          return NULL;
+        case BINARY_NUMBER_GREATER_EQUAL:
+          *truthy = a >= b;
+          return NULL;
+        default:
+          break;
       }
-      return INTERPRET_OK(
-          object_new_number(OBJECT_AS_NUMBER(left) / OBJECT_AS_NUMBER(right)));
+    }
+    struct interpret_result result = binary_apply(expr, left, right);
+    if (result.type == INTERPRET_RESULT_ERROR) {
+      return result.u.err;
+    }
+    *truthy = operator_is_truthy(result.u.ok);
+    return NULL;
+  }
+
+  struct interpret_result result = evaluate(interpreter, condition);
+  if (result.type == INTERPRET_RESULT_ERROR) {
+    return result.u.err;
+  }
+  *truthy = operator_is_truthy(result.u.ok);
+  return NULL;
+}
+
+static struct interpret_result binary_generic(struct binary_expr* expr,
+                                              struct object* left,
+                                              struct object* right)
+{
+  struct runtime_error* err;
+  struct object* value = operator_binary(&expr->op, left, right, &err);
+  if (!value) {
+    return INTERPRET_ERROR(err);
+  }
+  return INTERPRET_OK(value);
+}
+
+static void binary_specialize(struct binary_expr* expr,
+                              struct object* left,
+                              struct object* right)
+{
+  if (OBJECT_IS_STRING(left) && OBJECT_IS_STRING(right)
+      && expr->op.type == TOKEN_PLUS)
+  {
+    expr->specialization = BINARY_STRING_CONCAT;
+    return;
+  }
+  if (!OBJECT_IS_NUMBER(left) || !OBJECT_IS_NUMBER(right)) {
+    return;
+  }
+  switch (expr->op.type) {
+    case TOKEN_PLUS:
+      expr->specialization = BINARY_NUMBER_ADD;
+      break;
+    case TOKEN_MINUS:
+      expr->specialization = BINARY_NUMBER_SUBTRACT;
+      break;
     case TOKEN_STAR:
-      if ((err = check_number_operands(&expr->op, left, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(
-          object_new_number(OBJECT_AS_NUMBER(left) * OBJECT_AS_NUMBER(right)));
+      expr->specialization = BINARY_NUMBER_MULTIPLY;
+      break;
+    case TOKEN_SLASH:
+      expr->specialization = BINARY_NUMBER_DIVIDE;
+      break;
+    case TOKEN_LESS:
+      expr->specialization = BINARY_NUMBER_LESS;
+      break;
+    case TOKEN_LESS_EQUAL:
+      expr->specialization = BINARY_NUMBER_LESS_EQUAL;
+      break;
+    case TOKEN_GREATER:
+      expr->specialization = BINARY_NUMBER_GREATER;
+      break;
+    case TOKEN_GREATER_EQUAL:
+      expr->specialization = BINARY_NUMBER_GREATER_EQUAL;
+      break;
     default:
-      ASSERT_UNREACHABLE();
+      // equality is already type-generic
+      break;
   }
 }
 
 static struct interpret_result interpreter_visit_call_expr(
     struct interpreter* interpreter, struct call_expr* expr)
 {
-  struct interpret_result callee_result = evaluate(interpreter, expr->callee);
-  if (callee_result.type == INTERPRET_RESULT_ERROR) {
-    return callee_result;
-  }
-  struct object* callee = callee_result.u.ok;
-
-  struct object_list* arguments = GC_MALLOC(sizeof(struct object_list));
-  LIST_INIT(arguments);
-  for (long i = 0; i < expr->arguments->length; ++i) {
-    struct interpret_result argument_result =
-        evaluate(interpreter, expr->arguments->pointer[i]);
-    if (argument_result.type == INTERPRET_RESULT_ERROR) {
-      return argument_result;
-    }
-    LIST_PUSH(arguments, argument_result.u.ok);
+  struct object* callee;
+  struct runtime_error* err =
+      interpreter_load_callee(interpreter, expr, &callee);
+  if (err) {
+    return INTERPRET_ERROR(err);
   }
-
-  if (!OBJECT_IS_CALLABLE(callee)) {
-    return INTERPRET_ERROR(runtime_error_new(
-        &expr->paren, "Can only call functions and classes."));
+  struct interpret_result result;
+  if (interpreter_call_inlined(interpreter, expr, callee, &result)) {
+    return result;
   }
-  if (object_arity(callee) != arguments->length) {
-    return INTERPRET_ERROR(
-        runtime_error_new(&expr->paren,
-                          alloc_printf("Expected %li arguments but got %li.",
-                                       object_arity(callee),
-                                       arguments->length)));
+  struct object_list* arguments;
+  err = interpreter_prepare_call(interpreter, expr, callee, &arguments);
+  if (err) {
+    return INTERPRET_ERROR(err);
   }
-  return interpreter_call(interpreter, callee, arguments);
+  return interpreter_call(interpreter, callee, arguments, &expr->paren);
 }
 
 static struct interpret_result interpreter_visit_grouping_expr(
@@ -402,11 +657,11 @@ static struct interpret_result interpreter_visit_logical_expr(
     return left;
   }
   if (expr->op.type == TOKEN_OR) {
-    if (is_truthy(left.u.ok)) {
+    if (operator_is_truthy(left.u.ok)) {
       return left;
     }
   } else {
-    if (!is_truthy(left.u.ok)) {
+    if (!operator_is_truthy(left.u.ok)) {
       return left;
     }
   }
@@ -421,74 +676,287 @@ static struct interpret_result interpreter_visit_unary_expr(
   if (right_result.type == INTERPRET_RESULT_ERROR) {
     return right_result;
   }
-  struct object* right = right_result.u.ok;
-
   struct runtime_error* err;
-  switch (expr->op.type) {
-    case TOKEN_BANG:
-      return INTERPRET_OK(object_new_bool(!is_truthy(right)));
-    case TOKEN_MINUS:
-      if ((err = check_number_operand(&expr->op, right))) {
-        return INTERPRET_ERROR(err);
-      }
-      return INTERPRET_OK(object_new_number(-OBJECT_AS_NUMBER(right)));
-    default:
-      ASSERT_UNREACHABLE();
+  struct object* value = operator_unary(&expr->op, right_result.u.ok, &err);
+  if (!value) {
+    return INTERPRET_ERROR(err);
   }
+  return INTERPRET_OK(value);
 }
 
 static struct interpret_result interpreter_visit_variable_expr(
     struct interpreter* interpreter, struct variable_expr* expr)
 {
-  struct environment_lookup_result result =
-      environment_get(interpreter->environment, &expr->name);
+  return eval_variable(interpreter, &expr->base);
+}
+
+static struct runtime_error* load_variable(struct interpreter* interpreter,
+                                           struct expr* expr,
+                                           struct object** value)
+{
+  struct variable_expr* variable = (struct variable_expr*)expr;
+  struct environment_lookup_result result = environment_get_cached(
+      interpreter->environment, &variable->name, &variable->cache);
   if (ENVIRONMENT_LOOKUP_RESULT_IS_OK(&result)) {
-    return INTERPRET_OK(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&result));
+    *value = ENVIRONMENT_LOOKUP_RESULT_GET_OK(&result);
+    return NULL;
   }
-  return INTERPRET_ERROR(ENVIRONMENT_LOOKUP_RESULT_GET_ERROR(&result));
+  return ENVIRONMENT_LOOKUP_RESULT_GET_ERROR(&result);
+}
+
+static struct runtime_error* interpreter_load_callee(
+    struct interpreter* interpreter,
+    struct call_expr* expr,
+    struct object** callee)
+{
+  struct object** slot = NULL;
+  if (expr->callee->type == EXPR_VARIABLE) {
+    // load-and-call: read the callee straight from its cached slot
+    struct variable_expr* variable = (struct variable_expr*)expr->callee;
+    slot = environment_find_cached(
+        interpreter->environment, &variable->name, &variable->cache);
+  }
+  if (slot) {
+    *callee = *slot;
+  } else {
+    struct interpret_result callee_result =
+        evaluate(interpreter, expr->callee);
+    if (callee_result.type == INTERPRET_RESULT_ERROR) {
+      return callee_result.u.err;
+    }
+    *callee = callee_result.u.ok;
+  }
+  return NULL;
+}
+
+static struct runtime_error* interpreter_prepare_call(
+    struct interpreter* interpreter,
+    struct call_expr* expr,
+    struct object* callee,
+    struct object_list** arguments)
+{
+  *arguments = alloc_untyped(sizeof(struct object_list));
+  alloc_profiler_record(sizeof(struct object_list));
+  LIST_INIT(*arguments);
+  for (long i = 0; i < expr->arguments->length; ++i) {
+    struct interpret_result argument_result =
+        evaluate(interpreter, expr->arguments->pointer[i]);
+    if (argument_result.type == INTERPRET_RESULT_ERROR) {
+      return argument_result.u.err;
+    }
+    LIST_PUSH(*arguments, argument_result.u.ok);
+  }
+
+  if (!OBJECT_IS_CALLABLE(callee)) {
+    return runtime_error_new(&expr->paren,
+                             "Can only call functions and classes.");
+  }
+  if (object_arity(callee) != (*arguments)->length) {
+    return runtime_error_new(
+        &expr->paren,
+        alloc_printf("Expected %li arguments but got %li.",
+                     object_arity(callee),
+                     (*arguments)->length));
+  }
+  return NULL;
+}
+
+// Runs the call through the site's inlined copy of the callee's body, if it
+// has one and the JIT hasn't taken the callee over. The arguments are all
+// evaluated before any is stored, since they may themselves reach this call
+// site; the body makes no calls, so nothing can overwrite them while it runs.
+static bool interpreter_call_inlined(struct interpreter* interpreter,
+                                     struct call_expr* expr,
+                                     struct object* callee,
+                                     struct interpret_result* result)
+{
+  struct inlined_call* inlined = inliner_lookup(expr, callee);
+  if (!inlined || jit_takes_over(OBJECT_AS_FUNCTION(callee).declaration)) {
+    return false;
+  }
+  struct object* arguments[INLINER_MAX_PARAMS];
+  for (long i = 0; i < expr->arguments->length; ++i) {
+    *result = evaluate(interpreter, expr->arguments->pointer[i]);
+    if (result->type == INTERPRET_RESULT_ERROR) {
+      return true;
+    }
+    arguments[i] = result->u.ok;
+  }
+  for (long i = 0; i < expr->arguments->length; ++i) {
+    inlined->arguments[i]->value = arguments[i];
+  }
+  struct environment* previous = interpreter->environment;
+  interpreter->environment = OBJECT_AS_FUNCTION(callee).closure;
+  *result = evaluate(interpreter, inlined->body);
+  interpreter->environment = previous;
+  return true;
 }
 
 static struct interpret_result interpreter_call(struct interpreter* interpreter,
                                                 struct object* callee,
-                                                struct object_list* arguments)
-{
-  switch (callee->type) {
-    case OBJECT_TYPE_NATIVE_FUNCTION:
-      return INTERPRET_OK(
-          OBJECT_AS_NATIVE_FUNCTION(callee).func(interpreter, arguments));
-    case OBJECT_TYPE_FUNCTION: {
-      struct function func = OBJECT_AS_FUNCTION(callee);
-      struct environment* environment =
-          environment_new_enclosed(func.closure);
-      for (long i = 0; i < func.declaration->params->length; ++i) {
-        environment_define(environment,
-                           func.declaration->params->pointer[i].lexeme,
-                           // arity was checked, so this is OK
-                           arguments->pointer[i]);
-      }
-      struct execution_result result = interpreter_execute_block(
-          interpreter, func.declaration->body, environment);
-      switch (result.type) {
-        case EXECUTION_RESULT_TYPE_RUNTIME_ERROR:
-          return INTERPRET_ERROR(result.u.runtime_error);
-        case EXECUTION_RESULT_TYPE_RETURN:
-          return INTERPRET_OK(result.u.return_value);
-        default:
-          return INTERPRET_OK(OBJECT_NULL());
+                                                struct object_list* arguments,
+                                                struct token* call_site)
+{
+  if (OBJECT_IS_NATIVE_FUNCTION(callee)) {
+    return INTERPRET_OK(
+        OBJECT_AS_NATIVE_FUNCTION(callee).func(interpreter, arguments));
+  }
+  assert(OBJECT_IS_FUNCTION(callee));
+
+  struct runtime_error* err =
+      interpreter_push_frame(interpreter, callee, call_site);
+  if (err) {
+    return INTERPRET_ERROR(err);
+  }
+  struct call_frame* frame =
+      &interpreter->frames.pointer[interpreter->frames.length - 1];
+
+  // Tail calls come back as EXECUTION_RESULT_TYPE_TAIL_CALL and are run by
+  // this loop, so a chain of them uses one C frame. The environment is
+  // reused for the next callee unless a closure captured it, and goes back
+  // to the pool at the end on the same condition.
+  struct environment* environment = NULL;
+  while (true) {
+    struct function func = OBJECT_AS_FUNCTION(callee);
+    struct object* compiled_result;
+    if (jit_call(func.declaration, arguments, &compiled_result)) {
+      --interpreter->frames.length;
+      interpreter_release_environment(interpreter, environment);
+      return INTERPRET_OK(compiled_result);
+    }
+    if (environment && !environment->captured) {
+      environment_reset(environment, func.closure);
+    } else if (!escape_scope_escapes(&func.declaration->escape,
+                                     func.declaration->body))
+    {
+      environment = environment_pool_take(&interpreter->environment_pool,
+                                          func.closure);
+    } else {
+      environment = environment_new_enclosed(func.closure);
+    }
+    for (long i = 0; i < func.declaration->params->length; ++i) {
+      environment_define(environment,
+                         func.declaration->params->pointer[i].lexeme,
+                         // arity was checked, so this is OK
+                         arguments->pointer[i]);
+    }
+    alloc_profiler_enter(func.declaration->name.lexeme);
+    unsigned long long start = trace_enabled() ? timing_now_ns() : 0;
+    struct execution_result result =
+        interpreter_execute_block(interpreter,
+                                  func.declaration->body,
+                                  &func.declaration->code,
+                                  environment);
+    if (start) {
+      unsigned long long end = timing_now_ns();
+      if (end - start >= trace_call_threshold_ns()) {
+        trace_span(func.declaration->name.lexeme, "call", start, end);
       }
     }
-    default:
-      ASSERT_UNREACHABLE();
+    alloc_profiler_leave();
+    if (result.type == EXECUTION_RESULT_TYPE_TAIL_CALL) {
+      callee = result.u.tail_call.callee;
+      arguments = result.u.tail_call.arguments;
+      // the frames list may have been reallocated by deeper calls
+      frame = &interpreter->frames.pointer[interpreter->frames.length - 1];
+      frame->callee = callee;
+      continue;
+    }
+    --interpreter->frames.length;
+    interpreter_release_environment(interpreter, environment);
+    switch (result.type) {
+      case EXECUTION_RESULT_TYPE_RUNTIME_ERROR:
+        return INTERPRET_ERROR(result.u.runtime_error);
+      case EXECUTION_RESULT_TYPE_RETURN:
+        return INTERPRET_OK(result.u.return_value);
+      default:
+        return INTERPRET_OK(OBJECT_NULL());
+    }
   }
 }
 
+static struct runtime_error* interpreter_push_frame(
+    struct interpreter* interpreter,
+    struct object* callee,
+    struct token* call_site)
+{
+  char here;
+  uintptr_t top = (uintptr_t)&here;
+  size_t stack_used = interpreter->stack_base > top
+      ? interpreter->stack_base - top
+      : top - interpreter->stack_base;
+  if (interpreter->frames.length >= interpreter->max_call_depth
+      || stack_used > interpreter->stack_budget)
+  {
+    return runtime_error_new(call_site, "Stack overflow.");
+  }
+  HEAP_SNAPSHOT_POLL(interpreter);
+  LIST_PUSH(&interpreter->frames,
+            ((struct call_frame) {
+                .callee = callee,
+                .call_site = call_site,
+                .environment = interpreter->environment,
+            }));
+  return NULL;
+}
+
+static size_t stack_budget(void)
+{
+  size_t size = DEFAULT_STACK_SIZE;
+#ifdef INTERPRETER_THREADS
+  // threads other than main get their stack size from their attributes,
+  // not from RLIMIT_STACK
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    pthread_attr_getstacksize(&attr, &size);
+    pthread_attr_destroy(&attr);
+  }
+#else
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+  {
+    size = (size_t)limit.rlim_cur;
+  }
+#endif
+  return size > 2 * STACK_MARGIN ? size - STACK_MARGIN : size / 2;
+}
+
+static void* on_out_of_memory(size_t bytes)
+{
+  (void)bytes;
+  if (Recovery) {
+    longjmp(*Recovery, 1);
+  }
+  // outside a script, fail the allocation like the default handler does
+  return NULL;
+}
+
 static struct execution_result interpreter_visit_block_stmt(
     struct interpreter* interpreter, struct block_stmt* stmt)
 {
-  return interpreter_execute_block(
-      interpreter,
-      stmt->statements,
-      environment_new_enclosed(interpreter->environment));
+  if (escape_scope_escapes(&stmt->escape, stmt->statements)) {
+    return interpreter_execute_block(
+        interpreter,
+        stmt->statements,
+        &stmt->code,
+        environment_new_enclosed(interpreter->environment));
+  }
+  struct environment* environment = environment_pool_take(
+      &interpreter->environment_pool, interpreter->environment);
+  struct execution_result result = interpreter_execute_block(
+      interpreter, stmt->statements, &stmt->code, environment);
+  environment_pool_give(&interpreter->environment_pool, environment);
+  return result;
+}
+
+// returns the environment of a finished call to the pool, unless a closure
+// captured it
+static void interpreter_release_environment(struct interpreter* interpreter,
+                                            struct environment* environment)
+{
+  if (environment && !environment->captured) {
+    environment_pool_give(&interpreter->environment_pool, environment);
+  }
 }
 
 static struct execution_result interpreter_visit_print_stmt(
@@ -500,12 +968,43 @@ static struct execution_result interpreter_visit_print_stmt(
   if (result.type == INTERPRET_RESULT_ERROR) {
     return EXECUTION_RESULT_RUNTIME_ERROR(result.u.err);
   }
-  printf("%s\n", stringify(result.u.ok));
+  printf("%s\n", operator_stringify(result.u.ok));
   return EXECUTION_RESULT_NONE;
 }
 static struct execution_result interpreter_visit_return_stmt(
     struct interpreter* interpreter, struct return_stmt* stmt)
 {
+  if (stmt->value && stmt->value->type == EXPR_CALL) {
+    struct call_expr* call = (struct call_expr*)stmt->value;
+    struct object* callee;
+    struct runtime_error* err =
+        interpreter_load_callee(interpreter, call, &callee);
+    if (err) {
+      return EXECUTION_RESULT_RUNTIME_ERROR(err);
+    }
+    struct interpret_result inlined;
+    if (interpreter_call_inlined(interpreter, call, callee, &inlined)) {
+      if (inlined.type == INTERPRET_RESULT_ERROR) {
+        return EXECUTION_RESULT_RUNTIME_ERROR(inlined.u.err);
+      }
+      return EXECUTION_RESULT_RETURN(inlined.u.ok);
+    }
+    struct object_list* arguments;
+    err = interpreter_prepare_call(interpreter, call, callee, &arguments);
+    if (err) {
+      return EXECUTION_RESULT_RUNTIME_ERROR(err);
+    }
+    if (OBJECT_IS_FUNCTION(callee)) {
+      return EXECUTION_RESULT_TAIL_CALL(callee, arguments);
+    }
+    struct interpret_result result =
+        interpreter_call(interpreter, callee, arguments, &call->paren);
+    if (result.type == INTERPRET_RESULT_ERROR) {
+      return EXECUTION_RESULT_RUNTIME_ERROR(result.u.err);
+    }
+    return EXECUTION_RESULT_RETURN(result.u.ok);
+  }
+
   struct object* value = OBJECT_NULL();
   if (stmt->value) {
     struct interpret_result result = evaluate(interpreter, stmt->value);
@@ -532,10 +1031,12 @@ static struct execution_result interpreter_visit_function_stmt(
     struct interpreter* interpreter, struct function_stmt* stmt)
 {
   struct function_stmt* function_stmt = (struct function_stmt*)stmt;
+  escape_scope_escapes(&function_stmt->escape, function_stmt->body);
   struct object* function = OBJECT_FUNCTION(((struct function) {
       .declaration = function_stmt,
       .closure = interpreter->environment,
   }));
+  environment_capture(interpreter->environment);
   environment_define(
       interpreter->environment, function_stmt->name.lexeme, function);
   return EXECUTION_RESULT_NONE;
@@ -544,11 +1045,13 @@ static struct execution_result interpreter_visit_function_stmt(
 static struct execution_result interpreter_visit_if_stmt(
     struct interpreter* interpreter, struct if_stmt* stmt)
 {
-  struct interpret_result condition = evaluate(interpreter, stmt->condition);
-  if (condition.type == INTERPRET_RESULT_ERROR) {
-    return EXECUTION_RESULT_RUNTIME_ERROR(condition.u.err);
+  bool condition;
+  struct runtime_error* err =
+      evaluate_condition(interpreter, stmt->condition, &condition);
+  if (err) {
+    return EXECUTION_RESULT_RUNTIME_ERROR(err);
   }
-  if (is_truthy(condition.u.ok)) {
+  if (condition) {
     return interpreter_execute(interpreter, stmt->then_branch);
   }
   if (stmt->else_branch != NULL) {
@@ -579,43 +1082,128 @@ static struct execution_result interpreter_visit_var_stmt(
 static struct execution_result interpreter_visit_while_stmt(
     struct interpreter* interpreter, struct while_stmt* stmt)
 {
+  if (!stmt->invariants) {
+    stmt->invariants = hoist_invariants(stmt);
+    for (long i = 0; i < stmt->invariants->length; ++i) {
+      stmt->invariants->pointer[i]->eval = eval_hoisted;
+    }
+  }
+  for (long i = 0; i < stmt->invariants->length; ++i) {
+    *hoist_slot(stmt->invariants->pointer[i]) = NULL;
+  }
+
   while (true) {
-    struct interpret_result condition = evaluate(interpreter, stmt->condition);
-    if (condition.type == INTERPRET_RESULT_ERROR) {
-      return EXECUTION_RESULT_RUNTIME_ERROR(condition.u.err);
+    bool condition;
+    struct runtime_error* err =
+        evaluate_condition(interpreter, stmt->condition, &condition);
+    if (err) {
+      return EXECUTION_RESULT_RUNTIME_ERROR(err);
     }
-    if (!is_truthy(condition.u.ok)) {
+    if (!condition) {
       break;
     }
-    interpreter_execute(interpreter, stmt->body);
+    HEAP_SNAPSHOT_POLL(interpreter);
+    struct execution_result result =
+        interpreter_execute(interpreter, stmt->body);
+    if (result.type != EXECUTION_RESULT_TYPE_NONE) {
+      return result;
+    }
   }
   return EXECUTION_RESULT_NONE;
 }
 
 struct interpreter* interpreter_new(void)
 {
-  struct interpreter* interpreter = GC_MALLOC(sizeof(struct interpreter));
+  struct interpreter* interpreter = alloc_untyped(sizeof(struct interpreter));
   interpreter->globals = environment_new();
   interpreter->environment = interpreter->globals;
   interpreter->init_time = time(NULL);
-  environment_define(
-      interpreter->globals, "clock", OBJECT_NATIVE_FUNCTION(0, lox_clock));
+  LIST_INIT(&interpreter->frames);
+  interpreter->environment_pool = (struct environment_pool) {
+      .free = NULL,
+      .length = 0,
+  };
+  interpreter->stack_base = 0;
+  interpreter->stack_budget = stack_budget();
+  interpreter->max_call_depth =
+      (long)(interpreter->stack_budget / INTERPRETER_STACK_PER_CALL);
+  interpreter->out_of_memory_at = (struct token) {
+      .type = TOKEN_EOF,
+      .lexeme = "",
+      .literal = OBJECT_NULL(),
+  };
+  interpreter->out_of_memory = (struct runtime_error) {
+      .token = &interpreter->out_of_memory_at,
+      .message = "Out of memory.",
+  };
+  alloc_set_oom_fn(on_out_of_memory);
+  natives_define(interpreter->globals);
   return interpreter;
 }
 
+long interpreter_default_max_call_depth(void)
+{
+  return (long)(stack_budget() / INTERPRETER_STACK_PER_CALL);
+}
+
+size_t interpreter_stack_budget(void)
+{
+  return stack_budget();
+}
+
+void interpreter_set_max_call_depth(struct interpreter* interpreter,
+                                    long max_call_depth)
+{
+  long limit = (long)(interpreter->stack_budget / INTERPRETER_STACK_PER_CALL);
+  interpreter->max_call_depth =
+      max_call_depth < limit ? max_call_depth : limit;
+}
+
 void interpret(struct interpreter* interpreter, struct stmt_list* statements)
 {
-  for (long i = 0; i < statements->length; ++i) {
+  char base;
+  interpreter->stack_base = (uintptr_t)&base;
+  interpreter->frames.length = 0;
+  size_t profiler_depth = alloc_profiler_depth();
+  alloc_profiler_enter("<script>");
+  jmp_buf recovery;
+  volatile long i = 0;
+  if (setjmp(recovery) != 0) {
+    // the collector has no lock held here (it calls the OOM function after
+    // releasing it), and everything the statement allocated is garbage
+    Recovery = NULL;
+    interpreter->environment = interpreter->globals;
+    interpreter->frames.length = 0;
+    interpreter->out_of_memory_at.line = statements->pointer[i]->line;
+    library_runtime_error(&interpreter->out_of_memory);
+    // the calls the jump skipped never left the profiler
+    alloc_profiler_unwind(profiler_depth);
+    return;
+  }
+  Recovery = &recovery;
+  for (; i < statements->length; ++i) {
+    unsigned long long start = trace_enabled() ? timing_now_ns() : 0;
     struct execution_result result =
         interpreter_execute(interpreter, statements->pointer[i]);
+    if (start) {
+      trace_span(alloc_printf("statement (line %zu)",
+                              statements->pointer[i]->line),
+                 "execute",
+                 start,
+                 timing_now_ns());
+    }
     if (result.type == EXECUTION_RESULT_TYPE_RUNTIME_ERROR) {
       library_runtime_error(result.u.runtime_error);
       break;
     }
-    if (result.type == EXECUTION_RESULT_TYPE_RETURN) {
+    if (result.type == EXECUTION_RESULT_TYPE_RETURN
+        || result.type == EXECUTION_RESULT_TYPE_TAIL_CALL)
+    {
       ASSERT_UNREACHABLE();
     }
   }
+  Recovery = NULL;
+  alloc_profiler_leave();
 }
 
 struct execution_result interpreter_execute(struct interpreter* interpreter,
@@ -626,6 +1214,7 @@ struct execution_result interpreter_execute(struct interpreter* interpreter,
   stmt_debug(stmt);
   printf("\n");
 #endif
+  alloc_profiler_set_line(stmt->line);
   struct execution_result result = stmt_accept_interpreter(stmt, interpreter);
 #ifdef INTERPRETER_DEBUG
   if (result.type != EXECUTION_RESULT_TYPE_RUNTIME_ERROR) {
@@ -639,20 +1228,108 @@ struct execution_result interpreter_execute(struct interpreter* interpreter,
 static struct execution_result interpreter_execute_block(
     struct interpreter* interpreter,
     struct stmt_list* statements,
+    struct stmt_code** code,
     struct environment* environment)
 {
   struct environment* previous = interpreter->environment;
   interpreter->environment = environment;
+  struct execution_result result =
+      interpreter_run(interpreter, statements, code);
+  interpreter->environment = previous;
+  return result;
+}
 
-  for (long i = 0; i < statements->length; ++i) {
-    struct execution_result result =
-        interpreter_execute(interpreter, statements->pointer[i]);
+#ifdef INTERPRETER_THREADED_DISPATCH
+
+// Labels as values are a GNU extension.
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wpedantic"
+
+// Direct-threaded dispatch: every handler ends with its own indirect jump to
+// the next statement's handler, so each jump site is predicted separately.
+static struct execution_result interpreter_run(struct interpreter* interpreter,
+                                               struct stmt_list* statements,
+                                               struct stmt_code** code)
+{
+  static const void* const handlers[] = {
+      [STMT_BLOCK] = &&block,
+      [STMT_EXPRESSION] = &&expression,
+      [STMT_FUNCTION] = &&function,
+      [STMT_IF] = &&if_,
+      [STMT_PRINT] = &&print,
+      [STMT_RETURN] = &&return_,
+      [STMT_VAR] = &&var,
+      [STMT_WHILE] = &&while_,
+  };
+  if (*code == NULL) {
+    *code = flatten(statements, handlers, &&halt);
+  }
+  struct stmt_code* pc = *code;
+  struct execution_result result;
+
+#  define HANDLER(label, node) \
+    label: \
+      alloc_profiler_set_line(pc->stmt->line); \
+      result = interpreter_visit_##node(interpreter, (struct node*)pc->stmt); \
+      if (result.type != EXECUTION_RESULT_TYPE_NONE) { \
+        return result; \
+      } \
+      ++pc; \
+      goto* pc->handler
+
+  goto* pc->handler;
+  HANDLER(block, block_stmt);
+  HANDLER(expression, expression_stmt);
+  HANDLER(function, function_stmt);
+  HANDLER(if_, if_stmt);
+  HANDLER(print, print_stmt);
+  HANDLER(return_, return_stmt);
+  HANDLER(var, var_stmt);
+  HANDLER(while_, while_stmt);
+halt:
+  return EXECUTION_RESULT_NONE;
+#  undef HANDLER
+}
+
+#  pragma GCC diagnostic pop
+
+#else
+
+static struct execution_result interpreter_run(struct interpreter* interpreter,
+                                               struct stmt_list* statements,
+                                               struct stmt_code** code)
+{
+  if (*code == NULL) {
+    *code = flatten(statements, NULL, NULL);
+  }
+  for (struct stmt_code* pc = *code; pc->stmt != NULL; ++pc) {
+    struct execution_result result = interpreter_execute(interpreter, pc->stmt);
     if (result.type != EXECUTION_RESULT_TYPE_NONE) {
-      interpreter->environment = previous;
       return result;
     }
   }
-
-  interpreter->environment = previous;
   return EXECUTION_RESULT_NONE;
 }
+
+#endif
+
+static struct stmt_code* flatten(struct stmt_list* statements,
+                                 const void* const* handlers,
+                                 const void* halt)
+{
+  size_t size = sizeof(struct stmt_code) * (statements->length + 1);
+  struct stmt_code* code = alloc_untyped(size);
+  alloc_profiler_record(size);
+  for (long i = 0; i < statements->length; ++i) {
+    struct stmt* stmt = statements->pointer[i];
+    code[i] = (struct stmt_code) {
+        .handler = handlers ? handlers[stmt->type] : NULL,
+        .stmt = stmt,
+    };
+  }
+  code[statements->length] = (struct stmt_code) {
+      .handler = halt,
+      .stmt = NULL,
+  };
+  return code;
+}
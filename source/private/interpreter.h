@@ -3,18 +3,62 @@
 #include <private/ast/expr.h>
 #include <private/ast/stmt.h>
 #include <private/environment.h>
+#include <private/list.h>
 #include <private/object.h>
 #include <private/runtime_error.h>
+#include <private/token.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+// Evaluation recurses in C, so the C stack bounds how deep Lox calls can
+// nest. The call depth allowed by default (and at most) is the stack budget
+// divided by this, which is more than a call with a plain body takes in any
+// build. Calls that take more, through deeply nested expressions, still fail
+// with 'Stack overflow.' before the limit once the budget runs out.
+#define INTERPRETER_STACK_PER_CALL 1024
+
+struct call_frame {
+  struct object* callee;
+  struct token* call_site;
+  // the caller's scope, which only the C stack refers to otherwise; kept
+  // for heap snapshots
+  struct environment* environment;
+};
+
+DECLARE_NAMED_LIST(call_frame_list, struct call_frame);
+
 struct interpreter {
   struct environment* globals;
   struct environment* environment;
   time_t init_time;
+  // one entry per active Lox function call; tail calls replace the top
+  struct call_frame_list frames;
+  // environments of finished calls and blocks, for reuse
+  struct environment_pool environment_pool;
+  long max_call_depth;
+  // calls are refused once the C stack has grown this many bytes past
+  // stack_base, whatever max_call_depth says
+  uintptr_t stack_base;
+  size_t stack_budget;
+  // reported when an allocation fails; built up front, as nothing more can
+  // be allocated by then
+  struct token out_of_memory_at;
+  struct runtime_error out_of_memory;
 };
 
 EXPR_DECLARE_ACCEPT_FOR(struct interpret_result, interpreter);
 STMT_DECLARE_ACCEPT_FOR(struct execution_result, interpreter);
 
 struct interpreter* interpreter_new(void);
+// the call depth allowed by default on the calling thread's stack
+long interpreter_default_max_call_depth(void);
+// how much of the calling thread's C stack calls may use
+size_t interpreter_stack_budget(void);
+// lowers the call depth allowed; larger values than the default are capped
+void interpreter_set_max_call_depth(struct interpreter* interpreter,
+                                    long max_call_depth);
+// An allocation that fails while a script runs (see
+// library_set_max_heap_size) abandons the current top-level statement and is
+// reported as an 'Out of memory.' runtime error.
 void interpret(struct interpreter* interpreter, struct stmt_list* statements);
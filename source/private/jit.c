@@ -0,0 +1,610 @@
+#include <private/jit.h>
+
+#ifdef INTERPRETER_JIT
+
+#  ifndef __x86_64__
+#    error "INTERPRETER_JIT needs an x86-64 target"
+#  endif
+
+#  include <private/ast/expr.h>
+#  include <private/list.h>
+#  include <private/operators.h>
+#  include <private/threads.h>
+#  include <stddef.h>
+#  include <stdint.h>
+#  include <stdio.h>
+#  include <string.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+
+_Static_assert(sizeof(enum object_type) == 4, "guards compare 32 bits");
+
+// a variable in scope and the frame slot that holds it
+struct binding {
+  size_t symbol;
+  long slot;
+};
+
+DECLARE_NAMED_LIST(jump_list, long);
+DECLARE_NAMED_LIST(binding_list, struct binding);
+
+struct assembler {
+  LIST(unsigned char) code;
+  // positions of rel32 operands of jumps to the fallback exit
+  struct jump_list fail_jumps;
+  // innermost last, so a lookup from the end finds the one that shadows
+  struct binding_list scope;
+  long slots;
+  // position of the prologue's frame size, known once the body is compiled
+  long frame_size_at;
+};
+
+static bool compile_stmt(struct assembler* as, struct stmt* stmt);
+static bool compile_statements(struct assembler* as,
+                               struct stmt_list* statements);
+static bool compile_expr(struct assembler* as, struct expr* expr);
+static bool compile_operands(struct assembler* as, struct binary_expr* binary);
+static bool compile_branch(struct assembler* as,
+                           struct expr* condition,
+                           bool jump_if,
+                           struct jump_list* jumps);
+static bool compile_number_branch(struct assembler* as,
+                                  struct expr* condition,
+                                  bool jump_if,
+                                  struct jump_list* jumps);
+static long find_slot(struct assembler* as, struct token* name);
+static long add_slot(struct assembler* as, struct token* name);
+static void emit_slot(struct assembler* as, const char* opcode, long slot);
+static void emit(struct assembler* as, const char* bytes, size_t length);
+static void emit_jump(struct assembler* as,
+                      const char* opcode,
+                      size_t length,
+                      struct jump_list* jumps);
+static void emit_u32(struct assembler* as, uint32_t value);
+static void emit_u64(struct assembler* as, uint64_t value);
+static void patch_jumps(struct assembler* as, struct jump_list* jumps);
+static void* install(struct assembler* as);
+static void perf_map_write(void* code, size_t size, const char* name);
+
+static FILE* PerfMap = NULL;
+THREADS_MUTEX(PerfMapLock);
+
+#endif
+
+static unsigned long Threshold = JIT_DEFAULT_THRESHOLD;
+
+static bool warm_up(struct function_stmt* function);
+
+bool jit_available(void)
+{
+#ifdef INTERPRETER_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+void jit_set_threshold(unsigned long threshold)
+{
+  Threshold = threshold;
+}
+
+bool jit_call(struct function_stmt* function,
+              struct object_list* arguments,
+              struct object** result)
+{
+  if (!function->jit_code && !warm_up(function)) {
+    return false;
+  }
+  double value;
+  if (!((jit_code)function->jit_code)(arguments->pointer, &value)) {
+    return false;
+  }
+  *result = object_new_number(value);
+  return true;
+}
+
+bool jit_takes_over(struct function_stmt* function)
+{
+  return jit_available() && (function->jit_code || warm_up(function));
+}
+
+// Counts a call to a function that has no machine code yet, and compiles it
+// once it is hot. Returns whether it has machine code now.
+static bool warm_up(struct function_stmt* function)
+{
+  if (Threshold == 0 || function->jit_failed || ++function->calls < Threshold)
+  {
+    return false;
+  }
+  jit_code code = jit_compile(function);
+  if (!code) {
+    function->jit_failed = true;
+    return false;
+  }
+  function->jit_code = (void (*)(void))code;
+  return true;
+}
+
+#ifndef INTERPRETER_JIT
+
+jit_code jit_compile(struct function_stmt* function)
+{
+  (void)function;
+  return NULL;
+}
+
+#else
+
+// Register use: rdi = arguments, rsi = result, rdx = rsp on entry, which is
+// the frame's base and is restored by both exits, xmm0 = value of the
+// expression being compiled, xmm1 = scratch. Every variable, parameters
+// included, lives in a slot of the frame below rdx; intermediate values are
+// spilled below the frame.
+jit_code jit_compile(struct function_stmt* function)
+{
+  struct assembler as = {.slots = 0};
+  LIST_INIT(&as.code);
+  LIST_INIT(&as.fail_jumps);
+  LIST_INIT(&as.scope);
+
+  emit(&as, "\x48\x89\xe2", 3);  // mov rdx, rsp
+  emit(&as, "\x48\x81\xec", 3);  // sub rsp, frame size
+  as.frame_size_at = as.code.length;
+  emit_u32(&as, 0);
+  // the guards: every argument must be a number
+  for (long i = 0; i < function->params->length; ++i) {
+    emit(&as, "\x48\x8b\x87", 3);  // mov rax, [rdi + 8 * i]
+    emit_u32(&as, (uint32_t)(i * sizeof(struct object*)));
+    emit(&as, "\x81\xb8", 2);  // cmp dword [rax + type], NUMBER
+    emit_u32(&as, (uint32_t)offsetof(struct object, type));
+    emit_u32(&as, OBJECT_TYPE_NUMBER);
+    emit_jump(&as, "\x0f\x85", 2, &as.fail_jumps);  // jne fail
+    emit(&as, "\xf2\x0f\x10\x80", 4);  // movsd xmm0, [rax + value]
+    emit_u32(&as, (uint32_t)offsetof(struct object, value.d));
+    long slot = add_slot(&as, &function->params->pointer[i]);
+    emit_slot(&as, "\xf2\x0f\x11", slot);  // movsd slot, xmm0
+  }
+  if (!compile_statements(&as, function->body)) {
+    return NULL;
+  }
+  // falling off the end returns nil, which only the interpreter can
+  emit_jump(&as, "\xe9", 1, &as.fail_jumps);  // jmp fail
+  uint32_t frame_size = (uint32_t)(as.slots * sizeof(double));
+  memcpy(&as.code.pointer[as.frame_size_at], &frame_size, sizeof frame_size);
+
+  patch_jumps(&as, &as.fail_jumps);
+  emit(&as, "\x48\x89\xd4", 3);  // mov rsp, rdx
+  emit(&as, "\x31\xc0", 2);  // xor eax, eax
+  emit(&as, "\xc3", 1);  // ret
+
+  void* code = install(&as);
+  if (!code) {
+    return NULL;
+  }
+  perf_map_write(code, (size_t)as.code.length, function->name.lexeme);
+  union {
+    void* data;
+    jit_code function;
+  } pun = {.data = code};
+  return pun.function;
+}
+
+static bool compile_statements(struct assembler* as,
+                               struct stmt_list* statements)
+{
+  for (long i = 0; i < statements->length; ++i) {
+    if (!compile_stmt(as, statements->pointer[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool compile_stmt(struct assembler* as, struct stmt* stmt)
+{
+  switch (stmt->type) {
+    case STMT_BLOCK: {
+      long outer = as->scope.length;
+      if (!compile_statements(as, ((struct block_stmt*)stmt)->statements)) {
+        return false;
+      }
+      as->scope.length = outer;
+      return true;
+    }
+    case STMT_EXPRESSION:
+      return compile_expr(as, ((struct expression_stmt*)stmt)->expression);
+    case STMT_IF: {
+      struct if_stmt* if_stmt = (struct if_stmt*)stmt;
+      struct jump_list to_else;
+      LIST_INIT(&to_else);
+      if (!compile_branch(as, if_stmt->condition, false, &to_else)
+          || !compile_stmt(as, if_stmt->then_branch))
+      {
+        return false;
+      }
+      if (!if_stmt->else_branch) {
+        patch_jumps(as, &to_else);
+        return true;
+      }
+      struct jump_list to_end;
+      LIST_INIT(&to_end);
+      emit_jump(as, "\xe9", 1, &to_end);  // jmp end
+      patch_jumps(as, &to_else);
+      if (!compile_stmt(as, if_stmt->else_branch)) {
+        return false;
+      }
+      patch_jumps(as, &to_end);
+      return true;
+    }
+    case STMT_RETURN: {
+      struct return_stmt* ret = (struct return_stmt*)stmt;
+      if (!ret->value || !compile_expr(as, ret->value)) {
+        return false;
+      }
+      emit(as, "\xf2\x0f\x11\x06", 4);  // movsd [rsi], xmm0
+      emit(as, "\x48\x89\xd4", 3);  // mov rsp, rdx
+      emit(as, "\xb8\x01\x00\x00\x00", 5);  // mov eax, 1
+      emit(as, "\xc3", 1);  // ret
+      return true;
+    }
+    case STMT_VAR: {
+      struct var_stmt* var = (struct var_stmt*)stmt;
+      // the initializer still sees an outer variable of the same name
+      if (!var->initializer || !compile_expr(as, var->initializer)) {
+        return false;
+      }
+      emit_slot(as, "\xf2\x0f\x11", add_slot(as, &var->name));  // movsd
+      return true;
+    }
+    case STMT_WHILE: {
+      struct while_stmt* loop = (struct while_stmt*)stmt;
+      long start = as->code.length;
+      struct jump_list to_exit;
+      LIST_INIT(&to_exit);
+      if (!compile_branch(as, loop->condition, false, &to_exit)
+          || !compile_stmt(as, loop->body))
+      {
+        return false;
+      }
+      emit(as, "\xe9", 1);  // jmp start
+      emit_u32(as, (uint32_t)(start - (as->code.length + 4)));
+      patch_jumps(as, &to_exit);
+      return true;
+    }
+    case STMT_FUNCTION:
+    case STMT_PRINT:
+      return false;
+  }
+  return false;
+}
+
+// Leaves a number in xmm0. Every variable holds a number, so arithmetic
+// needs no guards of its own.
+static bool compile_expr(struct assembler* as, struct expr* expr)
+{
+  switch (expr->type) {
+    case EXPR_LITERAL: {
+      struct object* value = ((struct literal_expr*)expr)->value;
+      if (!OBJECT_IS_NUMBER(value)) {
+        return false;
+      }
+      uint64_t bits;
+      double d = OBJECT_AS_NUMBER(value);
+      memcpy(&bits, &d, sizeof bits);
+      emit(as, "\x48\xb8", 2);  // mov rax, imm64
+      emit_u64(as, bits);
+      emit(as, "\x66\x48\x0f\x6e\xc0", 5);  // movq xmm0, rax
+      return true;
+    }
+    case EXPR_VARIABLE: {
+      long slot = find_slot(as, &((struct variable_expr*)expr)->name);
+      if (slot < 0) {
+        return false;
+      }
+      emit_slot(as, "\xf2\x0f\x10", slot);  // movsd xmm0, slot
+      return true;
+    }
+    case EXPR_ASSIGN: {
+      struct assign_expr* assign = (struct assign_expr*)expr;
+      long slot = find_slot(as, &assign->name);
+      if (slot < 0 || !compile_expr(as, assign->value)) {
+        return false;
+      }
+      emit_slot(as, "\xf2\x0f\x11", slot);  // movsd slot, xmm0
+      return true;
+    }
+    case EXPR_GROUPING:
+      return compile_expr(as, ((struct grouping_expr*)expr)->expression);
+    case EXPR_UNARY: {
+      struct unary_expr* unary = (struct unary_expr*)expr;
+      if (unary->op.type != TOKEN_MINUS || !compile_expr(as, unary->right)) {
+        return false;
+      }
+      emit(as, "\x48\xb8", 2);  // mov rax, sign bit
+      emit_u64(as, UINT64_C(1) << 63);
+      emit(as, "\x66\x48\x0f\x6e\xc8", 5);  // movq xmm1, rax
+      emit(as, "\x66\x0f\x57\xc1", 4);  // xorpd xmm0, xmm1
+      return true;
+    }
+    case EXPR_BINARY: {
+      struct binary_expr* binary = (struct binary_expr*)expr;
+      const char* op;
+      switch (binary->op.type) {
+        case TOKEN_PLUS:
+          op = "\xf2\x0f\x58\xc1";  // addsd xmm0, xmm1
+          break;
+        case TOKEN_MINUS:
+          op = "\xf2\x0f\x5c\xc1";  // subsd xmm0, xmm1
+          break;
+        case TOKEN_STAR:
+          op = "\xf2\x0f\x59\xc1";  // mulsd xmm0, xmm1
+          break;
+        case TOKEN_SLASH:
+          op = "\xf2\x0f\x5e\xc1";  // divsd xmm0, xmm1
+          break;
+        default:
+          // comparisons make booleans, which only conditions can use
+          return false;
+      }
+      if (!compile_operands(as, binary)) {
+        return false;
+      }
+      emit(as, op, 4);
+      return true;
+    }
+    case EXPR_CALL:
+    case EXPR_LOGICAL:
+      return false;
+  }
+  return false;
+}
+
+// left operand in xmm0, right in xmm1
+static bool compile_operands(struct assembler* as, struct binary_expr* binary)
+{
+  if (!compile_expr(as, binary->left)) {
+    return false;
+  }
+  emit(as, "\x48\x83\xec\x08", 4);  // sub rsp, 8
+  emit(as, "\xf2\x0f\x11\x04\x24", 5);  // movsd [rsp], xmm0
+  if (!compile_expr(as, binary->right)) {
+    return false;
+  }
+  emit(as, "\x66\x0f\x28\xc8", 4);  // movapd xmm1, xmm0
+  emit(as, "\xf2\x0f\x10\x04\x24", 5);  // movsd xmm0, [rsp]
+  emit(as, "\x48\x83\xc4\x08", 4);  // add rsp, 8
+  return true;
+}
+
+// Jumps (adding the jump to `jumps`) when the condition's truth is jump_if,
+// and falls through otherwise. Conditions are comparisons of numbers,
+// literals and numbers, and `!`, `and` and `or` over them.
+// Comparisons put the operand that must be larger first in ucomisd and test
+// with ja/jae, which are false when either operand is NaN, as in C.
+static bool compile_branch(struct assembler* as,
+                           struct expr* condition,
+                           bool jump_if,
+                           struct jump_list* jumps)
+{
+  switch (condition->type) {
+    case EXPR_GROUPING:
+      return compile_branch(as,
+                            ((struct grouping_expr*)condition)->expression,
+                            jump_if,
+                            jumps);
+    case EXPR_LITERAL: {
+      struct object* value = ((struct literal_expr*)condition)->value;
+      if (operator_is_truthy(value) == jump_if) {
+        emit_jump(as, "\xe9", 1, jumps);  // jmp
+      }
+      return true;
+    }
+    case EXPR_UNARY: {
+      struct unary_expr* unary = (struct unary_expr*)condition;
+      if (unary->op.type == TOKEN_BANG) {
+        return compile_branch(as, unary->right, !jump_if, jumps);
+      }
+      break;
+    }
+    case EXPR_LOGICAL: {
+      struct logical_expr* logical = (struct logical_expr*)condition;
+      // `and` decides early when its left side is false, `or` when true
+      bool decides_on = logical->op.type == TOKEN_OR;
+      if (decides_on == jump_if) {
+        return compile_branch(as, logical->left, jump_if, jumps)
+            && compile_branch(as, logical->right, jump_if, jumps);
+      }
+      struct jump_list decided;
+      LIST_INIT(&decided);
+      if (!compile_branch(as, logical->left, decides_on, &decided)
+          || !compile_branch(as, logical->right, jump_if, jumps))
+      {
+        return false;
+      }
+      patch_jumps(as, &decided);
+      return true;
+    }
+    case EXPR_BINARY: {
+      struct binary_expr* binary = (struct binary_expr*)condition;
+      // jcc opcodes when true (ja, jae) and when false (jbe, jb)
+      const char* when_true = "\x0f\x87";
+      const char* when_false = "\x0f\x86";
+      switch (binary->op.type) {
+        case TOKEN_GREATER:
+        case TOKEN_LESS:
+          break;
+        case TOKEN_GREATER_EQUAL:
+        case TOKEN_LESS_EQUAL:
+          when_true = "\x0f\x83";
+          when_false = "\x0f\x82";
+          break;
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL:
+          break;
+        default:
+          return compile_number_branch(as, condition, jump_if, jumps);
+      }
+      if (!compile_operands(as, binary)) {
+        return false;
+      }
+      switch (binary->op.type) {
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+          emit(as, "\x66\x0f\x2e\xc1", 4);  // ucomisd xmm0, xmm1
+          break;
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+          emit(as, "\x66\x0f\x2e\xc8", 4);  // ucomisd xmm1, xmm0
+          break;
+        default: {
+          // equal when OPERATOR_NUMBER_DELTA > |left - right|
+          uint64_t bits;
+          double delta = OPERATOR_NUMBER_DELTA;
+          memcpy(&bits, &delta, sizeof bits);
+          emit(as, "\xf2\x0f\x5c\xc1", 4);  // subsd xmm0, xmm1
+          emit(as, "\x48\xb8", 2);  // mov rax, all but the sign bit
+          emit_u64(as, ~(UINT64_C(1) << 63));
+          emit(as, "\x66\x48\x0f\x6e\xc8", 5);  // movq xmm1, rax
+          emit(as, "\x66\x0f\x54\xc1", 4);  // andpd xmm0, xmm1
+          emit(as, "\x48\xb8", 2);  // mov rax, delta
+          emit_u64(as, bits);
+          emit(as, "\x66\x48\x0f\x6e\xc8", 5);  // movq xmm1, rax
+          emit(as, "\x66\x0f\x2e\xc8", 4);  // ucomisd xmm1, xmm0
+          if (binary->op.type == TOKEN_BANG_EQUAL) {
+            jump_if = !jump_if;
+          }
+          break;
+        }
+      }
+      emit_jump(as, jump_if ? when_true : when_false, 2, jumps);
+      return true;
+    }
+    case EXPR_ASSIGN:
+    case EXPR_CALL:
+    case EXPR_VARIABLE:
+      break;
+  }
+  return compile_number_branch(as, condition, jump_if, jumps);
+}
+
+// any other condition has to be a number, and numbers are always true
+static bool compile_number_branch(struct assembler* as,
+                                  struct expr* condition,
+                                  bool jump_if,
+                                  struct jump_list* jumps)
+{
+  if (!compile_expr(as, condition)) {
+    return false;
+  }
+  if (jump_if) {
+    emit_jump(as, "\xe9", 1, jumps);  // jmp
+  }
+  return true;
+}
+
+// the slot of the variable the name refers to, or -1 if it isn't a
+// parameter or local (a global or a closure's variable)
+static long find_slot(struct assembler* as, struct token* name)
+{
+  for (long i = as->scope.length - 1; i >= 0; --i) {
+    if (as->scope.pointer[i].symbol == name->symbol) {
+      return as->scope.pointer[i].slot;
+    }
+  }
+  return -1;
+}
+
+static long add_slot(struct assembler* as, struct token* name)
+{
+  long slot = as->slots++;
+  LIST_PUSH(&as->scope,
+            ((struct binding) {.symbol = name->symbol, .slot = slot}));
+  return slot;
+}
+
+// a movsd between xmm0 and [rdx - 8 * (slot + 1)]
+static void emit_slot(struct assembler* as, const char* opcode, long slot)
+{
+  emit(as, opcode, 3);
+  emit(as, "\x82", 1);  // modrm: xmm0, [rdx + disp32]
+  emit_u32(as, (uint32_t)(-8 * (slot + 1)));
+}
+
+static void emit(struct assembler* as, const char* bytes, size_t length)
+{
+  for (size_t i = 0; i < length; ++i) {
+    LIST_PUSH(&as->code, (unsigned char)bytes[i]);
+  }
+}
+
+// a jump with a rel32 operand, to be filled in by patch_jumps
+static void emit_jump(struct assembler* as,
+                      const char* opcode,
+                      size_t length,
+                      struct jump_list* jumps)
+{
+  emit(as, opcode, length);
+  LIST_PUSH(jumps, as->code.length);
+  emit_u32(as, 0);
+}
+
+static void emit_u32(struct assembler* as, uint32_t value)
+{
+  char bytes[sizeof value];
+  memcpy(bytes, &value, sizeof value);
+  emit(as, bytes, sizeof bytes);
+}
+
+static void emit_u64(struct assembler* as, uint64_t value)
+{
+  char bytes[sizeof value];
+  memcpy(bytes, &value, sizeof value);
+  emit(as, bytes, sizeof bytes);
+}
+
+// points the jumps at the current position
+static void patch_jumps(struct assembler* as, struct jump_list* jumps)
+{
+  for (long i = 0; i < jumps->length; ++i) {
+    long at = jumps->pointer[i];
+    uint32_t rel = (uint32_t)(as->code.length - (at + 4));
+    memcpy(&as->code.pointer[at], &rel, sizeof rel);
+  }
+}
+
+// Copies the code into its own mapping, which is made executable and never
+// writable again.
+static void* install(struct assembler* as)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t size = ((size_t)as->code.length + page - 1) / page * page;
+  void* region = mmap(
+      NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return NULL;
+  }
+  memcpy(region, as->code.pointer, (size_t)as->code.length);
+  if (mprotect(region, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(region, size);
+    return NULL;
+  }
+  return region;
+}
+
+static void perf_map_write(void* code, size_t size, const char* name)
+{
+  THREADS_LOCK(PerfMapLock);
+  if (!PerfMap) {
+    char path[64];
+    snprintf(path, sizeof path, "/tmp/perf-%ld.map", (long)getpid());
+    PerfMap = fopen(path, "ae");
+  }
+  if (PerfMap) {
+    fprintf(PerfMap, "%lx %zx lox:%s\n", (unsigned long)code, size, name);
+    fflush(PerfMap);
+  }
+  THREADS_UNLOCK(PerfMapLock);
+}
+
+#endif
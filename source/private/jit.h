@@ -0,0 +1,46 @@
+#pragma once
+
+#include <private/ast/stmt.h>
+#include <private/object.h>
+#include <stdbool.h>
+
+// Template JIT for x86-64, built when INTERPRETER_JIT is defined.
+//
+// A Lox function that computes a number from numbers is compiled to machine
+// code after it has been called JIT_DEFAULT_THRESHOLD times (see
+// jit_set_threshold). Its body may declare and assign local variables and
+// use blocks, `if` and `while` (so `for`), with conditions made of
+// comparisons, `!`, `and` and `or`; its expressions may use its parameters
+// and locals, number literals, grouping, unary minus and + - * /. Globals,
+// closed-over variables, calls, strings, booleans outside conditions and
+// `print` keep a function in the interpreter. On entry the code checks that
+// every argument is a number; if one isn't, or the call ends without
+// returning a number, it falls back to the interpreter, which is safe because
+// compiled code has no side effects.
+// Compiled functions are listed in /tmp/perf-PID.map for perf.
+//
+// The inliner handles the simplest of these functions, a single
+// `return <expr>;`, and is tried first; it keeps a function only until the
+// JIT takes it over (see jit_takes_over), or for good if the JIT can't
+// compile it.
+
+#define JIT_DEFAULT_THRESHOLD 1000
+
+// returns false when a guard fails or the function would return nil
+typedef int (*jit_code)(struct object** arguments, double* result);
+
+bool jit_available(void);
+// calls before a function is compiled; 0 disables the JIT
+void jit_set_threshold(unsigned long threshold);
+// NULL if the function's body is outside the subset
+jit_code jit_compile(struct function_stmt* function);
+// Counts a call to function and runs its machine code if it has some.
+// Returns false if the interpreter has to make the call instead.
+bool jit_call(struct function_stmt* function,
+              struct object_list* arguments,
+              struct object** result);
+// Counts a call that would otherwise bypass jit_call (an inlined one, see
+// inliner.h) and returns whether the function is, or is about to be,
+// compiled; such a call should be made through jit_call instead, so that the
+// JIT gets hot functions even though the inliner takes them first.
+bool jit_takes_over(struct function_stmt* function);
@@ -1,6 +1,7 @@
 #include "list.h"
 
-#include <gc.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 
 #define LIST_INITIAL_CAPACITY 8
 
@@ -11,7 +12,8 @@ void list_reserve_(struct list_unpacked_ list, long capacity)
       *list.capacity =
           (*list.capacity == 0) ? LIST_INITIAL_CAPACITY : *list.capacity * 2;
     }
-    *list.pointer = GC_REALLOC(*list.pointer, *list.capacity * list.sizeof_t);
+    *list.pointer = alloc_realloc(*list.pointer, *list.capacity * list.sizeof_t);
+    alloc_profiler_record(*list.capacity * list.sizeof_t);
   }
 }
 
@@ -0,0 +1,126 @@
+#include <private/heap_snapshot.h>
+#include <private/interpreter.h>
+#include <private/natives.h>
+#include <private/weak_map.h>
+#include <stddef.h>
+#include <time.h>
+
+// clock(): seconds since the interpreter started
+static struct object* lox_clock(struct interpreter* interpreter,
+                                struct object_list* parameters)
+{
+  (void)parameters;
+  return OBJECT_NUMBER(time(NULL) - interpreter->init_time);
+}
+
+// heapSnapshot(path): writes a heap snapshot (see heap_snapshot.h) and
+// returns whether it could
+static struct object* lox_heap_snapshot(struct interpreter* interpreter,
+                                        struct object_list* parameters)
+{
+  struct object* path = parameters->pointer[0];
+  return OBJECT_BOOL(
+      OBJECT_IS_STRING(path)
+      && heap_snapshot_write(interpreter, OBJECT_AS_STRING(path)));
+}
+
+// WeakMap(): a map whose keys are held weakly (see weak_map.h). Keys must
+// have an identity, so only functions and weak maps can be keys; the other
+// natives return nil (or false) for anything else, including a map that
+// isn't one.
+static struct object* lox_weak_map(struct interpreter* interpreter,
+                                   struct object_list* parameters)
+{
+  (void)interpreter;
+  (void)parameters;
+  return OBJECT_WEAK_MAP(weak_map_new());
+}
+
+static bool is_weak_map_key(struct object* key)
+{
+  return OBJECT_IS_CALLABLE(key) || OBJECT_IS_WEAK_MAP(key);
+}
+
+// weakMapGet(map, key): the value under the key, or nil
+static struct object* lox_weak_map_get(struct interpreter* interpreter,
+                                       struct object_list* parameters)
+{
+  (void)interpreter;
+  struct object* map = parameters->pointer[0];
+  struct object* key = parameters->pointer[1];
+  struct object* value = OBJECT_IS_WEAK_MAP(map) && is_weak_map_key(key)
+      ? weak_map_get(OBJECT_AS_WEAK_MAP(map), key)
+      : NULL;
+  return value ? value : OBJECT_NULL();
+}
+
+// weakMapSet(map, key, value): returns whether the value was stored
+static struct object* lox_weak_map_set(struct interpreter* interpreter,
+                                       struct object_list* parameters)
+{
+  (void)interpreter;
+  struct object* map = parameters->pointer[0];
+  struct object* key = parameters->pointer[1];
+  return OBJECT_BOOL(
+      OBJECT_IS_WEAK_MAP(map) && is_weak_map_key(key)
+      && weak_map_set(OBJECT_AS_WEAK_MAP(map), key, parameters->pointer[2]));
+}
+
+// weakMapHas(map, key)
+static struct object* lox_weak_map_has(struct interpreter* interpreter,
+                                       struct object_list* parameters)
+{
+  (void)interpreter;
+  struct object* map = parameters->pointer[0];
+  struct object* key = parameters->pointer[1];
+  return OBJECT_BOOL(OBJECT_IS_WEAK_MAP(map) && is_weak_map_key(key)
+                     && weak_map_get(OBJECT_AS_WEAK_MAP(map), key));
+}
+
+// weakMapDelete(map, key): returns whether the key was there
+static struct object* lox_weak_map_delete(struct interpreter* interpreter,
+                                          struct object_list* parameters)
+{
+  (void)interpreter;
+  struct object* map = parameters->pointer[0];
+  struct object* key = parameters->pointer[1];
+  return OBJECT_BOOL(OBJECT_IS_WEAK_MAP(map) && is_weak_map_key(key)
+                     && weak_map_delete(OBJECT_AS_WEAK_MAP(map), key));
+}
+
+// weakMapSize(map): how many of its keys are still alive, which drops as
+// the collector finds them unreachable
+static struct object* lox_weak_map_size(struct interpreter* interpreter,
+                                        struct object_list* parameters)
+{
+  (void)interpreter;
+  struct object* map = parameters->pointer[0];
+  return OBJECT_IS_WEAK_MAP(map)
+      ? OBJECT_NUMBER((double)weak_map_size(OBJECT_AS_WEAK_MAP(map)))
+      : OBJECT_NULL();
+}
+
+static const struct {
+  const char* name;
+  long arity;
+  struct object* (*func)(struct interpreter*, struct object_list*);
+} Natives[] = {
+    {"clock", 0, lox_clock},
+    {"heapSnapshot", 1, lox_heap_snapshot},
+    {"WeakMap", 0, lox_weak_map},
+    {"weakMapGet", 2, lox_weak_map_get},
+    {"weakMapSet", 3, lox_weak_map_set},
+    {"weakMapHas", 2, lox_weak_map_has},
+    {"weakMapDelete", 2, lox_weak_map_delete},
+    {"weakMapSize", 1, lox_weak_map_size},
+};
+
+void natives_define(struct environment* globals)
+{
+  for (size_t i = 0; i < sizeof Natives / sizeof Natives[0]; ++i) {
+    environment_define(
+        globals,
+        Natives[i].name,
+        OBJECT_NATIVE_FUNCTION(Natives[i].arity, Natives[i].func));
+  }
+}
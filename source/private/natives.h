@@ -0,0 +1,9 @@
+#pragma once
+
+#include <private/environment.h>
+
+// The native functions Lox programs start with: clock, heapSnapshot and the
+// WeakMap functions. Both the interpreter and compiled programs (see aot.h)
+// define them from the same table, so a script sees the same globals either
+// way.
+void natives_define(struct environment* globals);
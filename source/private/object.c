@@ -1,7 +1,11 @@
-#include <gc.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/assertions.h>
 #include <private/ast/stmt.h>
+#include <private/gc_stats.h>
 #include <private/object.h>
+#include <private/threads.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
 
@@ -25,6 +29,8 @@
             (n), \
             "<fn %s>", \
             OBJECT_AS_FUNCTION(obj).declaration->name.lexeme); \
+      case OBJECT_TYPE_WEAK_MAP: \
+        return prefix##nprintf((p), (n), "<weak map>"); \
     } \
   } while (false)
 
@@ -51,57 +57,139 @@ static size_t object_print_to_string(struct my_printer* printer,
                                      const struct object* obj);
 static size_t fnprintf(FILE* fp, size_t _n, const char* format, ...)
     __attribute__((format(printf, 3, 4)));
+static struct object* object_alloc(enum object_type type);
+static void describe_objects(void);
+static void init_small_numbers(void);
+
+static const enum gc_stats_kind OBJECT_STATS_KINDS[] = {
+    [OBJECT_TYPE_STRING] = GC_STATS_KIND_STRING,
+    [OBJECT_TYPE_NUMBER] = GC_STATS_KIND_NUMBER,
+    [OBJECT_TYPE_BOOL] = GC_STATS_KIND_BOOL,
+    [OBJECT_TYPE_NULL] = GC_STATS_KIND_NULL,
+    [OBJECT_TYPE_NATIVE_FUNCTION] = GC_STATS_KIND_NATIVE_FUNCTION,
+    [OBJECT_TYPE_FUNCTION] = GC_STATS_KIND_FUNCTION,
+    [OBJECT_TYPE_WEAK_MAP] = GC_STATS_KIND_WEAK_MAP,
+};
+
+// where each type of pointer-holding object keeps its pointers; numbers hold
+// none and are allocated atomic (bools and nil are never allocated)
+static alloc_descriptor Descriptors[OBJECT_TYPE_WEAK_MAP + 1];
+THREADS_ONCE(Described);
+
+struct object ObjectNil = {.type = OBJECT_TYPE_NULL};
+struct object ObjectTrue = {.type = OBJECT_TYPE_BOOL, .value.b = true};
+struct object ObjectFalse = {.type = OBJECT_TYPE_BOOL, .value.b = false};
+
+static struct object SmallNumbers[SMALL_NUMBER_MAX - SMALL_NUMBER_MIN + 1];
+THREADS_ONCE(SmallNumbersReady);
 
 struct object* object_new_string(char* value)
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_STRING;
+  struct object* obj = object_alloc(OBJECT_TYPE_STRING);
   obj->value.s = value;
   return obj;
 }
 
 struct object* object_new_number(double value)
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_NUMBER;
+  // -0 prints differently from 0, so it isn't cached
+  if (value >= SMALL_NUMBER_MIN && value <= SMALL_NUMBER_MAX
+      && value == (double)(long)value && !(value == 0 && signbit(value)))
+  {
+    THREADS_CALL_ONCE(SmallNumbersReady, init_small_numbers);
+    return &SmallNumbers[(long)value - SMALL_NUMBER_MIN];
+  }
+  struct object* obj = object_alloc(OBJECT_TYPE_NUMBER);
   obj->value.d = value;
   return obj;
 }
 
 struct object* object_new_bool(bool value)
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_BOOL;
-  obj->value.b = value;
-  return obj;
+  return OBJECT_BOOL(value);
 }
 
 struct object* object_new_null(void)
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_NULL;
-  return obj;
+  return OBJECT_NULL();
 }
 
 struct object* object_new_native_function(
     long arity,
     struct object* (*value)(struct interpreter*, struct object_list*))
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_NATIVE_FUNCTION;
+  struct object* obj = object_alloc(OBJECT_TYPE_NATIVE_FUNCTION);
   obj->value.nf.func = value;
   obj->value.nf.arity = arity;
+  obj->value.nf.data = NULL;
   return obj;
 }
 
 struct object* object_new_function(struct function func)
 {
-  struct object* obj = GC_MALLOC(sizeof(struct object));
-  obj->type = OBJECT_TYPE_FUNCTION;
+  struct object* obj = object_alloc(OBJECT_TYPE_FUNCTION);
   obj->value.f = func;
   return obj;
 }
 
+struct object* object_new_weak_map(struct weak_map* map)
+{
+  struct object* obj = object_alloc(OBJECT_TYPE_WEAK_MAP);
+  obj->value.wm = map;
+  return obj;
+}
+
+static struct object* object_alloc(enum object_type type)
+{
+  THREADS_CALL_ONCE(Described, describe_objects);
+  struct object* obj;
+  switch (type) {
+    case OBJECT_TYPE_NUMBER:
+      obj = alloc_atomic(sizeof(struct object));
+      break;
+    default:
+      obj = alloc_typed(sizeof(struct object), Descriptors[type]);
+      break;
+  }
+  gc_stats_count_allocation(OBJECT_STATS_KINDS[type], sizeof(struct object));
+  alloc_profiler_record(sizeof(struct object));
+  obj->type = type;
+  return obj;
+}
+
+// The native function pointer is code, so only a native's data is scanned.
+static void describe_objects(void)
+{
+  struct alloc_layout layout;
+
+  alloc_layout_init(&layout, sizeof(struct object));
+  ALLOC_LAYOUT_POINTER(&layout, struct object, value.s);
+  Descriptors[OBJECT_TYPE_STRING] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct object));
+  ALLOC_LAYOUT_POINTER(&layout, struct object, value.nf.data);
+  Descriptors[OBJECT_TYPE_NATIVE_FUNCTION] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct object));
+  ALLOC_LAYOUT_POINTER(&layout, struct object, value.f.declaration);
+  ALLOC_LAYOUT_POINTER(&layout, struct object, value.f.closure);
+  Descriptors[OBJECT_TYPE_FUNCTION] = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct object));
+  ALLOC_LAYOUT_POINTER(&layout, struct object, value.wm);
+  Descriptors[OBJECT_TYPE_WEAK_MAP] = alloc_layout_descriptor(&layout);
+}
+
+static void init_small_numbers(void)
+{
+  for (long i = SMALL_NUMBER_MIN; i <= SMALL_NUMBER_MAX; ++i) {
+    SmallNumbers[i - SMALL_NUMBER_MIN] = (struct object) {
+        .type = OBJECT_TYPE_NUMBER,
+        .value.d = (double)i,
+    };
+  }
+}
+
 long object_arity(struct object* obj)
 {
   switch (obj->type) {
@@ -132,7 +220,7 @@ size_t object_snprint(char* s, size_t n, const struct object* obj)
 
 static struct my_file_printer* file_printer_new(FILE* fp)
 {
-  struct my_file_printer* handle = GC_MALLOC(sizeof(struct my_file_printer));
+  struct my_file_printer* handle = alloc_untyped(sizeof(struct my_file_printer));
   handle->fp = fp;
   handle->base.write = object_print_to_file;
   return handle;
@@ -141,7 +229,7 @@ static struct my_file_printer* file_printer_new(FILE* fp)
 static struct my_string_printer* string_printer_new(char* str, size_t len)
 {
   struct my_string_printer* handle =
-      GC_MALLOC(sizeof(struct my_string_printer));
+      alloc_untyped(sizeof(struct my_string_printer));
   handle->str = str;
   handle->len = len;
   return handle;
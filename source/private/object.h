@@ -14,13 +14,17 @@ enum object_type
   OBJECT_TYPE_NULL,
   OBJECT_TYPE_NATIVE_FUNCTION,
   OBJECT_TYPE_FUNCTION,
+  OBJECT_TYPE_WEAK_MAP,
 };
 
 struct object_list;
+struct weak_map;
 
 struct native_function {
   long arity;
   struct object* (*func)(struct interpreter*, struct object_list*);
+  // state for natives that carry some (compiled Lox closures), else NULL
+  void* data;
 };
 
 struct function {
@@ -36,11 +40,25 @@ struct object {
     bool b;
     struct native_function nf;
     struct function f;
+    struct weak_map* wm;
   } value;
 };
 
 DECLARE_NAMED_LIST(object_list, struct object*);
 
+// Objects are never modified once made, so some are shared instead of
+// allocated each time. nil, true and false exist once each, as these statics
+// (which hold no pointers, so the collector needn't know about them), and
+// integral numbers from SMALL_NUMBER_MIN to SMALL_NUMBER_MAX come from a
+// static cache. The scanner also gives every occurrence of a literal the
+// same object.
+extern struct object ObjectNil;
+extern struct object ObjectTrue;
+extern struct object ObjectFalse;
+
+#define SMALL_NUMBER_MIN (-128)
+#define SMALL_NUMBER_MAX 1023
+
 struct object* object_new_string(char* value);
 struct object* object_new_number(double value);
 struct object* object_new_bool(bool value);
@@ -49,24 +67,27 @@ struct object* object_new_native_function(
     long arity,
     struct object* (*value)(struct interpreter*, struct object_list*));
 struct object* object_new_function(struct function func);
+struct object* object_new_weak_map(struct weak_map* map);
 
 long object_arity(struct object* obj);
 
 #define OBJECT_STRING(val) ((struct object*)object_new_string(val))
 #define OBJECT_NUMBER(val) ((struct object*)object_new_number(val))
-#define OBJECT_BOOL(val) ((struct object*)object_new_bool(val))
-#define OBJECT_NULL() ((struct object*)object_new_null())
+#define OBJECT_BOOL(val) ((val) ? &ObjectTrue : &ObjectFalse)
+#define OBJECT_NULL() (&ObjectNil)
 #define OBJECT_NATIVE_FUNCTION(arity, val) \
   ((struct object*)object_new_native_function(arity, val))
 #define OBJECT_FUNCTION(func) ((struct object*)object_new_function(func))
+#define OBJECT_WEAK_MAP(map) ((struct object*)object_new_weak_map(map))
 
 #define OBJECT_IS_NUMBER(obj) ((obj)->type == OBJECT_TYPE_NUMBER)
 #define OBJECT_IS_STRING(obj) ((obj)->type == OBJECT_TYPE_STRING)
-#define OBJECT_IS_BOOL(obj) ((obj)->type == OBJECT_TYPE_BOOL)
-#define OBJECT_IS_NULL(obj) ((obj)->type == OBJECT_TYPE_NULL)
+#define OBJECT_IS_BOOL(obj) ((obj) == &ObjectTrue || (obj) == &ObjectFalse)
+#define OBJECT_IS_NULL(obj) ((obj) == &ObjectNil)
 #define OBJECT_IS_NATIVE_FUNCTION(obj) \
   ((obj)->type == OBJECT_TYPE_NATIVE_FUNCTION)
 #define OBJECT_IS_FUNCTION(obj) ((obj)->type == OBJECT_TYPE_FUNCTION)
+#define OBJECT_IS_WEAK_MAP(obj) ((obj)->type == OBJECT_TYPE_WEAK_MAP)
 #define OBJECT_IS_CALLABLE(obj) \
   (OBJECT_IS_NATIVE_FUNCTION(obj) || OBJECT_IS_FUNCTION(obj))
 
@@ -75,6 +96,7 @@ long object_arity(struct object* obj);
 #define OBJECT_AS_BOOL(obj) (obj)->value.b
 #define OBJECT_AS_NATIVE_FUNCTION(obj) (obj)->value.nf
 #define OBJECT_AS_FUNCTION(obj) (obj)->value.f
+#define OBJECT_AS_WEAK_MAP(obj) (obj)->value.wm
 
 size_t object_print(const struct object* obj);
 size_t object_fprint(FILE* f, const struct object* obj);
@@ -0,0 +1,180 @@
+#include <math.h>
+#include <private/assertions.h>
+#include <private/ast/stmt.h>
+#include <private/operators.h>
+#include <private/strutils.h>
+#include <string.h>
+
+static struct runtime_error* check_number_operand(struct token* op,
+                                                  struct object* operand);
+static struct runtime_error* check_number_operands(struct token* op,
+                                                   struct object* left,
+                                                   struct object* right);
+
+bool operator_is_truthy(struct object* obj)
+{
+  // nil and false are singletons (see object.h)
+  return obj != &ObjectNil && obj != &ObjectFalse;
+}
+
+bool operator_is_equal(struct object* left, struct object* right)
+{
+  if (OBJECT_IS_NULL(left) && OBJECT_IS_NULL(right)) {
+    return true;
+  }
+  if (OBJECT_IS_NULL(left)) {
+    return false;
+  }
+
+  switch (left->type) {
+    case OBJECT_TYPE_NULL:
+      return OBJECT_IS_NULL(right);
+    case OBJECT_TYPE_BOOL:
+      return left == right;
+    case OBJECT_TYPE_STRING:
+      return OBJECT_IS_STRING(right)
+          && strcmp(OBJECT_AS_STRING(left), OBJECT_AS_STRING(right)) == 0;
+    case OBJECT_TYPE_NUMBER:
+      return OBJECT_IS_NUMBER(right)
+          && fabs(OBJECT_AS_NUMBER(left) - OBJECT_AS_NUMBER(right))
+          < OPERATOR_NUMBER_DELTA;
+    case OBJECT_TYPE_NATIVE_FUNCTION:
+      return OBJECT_IS_NATIVE_FUNCTION(right)
+          && OBJECT_AS_NATIVE_FUNCTION(left).func
+          == OBJECT_AS_NATIVE_FUNCTION(right).func
+          && OBJECT_AS_NATIVE_FUNCTION(left).data
+          == OBJECT_AS_NATIVE_FUNCTION(right).data;
+    case OBJECT_TYPE_FUNCTION:
+      return OBJECT_IS_FUNCTION(right)
+          && OBJECT_AS_FUNCTION(left).declaration
+          == OBJECT_AS_FUNCTION(right).declaration;
+    case OBJECT_TYPE_WEAK_MAP:
+      return left == right;
+  }
+  ASSERT_UNREACHABLE();
+}
+
+const char* operator_stringify(struct object* obj)
+{
+  switch (obj->type) {
+    case OBJECT_TYPE_STRING:
+      return OBJECT_AS_STRING(obj);
+    case OBJECT_TYPE_NUMBER:
+      return alloc_printf("%lg", OBJECT_AS_NUMBER(obj));
+    case OBJECT_TYPE_BOOL:
+      return alloc_printf("%s", OBJECT_AS_BOOL(obj) ? "true" : "false");
+    case OBJECT_TYPE_NULL:
+      return "nil";
+    case OBJECT_TYPE_NATIVE_FUNCTION:
+      return "<native fn>";
+    case OBJECT_TYPE_FUNCTION:
+      return alloc_printf("<fn %s>",
+                          OBJECT_AS_FUNCTION(obj).declaration->name.lexeme);
+    case OBJECT_TYPE_WEAK_MAP:
+      return "<weak map>";
+  }
+  ASSERT_UNREACHABLE();
+}
+
+struct object* operator_binary(struct token* op,
+                               struct object* left,
+                               struct object* right,
+                               struct runtime_error** err)
+{
+  switch (op->type) {
+    case TOKEN_BANG_EQUAL:
+      return object_new_bool(!operator_is_equal(left, right));
+    case TOKEN_EQUAL_EQUAL:
+      return object_new_bool(operator_is_equal(left, right));
+    case TOKEN_GREATER:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_bool(OBJECT_AS_NUMBER(left) > OBJECT_AS_NUMBER(right));
+    case TOKEN_GREATER_EQUAL:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_bool(OBJECT_AS_NUMBER(left)
+                             >= OBJECT_AS_NUMBER(right));
+    case TOKEN_LESS:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_bool(OBJECT_AS_NUMBER(left) < OBJECT_AS_NUMBER(right));
+    case TOKEN_LESS_EQUAL:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_bool(OBJECT_AS_NUMBER(left)
+                             <= OBJECT_AS_NUMBER(right));
+    case TOKEN_MINUS:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_number(OBJECT_AS_NUMBER(left)
+                               - OBJECT_AS_NUMBER(right));
+    case TOKEN_PLUS:
+      if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) {
+        return object_new_number(OBJECT_AS_NUMBER(left)
+                                 + OBJECT_AS_NUMBER(right));
+      }
+      if (OBJECT_IS_STRING(left) && OBJECT_IS_STRING(right)) {
+        return object_new_string(alloc_printf(
+            "%s%s", OBJECT_AS_STRING(left), OBJECT_AS_STRING(right)));
+      }
+      *err = runtime_error_new(op,
+                               "Operands must be two numbers or two strings.");
+      return NULL;
+    case TOKEN_SLASH:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_number(OBJECT_AS_NUMBER(left)
+                               / OBJECT_AS_NUMBER(right));
+    case TOKEN_STAR:
+      if ((*err = check_number_operands(op, left, right))) {
+        return NULL;
+      }
+      return object_new_number(OBJECT_AS_NUMBER(left)
+                               * OBJECT_AS_NUMBER(right));
+    default:
+      ASSERT_UNREACHABLE();
+  }
+}
+
+struct object* operator_unary(struct token* op,
+                              struct object* right,
+                              struct runtime_error** err)
+{
+  switch (op->type) {
+    case TOKEN_BANG:
+      return object_new_bool(!operator_is_truthy(right));
+    case TOKEN_MINUS:
+      if ((*err = check_number_operand(op, right))) {
+        return NULL;
+      }
+      return object_new_number(-OBJECT_AS_NUMBER(right));
+    default:
+      ASSERT_UNREACHABLE();
+  }
+}
+
+static struct runtime_error* check_number_operand(struct token* op,
+                                                  struct object* operand)
+{
+  if (OBJECT_IS_NUMBER(operand)) {
+    return NULL;
+  }
+  return runtime_error_new(op, "Operand must be a number.");
+}
+
+static struct runtime_error* check_number_operands(struct token* op,
+                                                   struct object* left,
+                                                   struct object* right)
+{
+  if (OBJECT_IS_NUMBER(left) && OBJECT_IS_NUMBER(right)) {
+    return NULL;
+  }
+  return runtime_error_new(op, "Operands must be numbers.");
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <private/object.h>
+#include <private/runtime_error.h>
+#include <private/token.h>
+#include <stdbool.h>
+
+// Lox's operator semantics, shared by the interpreter and by programs emitted
+// with --emit-c. The binary and unary operators return NULL and set *err when
+// an operand has the wrong type.
+
+// numbers closer than this are equal
+#define OPERATOR_NUMBER_DELTA 0.000001
+
+bool operator_is_truthy(struct object* obj);
+bool operator_is_equal(struct object* left, struct object* right);
+// the text `print` writes for obj
+const char* operator_stringify(struct object* obj);
+struct object* operator_binary(struct token* op,
+                               struct object* left,
+                               struct object* right,
+                               struct runtime_error** err);
+struct object* operator_unary(struct token* op,
+                              struct object* right,
+                              struct runtime_error** err);
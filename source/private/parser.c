@@ -1,5 +1,5 @@
-#include <gc.h>
 #include <lib.h>
+#include <private/alloc.h>
 #include <private/ast/expr.h>
 #include <private/parser.h>
 #include <private/strutils.h>
@@ -44,10 +44,11 @@ static struct token* parser_consume(struct parser* parser,
                                     const char* message);
 static void error(struct token* token, const char* message);
 static void parser_synchronize(struct parser* parser);
+static struct stmt* stmt_set_line(struct stmt* stmt, size_t line);
 
 struct parser* parser_new(struct token_list* tokens)
 {
-  struct parser* parser = GC_MALLOC(sizeof(struct parser));
+  struct parser* parser = alloc_untyped(sizeof(struct parser));
   parser->tokens = tokens;
   parser->current = 0;
   return parser;
@@ -68,15 +69,16 @@ struct stmt_list* parser_parse(struct parser* parser)
 
 static struct stmt* parse_declaration(struct parser* parser)
 {
+  size_t line = parser_peek(parser)->line;
   if (parser_match(parser, 1, TOKEN_FUN)) {
     struct stmt* decl = parse_function(parser, "function");
     if (decl) {
-      return decl;
+      return stmt_set_line(decl, line);
     }
   } else if (parser_match(parser, 1, TOKEN_VAR)) {
     struct stmt* decl = parse_var_declaration(parser);
     if (decl) {
-      return decl;
+      return stmt_set_line(decl, line);
     }
   } else {
     struct stmt* stmt = parse_statement(parser);
@@ -90,30 +92,31 @@ static struct stmt* parse_declaration(struct parser* parser)
 
 static struct stmt* parse_statement(struct parser* parser)
 {
+  size_t line = parser_peek(parser)->line;
   if (parser_match(parser, 1, TOKEN_IF)) {
-    return parse_if_statement(parser);
+    return stmt_set_line(parse_if_statement(parser), line);
   }
   if (parser_match(parser, 1, TOKEN_FOR)) {
-    return parse_for_statement(parser);
+    return stmt_set_line(parse_for_statement(parser), line);
   }
   if (parser_match(parser, 1, TOKEN_PRINT)) {
-    return parse_print_statement(parser);
+    return stmt_set_line(parse_print_statement(parser), line);
   }
   if (parser_match(parser, 1, TOKEN_RETURN)) {
-    return parse_return_statement(parser);
+    return stmt_set_line(parse_return_statement(parser), line);
   }
   if (parser_match(parser, 1, TOKEN_WHILE)) {
-    return parse_while_statement(parser);
+    return stmt_set_line(parse_while_statement(parser), line);
   }
   if (parser_match(parser, 1, TOKEN_LEFT_BRACE)) {
     struct stmt_list* statements = parse_block(parser);
     if (!statements) {
       return NULL;
     }
-    return (struct stmt*)stmt_new_block(statements);
+    return stmt_set_line((struct stmt*)stmt_new_block(statements), line);
   }
 
-  return parse_expression_statement(parser);
+  return stmt_set_line(parse_expression_statement(parser), line);
 }
 
 static struct stmt* parse_print_statement(struct parser* parser)
@@ -192,6 +195,7 @@ static struct stmt* parse_if_statement(struct parser* parser)
 
 static struct stmt* parse_for_statement(struct parser* parser)
 {
+  size_t line = parser_previous(parser)->line;
   if (!parser_consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'for'.")) {
     return NULL;
   }
@@ -225,6 +229,7 @@ static struct stmt* parse_for_statement(struct parser* parser)
   }
 
   struct expr* increment = NULL;
+  size_t increment_line = parser_peek(parser)->line;
   if (!parser_check(parser, TOKEN_RIGHT_PAREN)) {
     increment = parse_expression(parser);
     if (!increment) {
@@ -244,19 +249,21 @@ static struct stmt* parse_for_statement(struct parser* parser)
   if (increment) {
     struct stmt_list* new_body = stmt_list_new();
     LIST_PUSH(new_body, body);
-    LIST_PUSH(new_body, (struct stmt*)stmt_new_expression(increment));
-    body = (struct stmt*)stmt_new_block(new_body);
+    LIST_PUSH(new_body,
+              stmt_set_line((struct stmt*)stmt_new_expression(increment),
+                            increment_line));
+    body = stmt_set_line((struct stmt*)stmt_new_block(new_body), line);
   }
 
   if (!condition) {
     condition = (struct expr*)expr_new_literal(OBJECT_BOOL(true));
   }
-  body = (struct stmt*)stmt_new_while(condition, body);
+  body = stmt_set_line((struct stmt*)stmt_new_while(condition, body), line);
   if (initializer) {
     struct stmt_list* new_body = stmt_list_new();
-    LIST_PUSH(new_body, initializer);
+    LIST_PUSH(new_body, stmt_set_line(initializer, line));
     LIST_PUSH(new_body, body);
-    body = (struct stmt*)stmt_new_block(new_body);
+    body = stmt_set_line((struct stmt*)stmt_new_block(new_body), line);
   }
   return body;
 }
@@ -541,7 +548,7 @@ static struct expr* parse_call(struct parser* parser)
 
 static struct expr* finish_call(struct parser* parser, struct expr* callee)
 {
-  struct expr_list* arguments = GC_MALLOC(sizeof(struct expr_list));
+  struct expr_list* arguments = alloc_untyped(sizeof(struct expr_list));
   LIST_INIT(arguments);
   if (!parser_check(parser, TOKEN_RIGHT_PAREN)) {
     while (true) {
@@ -684,3 +691,11 @@ static void parser_synchronize(struct parser* parser)
     parser_advance(parser);
   }
 }
+
+static struct stmt* stmt_set_line(struct stmt* stmt, size_t line)
+{
+  if (stmt) {
+    stmt->line = line;
+  }
+  return stmt;
+}
@@ -0,0 +1,1160 @@
+// A generational mark-sweep collector owned by the interpreter, built
+// instead of the Boehm GC with -Dgc-c-jlox_GC=precise. It never moves
+// objects, so the rest of the interpreter cannot tell the two apart.
+//
+// The heap is a set of PAGE_SIZE-aligned pages of three kinds. Small objects
+// are bump-allocated in nursery pages. Medium objects go straight to the old
+// generation, in small pages cut into equal slots of one size class, and a
+// large object gets a run of pages to itself. Every object starts with a
+// block header holding its layout (or one of the ATOMIC, UNTYPED and FREE
+// kinds), its size and its mark bit, and a page table maps page numbers to
+// pages, so any word can be checked for pointing into a live object. As in
+// Boehm's default configuration a pointer anywhere into an object keeps it
+// alive.
+//
+// Objects are traced precisely: typed objects through their layout's pointer
+// words, atomic ones not at all, and untyped ones (lists, tables) word by
+// word. The roots are the static regions passed to alloc_add_root and the C
+// stack and registers, which are scanned conservatively since C has no stack
+// maps.
+//
+// A minor collection runs when the nursery is full. It marks only young
+// objects, from the roots and from the old pages written since the last
+// collection, and promotes every nursery page holding a survivor to the old
+// generation as it is; the other nursery pages are reused, so young garbage
+// is never traced or swept. Objects cannot move, since the roots are scanned
+// conservatively, so a promoted page keeps the free runs between its
+// survivors, and the nursery bump-allocates in those runs (as Immix does)
+// before taking fresh pages; a young object is told from its old neighbours
+// by the young bit in its header. Old pages are write-protected after each
+// collection and the first write to one unprotects it (see on_fault), which
+// is the write barrier: pointer stores happen all over the interpreter, and
+// one left out of an explicit barrier would free a live object.
+//
+// Only the program's own writes fault, though. A system call that writes to a
+// protected page (read or fread into a buffer, say) fails with EFAULT rather
+// than raise the signal, so every read into the heap goes through
+// alloc_fread, which unprotects the pages first.
+//
+// A major collection marks and sweeps everything. It runs when the old
+// generation has grown by the size of what survived the last one (at least
+// MIN_TRIGGER), so the old generation stays around twice the live data.
+//
+// Weak links are kept in a plain array. After marking, a link whose holder
+// died is dropped, and one whose object died is cleared and dropped; in a
+// minor collection only young objects can have died.
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <private/alloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PAGE_SHIFT 16
+#define PAGE_SIZE ((size_t)1 << PAGE_SHIFT)
+#define GRANULE 16
+#define ROUND_UP(n, to) (((n) + (to)-1) / (to) * (to))
+// slot sizes, headers included; larger objects get their own pages
+#define MAX_SMALL_SLOT 8176
+#define MAX_NURSERY_SLOT 2048
+#define NURSERY_PAGES 32
+// free runs on old bump pages smaller than this aren't worth allocating in
+#define MIN_RUN 256
+#define MIN_TRIGGER ((size_t)4 << 20)
+
+static const size_t SLOT_SIZES[] = {
+    32,   48,   64,   80,   96,   112,  128,  160,  192,  224,
+    256,  320,  384,  448,  512,  640,  768,  896,  1024, 1280,
+    1536, 1792, 2048, 2560, 3072, 4080, 5456, 8176,
+};
+#define SIZE_CLASSES (sizeof SLOT_SIZES / sizeof SLOT_SIZES[0])
+
+struct block {
+  const struct alloc_layout* layout;
+  uint32_t size;
+  // the block's length on a bump page, which its size may no longer give
+  uint16_t granules;
+  uint8_t marked;
+  // allocated in the nursery since the last collection
+  uint8_t young;
+};
+
+_Static_assert(sizeof(struct block) % GRANULE == 0,
+               "payloads must stay granule-aligned");
+
+enum page_kind
+{
+  PAGE_SMALL,
+  PAGE_LARGE,
+  PAGE_BUMP,
+};
+
+struct page {
+  struct page* next;
+  char* slots;
+  // bump pages: the end of the last block
+  char* top;
+  // old bump pages: where the nursery looks for the next free run
+  char* cursor;
+  // small pages
+  size_t slot_size;
+  size_t slot_count;
+  size_t size_class;
+  size_t page_count;
+  // bytes marked in the collection in progress
+  size_t live;
+  enum page_kind kind;
+  bool young;
+  // read-only until the program writes to it (see on_fault)
+  bool write_protected;
+  // bump pages: the granules that start a block
+  uint64_t starts[PAGE_SIZE / GRANULE / 64];
+};
+
+#define SLOTS_OFFSET ROUND_UP(sizeof(struct page), GRANULE)
+
+struct root {
+  uintptr_t start;
+  uintptr_t end;
+};
+
+// the kinds of block that have no layout
+static const struct alloc_layout AtomicKind;
+static const struct alloc_layout UntypedKind;
+static const struct alloc_layout FreeKind;
+#define ATOMIC (&AtomicKind)
+#define UNTYPED (&UntypedKind)
+#define FREE (&FreeKind)
+
+static uintptr_t StackBase = 0;
+static unsigned char SizeClassOf[MAX_SMALL_SLOT / GRANULE + 1];
+static struct block* FreeLists[SIZE_CLASSES];
+// the old generation
+static struct page* Pages = NULL;
+
+// nursery pages in use, newest first, and the bump pointer into the newest
+// of them or into a free run of an old page
+static struct page* Nursery = NULL;
+static struct page* BumpPage = NULL;
+static char* BumpTop = NULL;
+static char* BumpLimit = NULL;
+// bytes given to the nursery since the last collection
+static size_t NurseryBytes = 0;
+// old bump pages with free runs, and how many the nursery has used up
+static struct page** Recyclable = NULL;
+static size_t RecyclableCount = 0;
+static size_t RecyclableCapacity = 0;
+static size_t RecycledCount = 0;
+// empty pages kept for the nursery
+static struct page* NurseryPool = NULL;
+static size_t NurseryPoolLength = 0;
+
+// open addressing on page numbers; 0 marks an empty entry
+static uintptr_t* PageTableKeys = NULL;
+static struct page** PageTableValues = NULL;
+static size_t PageTableCapacity = 0;
+static size_t PageTableCount = 0;
+static uintptr_t HeapLow = UINTPTR_MAX;
+static uintptr_t HeapHigh = 0;
+
+static struct root* Roots = NULL;
+static size_t RootCount = 0;
+static struct block** MarkStack = NULL;
+static size_t MarkLength = 0;
+static size_t MarkCapacity = 0;
+static void*** WeakLinks = NULL;
+static size_t WeakLinkCount = 0;
+static size_t WeakLinkCapacity = 0;
+// a minor collection marks only young blocks
+static bool MarkingYoung = false;
+static struct sigaction PreviousSegv;
+static struct sigaction PreviousBus;
+
+static size_t HeapSize = 0;
+static size_t FreeBytes = 0;
+static size_t TotalBytes = 0;
+static size_t TotalBytesAtCollection = 0;
+static size_t LiveBytes = 0;
+static size_t OldBytesSinceMajor = 0;
+static size_t Trigger = MIN_TRIGGER;
+static size_t MaxHeapSize = 0;
+static alloc_oom_fn OomFn = NULL;
+static alloc_event_hook EventHook = NULL;
+
+static void* allocate(size_t size, const struct alloc_layout* layout);
+static struct block* take_young(size_t slot);
+static bool next_nursery_region(size_t slot);
+static bool next_free_run(size_t slot);
+static struct block* take_small(size_t size_class);
+static struct block* take_large(size_t size);
+static struct page* add_pages(size_t page_count);
+static bool may_grow(size_t bytes);
+static void collect(bool major);
+static void mark_roots(void);
+static void mark_stack(void);
+static void mark_stack_from_here(void);
+static void mark_range(uintptr_t start, uintptr_t end);
+static void mark_word(uintptr_t word);
+static void scan_block(struct block* block);
+static void scan_written_pages(void);
+static void clear_weak_links(void);
+static bool is_dead(uintptr_t address);
+static void retire_nursery(void);
+static void sweep_recycled(void);
+static void sweep(void);
+static void free_run(struct page* page, char* start, char* end);
+static bool coalesce(struct page* page);
+static void add_recyclable(struct page* page);
+static void release_page(struct page* page);
+static void pool_page(struct page* page);
+static void protect_old_pages(void);
+static void unprotect_old_pages(void);
+static void unprotect_range(void* pointer, size_t size);
+static void unprotect_page(struct page* page);
+static struct page* page_at(uintptr_t address);
+static void on_fault(int signal_number, siginfo_t* info, void* context);
+static struct block* find_block(uintptr_t address, struct page** found);
+static struct block* first_block(struct page* page);
+static struct block* next_block(struct page* page, struct block* block);
+static void page_table_insert(struct page* page);
+static void page_table_rebuild(void);
+static size_t page_table_slot(uintptr_t key);
+static _Noreturn void fail(const char* what);
+
+void alloc_init(void* stack_base)
+{
+  StackBase = (uintptr_t)stack_base;
+  size_t size_class = 0;
+  for (size_t granules = 0; granules <= MAX_SMALL_SLOT / GRANULE; ++granules) {
+    while (SLOT_SIZES[size_class] < granules * GRANULE) {
+      ++size_class;
+    }
+    SizeClassOf[granules] = (unsigned char)size_class;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof action);
+  action.sa_sigaction = on_fault;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &PreviousSegv);
+  sigaction(SIGBUS, &action, &PreviousBus);
+}
+
+void* alloc_untyped(size_t size)
+{
+  return allocate(size, UNTYPED);
+}
+
+void* alloc_realloc(void* pointer, size_t size)
+{
+  if (!pointer) {
+    return alloc_untyped(size);
+  }
+  struct block* block = find_block((uintptr_t)pointer, NULL);
+  assert(block && pointer == block + 1);
+  if (size <= alloc_size(pointer)) {
+    if (size > block->size && block->layout != ATOMIC) {
+      memset((char*)pointer + block->size, 0, size - block->size);
+    }
+    block->size = (uint32_t)size;
+    return pointer;
+  }
+  void* moved = allocate(size, block->layout);
+  if (moved) {
+    memcpy(moved, pointer, block->size < size ? block->size : size);
+  }
+  return moved;
+}
+
+void* alloc_atomic(size_t size)
+{
+  return allocate(size, ATOMIC);
+}
+
+alloc_descriptor alloc_layout_descriptor(struct alloc_layout* layout)
+{
+  // descriptors live as long as the program, outside the collected heap
+  struct alloc_layout* copy = malloc(sizeof(struct alloc_layout));
+  if (!copy) {
+    fail("layout");
+  }
+  *copy = *layout;
+  return copy;
+}
+
+void* alloc_typed(size_t size, alloc_descriptor descriptor)
+{
+  return allocate(size, descriptor);
+}
+
+size_t alloc_size(const void* pointer)
+{
+  struct page* page;
+  struct block* block =
+      pointer ? find_block((uintptr_t)pointer, &page) : NULL;
+  if (!block) {
+    return 0;
+  }
+  size_t length = page->kind == PAGE_BUMP
+      ? (size_t)block->granules * GRANULE
+      : page->slot_size;
+  return length - sizeof(struct block);
+}
+
+void alloc_add_root(void* start, size_t size)
+{
+  struct root* roots = realloc(Roots, (RootCount + 1) * sizeof(struct root));
+  if (!roots) {
+    fail("roots");
+  }
+  Roots = roots;
+  Roots[RootCount++] = (struct root) {
+      .start = (uintptr_t)start,
+      .end = (uintptr_t)start + size,
+  };
+}
+
+void alloc_collect(void)
+{
+  collect(true);
+}
+
+size_t alloc_fread(void* pointer, size_t size, FILE* stream)
+{
+  unprotect_range(pointer, size);
+  return fread(pointer, 1, size, stream);
+}
+
+void alloc_set_oom_fn(alloc_oom_fn fn)
+{
+  OomFn = fn;
+}
+
+void alloc_set_max_heap_size(size_t bytes)
+{
+  MaxHeapSize = bytes;
+}
+
+bool alloc_enable_incremental(unsigned long pause_target_ms)
+{
+  (void)pause_target_ms;
+  return false;
+}
+
+struct alloc_heap_stats alloc_get_heap_stats(void)
+{
+  return (struct alloc_heap_stats) {
+      .heap_size = HeapSize,
+      .free_bytes = FreeBytes + NurseryPoolLength * PAGE_SIZE
+          + (size_t)(BumpLimit - BumpTop),
+      .total_bytes = TotalBytes,
+  };
+}
+
+bool alloc_register_weak_link(void** link, void* object)
+{
+  (void)object;
+  if (WeakLinkCount == WeakLinkCapacity) {
+    size_t capacity = WeakLinkCapacity ? WeakLinkCapacity * 2 : 64;
+    void*** links = realloc(WeakLinks, capacity * sizeof(void**));
+    if (!links) {
+      return false;
+    }
+    WeakLinks = links;
+    WeakLinkCapacity = capacity;
+  }
+  WeakLinks[WeakLinkCount++] = link;
+  return true;
+}
+
+// The link stays in WeakLinks until the next collection drops it for being
+// NULL, which saves searching for it.
+void alloc_clear_weak_link(void** link)
+{
+  *link = NULL;
+}
+
+void alloc_set_event_hook(alloc_event_hook hook)
+{
+  EventHook = hook;
+}
+
+static void* allocate(size_t size, const struct alloc_layout* layout)
+{
+  assert(StackBase && "ALLOC_INIT() must run first");
+  if (size > UINT32_MAX) {
+    return OomFn ? OomFn(size) : NULL;
+  }
+  size_t slot = ROUND_UP(sizeof(struct block) + size, GRANULE);
+  struct block* block;
+  if (slot <= MAX_NURSERY_SLOT) {
+    block = take_young(slot);
+  } else if (slot <= MAX_SMALL_SLOT) {
+    block = take_small(SizeClassOf[slot / GRANULE]);
+  } else {
+    block = take_large(size);
+  }
+  if (!block) {
+    return OomFn ? OomFn(size) : NULL;
+  }
+  block->layout = layout;
+  block->size = (uint32_t)size;
+  block->marked = 0;
+  block->young = slot <= MAX_NURSERY_SLOT;
+  if (layout != ATOMIC) {
+    memset(block + 1, 0, size);
+  }
+  return block + 1;
+}
+
+static struct block* take_young(size_t slot)
+{
+  if ((size_t)(BumpLimit - BumpTop) < slot && !next_nursery_region(slot)) {
+    return NULL;
+  }
+  struct page* page = BumpPage;
+  struct block* block = (struct block*)BumpTop;
+  size_t granule = (size_t)(BumpTop - page->slots) / GRANULE;
+  page->starts[granule / 64] |= (uint64_t)1 << (granule % 64);
+  block->granules = (uint16_t)(slot / GRANULE);
+  BumpTop += slot;
+  if (page->young) {
+    page->top = BumpTop;
+  } else if (BumpTop < BumpLimit) {
+    // the rest of a free run stays a free block
+    free_run(page, BumpTop, BumpLimit);
+  }
+  TotalBytes += slot;
+  return block;
+}
+
+static bool next_nursery_region(size_t slot)
+{
+  if (NurseryBytes >= NURSERY_PAGES * PAGE_SIZE) {
+    collect(OldBytesSinceMajor >= Trigger);
+  }
+  if (next_free_run(slot)) {
+    return true;
+  }
+  struct page* page = NurseryPool;
+  if (page) {
+    NurseryPool = page->next;
+    --NurseryPoolLength;
+  } else {
+    if (!may_grow(PAGE_SIZE)) {
+      return false;
+    }
+    // growing may have collected, emptying the nursery
+    if (NurseryPool) {
+      return next_nursery_region(slot);
+    }
+    page = add_pages(1);
+    if (!page) {
+      return false;
+    }
+    page->kind = PAGE_BUMP;
+    page->top = page->slots;
+  }
+  page->young = true;
+  page->next = Nursery;
+  Nursery = page;
+  BumpPage = page;
+  BumpTop = page->slots;
+  BumpLimit = (char*)page + PAGE_SIZE;
+  NurseryBytes += PAGE_SIZE;
+  return true;
+}
+
+// Points the bump pointer at the next free run of an old page. A run too
+// short for `slot` is left for later allocations, which a fresh page serves
+// meanwhile.
+static bool next_free_run(size_t slot)
+{
+  while (RecycledCount < RecyclableCount) {
+    struct page* page = Recyclable[RecycledCount];
+    for (struct block* block = page->cursor < page->top
+             ? (struct block*)page->cursor
+             : NULL;
+         block;
+         block = next_block(page, block))
+    {
+      size_t length = (size_t)block->granules * GRANULE;
+      if (block->layout != FREE || length < MIN_RUN) {
+        continue;
+      }
+      if (length < slot) {
+        page->cursor = (char*)block;
+        return false;
+      }
+      unprotect_page(page);
+      BumpPage = page;
+      BumpTop = (char*)block;
+      BumpLimit = BumpTop + length;
+      page->cursor = BumpLimit;
+      NurseryBytes += length;
+      return true;
+    }
+    ++RecycledCount;
+  }
+  return false;
+}
+
+static struct block* take_small(size_t size_class)
+{
+  size_t slot_size = SLOT_SIZES[size_class];
+  if (!FreeLists[size_class] && OldBytesSinceMajor >= Trigger) {
+    collect(true);
+  }
+  if (!FreeLists[size_class]) {
+    if (!may_grow(PAGE_SIZE)) {
+      return NULL;
+    }
+    struct page* page = add_pages(1);
+    if (!page) {
+      return NULL;
+    }
+    page->kind = PAGE_SMALL;
+    page->slot_size = slot_size;
+    page->slot_count = (PAGE_SIZE - SLOTS_OFFSET) / slot_size;
+    page->size_class = size_class;
+    page->next = Pages;
+    Pages = page;
+    for (size_t i = page->slot_count; i-- > 0;) {
+      struct block* free = (struct block*)(page->slots + i * slot_size);
+      free->layout = FREE;
+      *(struct block**)(free + 1) = FreeLists[size_class];
+      FreeLists[size_class] = free;
+    }
+    FreeBytes += page->slot_count * slot_size;
+  }
+  struct block* block = FreeLists[size_class];
+  FreeLists[size_class] = *(struct block**)(block + 1);
+  FreeBytes -= slot_size;
+  TotalBytes += slot_size;
+  OldBytesSinceMajor += slot_size;
+  return block;
+}
+
+static struct block* take_large(size_t size)
+{
+  size_t page_count =
+      ROUND_UP(SLOTS_OFFSET + sizeof(struct block) + size, PAGE_SIZE)
+      / PAGE_SIZE;
+  if (OldBytesSinceMajor >= Trigger) {
+    collect(true);
+  }
+  if (!may_grow(page_count * PAGE_SIZE)) {
+    return NULL;
+  }
+  struct page* page = add_pages(page_count);
+  if (!page) {
+    return NULL;
+  }
+  page->kind = PAGE_LARGE;
+  page->slot_size = page_count * PAGE_SIZE - SLOTS_OFFSET;
+  page->slot_count = 1;
+  page->next = Pages;
+  Pages = page;
+  TotalBytes += page->slot_size;
+  OldBytesSinceMajor += page->slot_size;
+  return (struct block*)page->slots;
+}
+
+// a page run on no list yet
+static struct page* add_pages(size_t page_count)
+{
+  struct page* page = aligned_alloc(PAGE_SIZE, page_count * PAGE_SIZE);
+  if (!page) {
+    return NULL;
+  }
+  memset(page, 0, SLOTS_OFFSET);
+  page->slots = (char*)page + SLOTS_OFFSET;
+  page->page_count = page_count;
+  HeapSize += page_count * PAGE_SIZE;
+  page_table_insert(page);
+  return page;
+}
+
+// collects once before letting the heap grow past MaxHeapSize
+static bool may_grow(size_t bytes)
+{
+  if (MaxHeapSize == 0 || HeapSize + bytes <= MaxHeapSize) {
+    return true;
+  }
+  if (TotalBytes != TotalBytesAtCollection) {
+    collect(true);
+  }
+  return HeapSize + bytes <= MaxHeapSize;
+}
+
+static void collect(bool major)
+{
+  if (EventHook) {
+    EventHook(ALLOC_EVENT_START);
+  }
+  if (major) {
+    // marking and sweeping write to every page
+    unprotect_old_pages();
+    LiveBytes = 0;
+  }
+  MarkingYoung = !major;
+  mark_roots();
+  clear_weak_links();
+  if (major) {
+    sweep();
+  } else {
+    sweep_recycled();
+  }
+  retire_nursery();
+  protect_old_pages();
+  if (major) {
+    OldBytesSinceMajor = 0;
+    Trigger = LiveBytes > MIN_TRIGGER ? LiveBytes : MIN_TRIGGER;
+  }
+  TotalBytesAtCollection = TotalBytes;
+  if (EventHook) {
+    EventHook(ALLOC_EVENT_END);
+  }
+}
+
+static void mark_roots(void)
+{
+  for (size_t i = 0; i < RootCount; ++i) {
+    mark_range(Roots[i].start, Roots[i].end);
+  }
+  mark_stack();
+  if (MarkingYoung) {
+    scan_written_pages();
+  }
+  while (MarkLength > 0) {
+    scan_block(MarkStack[--MarkLength]);
+  }
+}
+
+// Spills the callee-saved registers into this frame, which the callee then
+// scans along with the rest of the stack.
+__attribute__((noinline)) static void mark_stack(void)
+{
+  __builtin_unwind_init();
+  mark_stack_from_here();
+}
+
+__attribute__((noinline)) static void mark_stack_from_here(void)
+{
+  volatile char here = 0;
+  mark_range((uintptr_t)&here, StackBase);
+}
+
+static void mark_range(uintptr_t start, uintptr_t end)
+{
+  start = ROUND_UP(start, sizeof(uintptr_t));
+  for (uintptr_t at = start; at + sizeof(uintptr_t) <= end;
+       at += sizeof(uintptr_t))
+  {
+    mark_word(*(const uintptr_t*)at);
+  }
+}
+
+static void mark_word(uintptr_t word)
+{
+  struct page* page;
+  struct block* block = find_block(word, &page);
+  if (!block || block->marked || (MarkingYoung && !block->young)) {
+    return;
+  }
+  block->marked = 1;
+  page->live += block->size;
+  LiveBytes += block->size;
+  if (block->layout == ATOMIC) {
+    return;
+  }
+  if (MarkLength == MarkCapacity) {
+    MarkCapacity = MarkCapacity ? MarkCapacity * 2 : 1024;
+    MarkStack = realloc(MarkStack, MarkCapacity * sizeof(struct block*));
+    if (!MarkStack) {
+      fail("mark stack");
+    }
+  }
+  MarkStack[MarkLength++] = block;
+}
+
+static void scan_block(struct block* block)
+{
+  const uintptr_t* words = (const uintptr_t*)(block + 1);
+  size_t count = block->size / sizeof(uintptr_t);
+  if (block->layout == UNTYPED) {
+    for (size_t i = 0; i < count; ++i) {
+      mark_word(words[i]);
+    }
+    return;
+  }
+  const struct alloc_layout* layout = block->layout;
+  if (layout->size / sizeof(uintptr_t) < count) {
+    count = layout->size / sizeof(uintptr_t);
+  }
+  for (size_t i = 0; i * ALLOC_WORD_BITS < count; ++i) {
+    uintptr_t bits = layout->bitmap[i];
+    while (bits) {
+      size_t word = i * ALLOC_WORD_BITS + (size_t)__builtin_ctzll(bits);
+      if (word < count) {
+        mark_word(words[word]);
+      }
+      bits &= bits - 1;
+    }
+  }
+}
+
+// The remembered set: every old page that isn't write-protected has been
+// written since the last collection (or is new), so only those can point
+// into the nursery.
+static void scan_written_pages(void)
+{
+  for (struct page* page = Pages; page; page = page->next) {
+    if (page->write_protected) {
+      continue;
+    }
+    for (struct block* block = first_block(page); block;
+         block = next_block(page, block))
+    {
+      // young blocks in free runs are marked only if reachable
+      if (block->layout != FREE && block->layout != ATOMIC && !block->young) {
+        scan_block(block);
+      }
+    }
+  }
+}
+
+static void clear_weak_links(void)
+{
+  size_t kept = 0;
+  for (size_t i = 0; i < WeakLinkCount; ++i) {
+    void** link = WeakLinks[i];
+    if (!*link || is_dead((uintptr_t)link)) {
+      continue;
+    }
+    if (is_dead((uintptr_t)*link)) {
+      // may fault once on a protected page, which on_fault handles
+      *link = NULL;
+      continue;
+    }
+    WeakLinks[kept++] = link;
+  }
+  WeakLinkCount = kept;
+}
+
+// whether marking left the object at `address` for dead; memory outside the
+// heap is never dead, and neither are old objects in a minor collection
+static bool is_dead(uintptr_t address)
+{
+  struct block* block = find_block(address, NULL);
+  return block && !block->marked && (!MarkingYoung || block->young);
+}
+
+// Promotes the nursery pages holding survivors to the old generation, their
+// free space (the unused end included) made into free runs, and returns the
+// rest to the pool.
+static void retire_nursery(void)
+{
+  while (Nursery) {
+    struct page* page = Nursery;
+    Nursery = page->next;
+    if (page->live == 0) {
+      pool_page(page);
+      continue;
+    }
+    for (struct block* block = first_block(page); block;
+         block = next_block(page, block))
+    {
+      if (block->marked) {
+        block->marked = 0;
+        block->young = 0;
+      } else {
+        block->layout = FREE;
+      }
+    }
+    char* end = (char*)page + PAGE_SIZE;
+    if (page->top < end) {
+      char* top = page->top;
+      page->top = end;
+      free_run(page, top, end);
+    }
+    page->live = 0;
+    page->young = false;
+    page->next = Pages;
+    Pages = page;
+    OldBytesSinceMajor += PAGE_SIZE;
+    add_recyclable(page);
+  }
+  BumpPage = NULL;
+  BumpTop = NULL;
+  BumpLimit = NULL;
+  NurseryBytes = 0;
+}
+
+// After a minor collection: frees the young blocks that died in the free
+// runs the nursery used, makes the survivors old, and lists again the pages
+// with runs left.
+static void sweep_recycled(void)
+{
+  size_t used = RecycledCount < RecyclableCount ? RecycledCount + 1
+                                                : RecyclableCount;
+  size_t kept = 0;
+  for (size_t i = 0; i < RecyclableCount; ++i) {
+    struct page* page = Recyclable[i];
+    if (i < used) {
+      for (struct block* block = first_block(page); block;
+           block = next_block(page, block))
+      {
+        if (block->layout == FREE || !block->young) {
+          continue;
+        }
+        if (block->marked) {
+          block->marked = 0;
+          block->young = 0;
+          OldBytesSinceMajor += (size_t)block->granules * GRANULE;
+        } else {
+          block->layout = FREE;
+        }
+      }
+      page->live = 0;
+      page->cursor = page->slots;
+      if (!coalesce(page)) {
+        continue;
+      }
+    }
+    Recyclable[kept++] = page;
+  }
+  RecyclableCount = kept;
+  RecycledCount = 0;
+}
+
+// Frees what wasn't marked and rebuilds the free lists. Pages left empty go
+// to the nursery pool, or back to the system once the free space kept covers
+// the next cycle.
+static void sweep(void)
+{
+  memset(FreeLists, 0, sizeof FreeLists);
+  FreeBytes = 0;
+  RecyclableCount = 0;
+  RecycledCount = 0;
+  struct page** link = &Pages;
+  while (*link) {
+    struct page* page = *link;
+    size_t used = page->live;
+    page->live = 0;
+    for (struct block* block = first_block(page); block;
+         block = next_block(page, block))
+    {
+      if (block->marked) {
+        block->marked = 0;
+        block->young = 0;
+      } else {
+        block->layout = FREE;
+      }
+    }
+    if (used == 0) {
+      *link = page->next;
+      release_page(page);
+      continue;
+    }
+    if (page->kind == PAGE_SMALL) {
+      for (size_t i = page->slot_count; i-- > 0;) {
+        struct block* block =
+            (struct block*)(page->slots + i * page->slot_size);
+        if (block->layout == FREE) {
+          *(struct block**)(block + 1) = FreeLists[page->size_class];
+          FreeLists[page->size_class] = block;
+          FreeBytes += page->slot_size;
+        }
+      }
+    } else if (page->kind == PAGE_BUMP) {
+      add_recyclable(page);
+    }
+    link = &page->next;
+  }
+  page_table_rebuild();
+}
+
+// makes [start, end) of a bump page one free block
+static void free_run(struct page* page, char* start, char* end)
+{
+  struct block* block = (struct block*)start;
+  size_t granule = (size_t)(start - page->slots) / GRANULE;
+  page->starts[granule / 64] |= (uint64_t)1 << (granule % 64);
+  block->layout = FREE;
+  block->granules = (uint16_t)((size_t)(end - start) / GRANULE);
+  block->marked = 0;
+  block->young = 0;
+}
+
+// Merges neighbouring free blocks of an old bump page; returns whether a
+// run long enough for the nursery is left.
+static bool coalesce(struct page* page)
+{
+  bool found = false;
+  struct block* run = NULL;
+  for (struct block* block = first_block(page); block;
+       block = next_block(page, block))
+  {
+    if (block->layout != FREE) {
+      run = NULL;
+      continue;
+    }
+    if (run) {
+      size_t granule = (size_t)((char*)block - page->slots) / GRANULE;
+      page->starts[granule / 64] &= ~((uint64_t)1 << (granule % 64));
+      run->granules = (uint16_t)(run->granules + block->granules);
+      block = run;
+    } else {
+      run = block;
+    }
+    if ((size_t)run->granules * GRANULE >= MIN_RUN) {
+      found = true;
+    }
+  }
+  return found;
+}
+
+// lists an old bump page for the nursery if it has a long enough free run
+static void add_recyclable(struct page* page)
+{
+  page->cursor = page->slots;
+  if (!coalesce(page)) {
+    return;
+  }
+  if (RecyclableCount == RecyclableCapacity) {
+    size_t capacity = RecyclableCapacity ? RecyclableCapacity * 2 : 64;
+    struct page** pages =
+        realloc(Recyclable, capacity * sizeof(struct page*));
+    if (!pages) {
+      fail("recyclable pages");
+    }
+    Recyclable = pages;
+    RecyclableCapacity = capacity;
+  }
+  Recyclable[RecyclableCount++] = page;
+}
+
+static void release_page(struct page* page)
+{
+  if (page->page_count == 1 && NurseryPoolLength < NURSERY_PAGES) {
+    pool_page(page);
+    return;
+  }
+  HeapSize -= page->page_count * PAGE_SIZE;
+  free(page);
+}
+
+// empties a page for the nursery; find_block sees no blocks in it
+static void pool_page(struct page* page)
+{
+  page->kind = PAGE_BUMP;
+  page->young = false;
+  page->top = page->slots;
+  page->live = 0;
+  memset(page->starts, 0, sizeof page->starts);
+  page->next = NurseryPool;
+  NurseryPool = page;
+  ++NurseryPoolLength;
+}
+
+static void protect_old_pages(void)
+{
+  for (struct page* page = Pages; page; page = page->next) {
+    if (!page->write_protected) {
+      page->write_protected = true;
+      mprotect(page, page->page_count * PAGE_SIZE, PROT_READ);
+    }
+  }
+}
+
+static void unprotect_old_pages(void)
+{
+  for (struct page* page = Pages; page; page = page->next) {
+    unprotect_page(page);
+  }
+}
+
+// makes the memory writable by system calls until the next collection
+static void unprotect_range(void* pointer, size_t size)
+{
+  uintptr_t address = (uintptr_t)pointer;
+  uintptr_t end = address + size;
+  while (address < end) {
+    struct page* page = page_at(address);
+    if (!page) {
+      address = ROUND_UP(address + 1, PAGE_SIZE);
+      continue;
+    }
+    unprotect_page(page);
+    address = (uintptr_t)page + page->page_count * PAGE_SIZE;
+  }
+}
+
+static void unprotect_page(struct page* page)
+{
+  if (page->write_protected) {
+    mprotect(page, page->page_count * PAGE_SIZE, PROT_READ | PROT_WRITE);
+    page->write_protected = false;
+  }
+}
+
+// the page (or run of pages) holding address, or NULL
+static struct page* page_at(uintptr_t address)
+{
+  if (address < HeapLow || address >= HeapHigh) {
+    return NULL;
+  }
+  return PageTableValues[page_table_slot(address >> PAGE_SHIFT)];
+}
+
+// The write barrier: a write to a protected old page unprotects it, which
+// puts it in the remembered set until the next collection. Other faults are
+// retried under the previous handler.
+static void on_fault(int signal_number, siginfo_t* info, void* context)
+{
+  (void)context;
+  struct page* page = page_at((uintptr_t)info->si_addr);
+  if (page && page->write_protected) {
+    unprotect_page(page);
+    return;
+  }
+  sigaction(signal_number,
+            signal_number == SIGSEGV ? &PreviousSegv : &PreviousBus,
+            NULL);
+}
+
+static struct block* find_block(uintptr_t address, struct page** found)
+{
+  if (address < HeapLow || address >= HeapHigh) {
+    return NULL;
+  }
+  struct page* page = PageTableValues[page_table_slot(address >> PAGE_SHIFT)];
+  if (!page || address < (uintptr_t)page->slots) {
+    return NULL;
+  }
+  struct block* block;
+  if (page->kind == PAGE_BUMP) {
+    if (address >= (uintptr_t)page->top) {
+      return NULL;
+    }
+    // the nearest block start at or before the address
+    size_t granule = (address - (uintptr_t)page->slots) / GRANULE;
+    size_t word = granule / 64;
+    uint64_t bits = page->starts[word] & (~(uint64_t)0 >> (63 - granule % 64));
+    while (!bits) {
+      if (word == 0) {
+        return NULL;
+      }
+      bits = page->starts[--word];
+    }
+    size_t start = word * 64 + 63 - (size_t)__builtin_clzll(bits);
+    block = (struct block*)(page->slots + start * GRANULE);
+    if (address >= (uintptr_t)block + (size_t)block->granules * GRANULE) {
+      return NULL;
+    }
+  } else {
+    size_t index = (address - (uintptr_t)page->slots) / page->slot_size;
+    if (index >= page->slot_count) {
+      return NULL;
+    }
+    block = (struct block*)(page->slots + index * page->slot_size);
+  }
+  if (block->layout == FREE || address < (uintptr_t)(block + 1)) {
+    return NULL;
+  }
+  if (found) {
+    *found = page;
+  }
+  return block;
+}
+
+// walks every block of a page, free ones included
+static struct block* first_block(struct page* page)
+{
+  if (page->kind == PAGE_BUMP && page->top == page->slots) {
+    return NULL;
+  }
+  return (struct block*)page->slots;
+}
+
+static struct block* next_block(struct page* page, struct block* block)
+{
+  char* next;
+  char* end;
+  if (page->kind == PAGE_BUMP) {
+    next = (char*)block + (size_t)block->granules * GRANULE;
+    end = page->top;
+  } else {
+    next = (char*)block + page->slot_size;
+    end = page->slots + page->slot_count * page->slot_size;
+  }
+  return next < end ? (struct block*)next : NULL;
+}
+
+static void page_table_insert(struct page* page)
+{
+  if ((PageTableCount + page->page_count) * 2 > PageTableCapacity) {
+    size_t capacity = PageTableCapacity ? PageTableCapacity : 256;
+    while ((PageTableCount + page->page_count) * 2 > capacity) {
+      capacity *= 2;
+    }
+    free(PageTableKeys);
+    free(PageTableValues);
+    PageTableKeys = calloc(capacity, sizeof(uintptr_t));
+    PageTableValues = calloc(capacity, sizeof(struct page*));
+    if (!PageTableKeys || !PageTableValues) {
+      fail("page table");
+    }
+    PageTableCapacity = capacity;
+    page_table_rebuild();
+  }
+  uintptr_t first = (uintptr_t)page >> PAGE_SHIFT;
+  for (size_t i = 0; i < page->page_count; ++i) {
+    size_t slot = page_table_slot(first + i);
+    PageTableKeys[slot] = first + i;
+    PageTableValues[slot] = page;
+  }
+  PageTableCount += page->page_count;
+  if ((uintptr_t)page < HeapLow) {
+    HeapLow = (uintptr_t)page;
+  }
+  if ((uintptr_t)page + page->page_count * PAGE_SIZE > HeapHigh) {
+    HeapHigh = (uintptr_t)page + page->page_count * PAGE_SIZE;
+  }
+}
+
+static void page_table_rebuild(void)
+{
+  memset(PageTableKeys, 0, PageTableCapacity * sizeof(uintptr_t));
+  memset(PageTableValues, 0, PageTableCapacity * sizeof(struct page*));
+  PageTableCount = 0;
+  HeapLow = UINTPTR_MAX;
+  HeapHigh = 0;
+  struct page* lists[] = {Pages, Nursery, NurseryPool};
+  for (size_t i = 0; i < sizeof lists / sizeof lists[0]; ++i) {
+    for (struct page* page = lists[i]; page; page = page->next) {
+      page_table_insert(page);
+    }
+  }
+}
+
+// the entry for `key`, or the empty one where it would go
+static size_t page_table_slot(uintptr_t key)
+{
+  size_t mask = PageTableCapacity - 1;
+  size_t slot = (size_t)(key * 0x9E3779B97F4A7C15ULL) & mask;
+  while (PageTableKeys[slot] != 0 && PageTableKeys[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static _Noreturn void fail(const char* what)
+{
+  fprintf(stderr, "precise collector: out of memory for the %s\n", what);
+  abort();
+}
@@ -1,7 +1,9 @@
 #include <ctype.h>
-#include <gc.h>
 #include <lib.h>
+#include <private/alloc.h>
 #include <private/scanner.h>
+#include <private/symbol.h>
+#include <private/threads.h>
 #include <private/token.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -21,19 +23,27 @@ static char scanner_peek(struct scanner* self);
 static char scanner_peek_next(struct scanner* self);
 static void scanner_string(struct scanner* self);
 static void scanner_number(struct scanner* self);
+static struct object* scanner_find_constant(struct scanner* self);
+static void scanner_add_constant(struct scanner* self,
+                                 enum token_type type,
+                                 struct object* value);
 static bool is_alpha(char c);
 static bool is_alphanumeric(char c);
 static void scanner_identifier(struct scanner* self);
 static void init_keywords(void);
 
 static struct hash_table* Keywords = NULL;
+THREADS_ONCE(KeywordsReady);
 
 struct scanner* scanner_new(const char* source_begin, const char* source_end)
 {
-  struct scanner* scanner = GC_MALLOC(sizeof(struct scanner));
+  struct scanner* scanner = alloc_untyped(sizeof(struct scanner));
   scanner->source_begin = source_begin;
   scanner->source_end = source_end;
   scanner->tokens = token_list_new();
+  scanner->constants = hash_table_new(hash_fnv1a);
+  // keyed by the tokens' lexemes
+  scanner->constants->borrow_keys = true;
   scanner->start = 0;
   scanner->current = 0;
   scanner->line = 1;
@@ -160,7 +170,7 @@ static void scanner_add_token(struct scanner* self,
                               enum token_type type,
                               struct object* value)
 {
-  char* text = GC_MALLOC(self->current - self->start + 1);
+  char* text = alloc_string(self->current - self->start);
   strncpy(text, self->source_begin + self->start, self->current - self->start);
   LIST_PUSH(self->tokens,
             ((struct token) {
@@ -168,6 +178,8 @@ static void scanner_add_token(struct scanner* self,
                 .lexeme = text,
                 .literal = value,
                 .line = self->line,
+                .symbol = type == TOKEN_IDENTIFIER ? symbol_intern(text)
+                                                   : SYMBOL_NONE,
             }));
 }
 
@@ -215,11 +227,16 @@ static void scanner_string(struct scanner* self)
 
   scanner_advance(self);
 
-  char* value = GC_MALLOC(self->current - self->start - 1);
+  struct object* constant = scanner_find_constant(self);
+  if (constant) {
+    scanner_add_token(self, TOKEN_STRING, constant);
+    return;
+  }
+  char* value = alloc_string(self->current - self->start - 2);
   strncpy(value,
           self->source_begin + self->start + 1,
           self->current - self->start - 2);
-  scanner_add_token(self, TOKEN_STRING, object_new_string(value));
+  scanner_add_constant(self, TOKEN_STRING, object_new_string(value));
 }
 
 static void scanner_number(struct scanner* self)
@@ -236,10 +253,34 @@ static void scanner_number(struct scanner* self)
     }
   }
 
-  char* value = GC_MALLOC(self->current - self->start + 1);
+  struct object* constant = scanner_find_constant(self);
+  if (constant) {
+    scanner_add_token(self, TOKEN_NUMBER, constant);
+    return;
+  }
+  char* value = alloc_string(self->current - self->start);
   strncpy(value, self->source_begin + self->start, self->current - self->start);
   double dval = strtod(value, NULL);
-  scanner_add_token(self, TOKEN_NUMBER, object_new_number(dval));
+  scanner_add_constant(self, TOKEN_NUMBER, object_new_number(dval));
+}
+
+// the object of an earlier literal spelled like the current one, or NULL
+static struct object* scanner_find_constant(struct scanner* self)
+{
+  void** found = hash_table_try_get(self->constants,
+                                    self->source_begin + self->start,
+                                    self->current - self->start);
+  return found ? *found : NULL;
+}
+
+static void scanner_add_constant(struct scanner* self,
+                                 enum token_type type,
+                                 struct object* value)
+{
+  scanner_add_token(self, type, value);
+  hash_table_insert(self->constants,
+                    self->tokens->pointer[self->tokens->length - 1].lexeme,
+                    value);
 }
 
 static bool is_alpha(char c)
@@ -258,9 +299,7 @@ static void scanner_identifier(struct scanner* self)
     scanner_advance(self);
   }
 
-  if (Keywords == NULL) {
-    init_keywords();
-  }
+  THREADS_CALL_ONCE(KeywordsReady, init_keywords);
 
   enum token_type type = TOKEN_IDENTIFIER;
   void** iptr = hash_table_try_get(
@@ -273,13 +312,14 @@ static void scanner_identifier(struct scanner* self)
 
 static enum token_type* newtt(enum token_type type)
 {
-  enum token_type* result = GC_MALLOC(sizeof(enum token_type));
+  enum token_type* result = alloc_atomic(sizeof(enum token_type));
   *result = type;
   return result;
 }
 
 static void init_keywords(void)
 {
+  alloc_add_root(&Keywords, sizeof Keywords);
   Keywords = hash_table_new(hash_fnv1a);
   hash_table_insert(Keywords, "and", newtt(TOKEN_AND));
   hash_table_insert(Keywords, "class", newtt(TOKEN_CLASS));
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <private/hash/table.h>
 #include <private/token.h>
 
 struct scanner {
@@ -9,6 +10,9 @@ struct scanner {
   size_t current;
   size_t line;
   struct token_list* tokens;
+  // the object of each string and number literal seen so far, by lexeme, so
+  // that repeated literals share one
+  struct hash_table* constants;
 };
 
 struct scanner* scanner_new(const char* source_begin, const char* source_end);
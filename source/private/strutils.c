@@ -1,4 +1,5 @@
-#include <gc.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/strutils.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -10,10 +11,37 @@ char* alloc_printf(const char* format, ...)
   size_t len = vsnprintf(NULL, 0, format, args);
   va_end(args);
 
-  char* str = GC_MALLOC(len + 1);
+  char* str = alloc_string(len);
+  alloc_profiler_record(len + 1);
 
   va_start(args, format);
   vsprintf(str, format, args);
   va_end(args);
   return str;
 }
+
+void fprint_json_string(FILE* fp, const char* str)
+{
+  fputc('"', fp);
+  for (const char* p = str; *p; ++p) {
+    switch (*p) {
+      case '"':
+        fputs("\\\"", fp);
+        break;
+      case '\\':
+        fputs("\\\\", fp);
+        break;
+      case '\n':
+        fputs("\\n", fp);
+        break;
+      default:
+        if ((unsigned char)*p < 0x20) {
+          fprintf(fp, "\\u%04x", (unsigned char)*p);
+        } else {
+          fputc(*p, fp);
+        }
+        break;
+    }
+  }
+  fputc('"', fp);
+}
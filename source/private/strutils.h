@@ -1,4 +1,9 @@
 #pragma once
 
+#include <stdio.h>
+
 char* alloc_printf(const char* format, ...)
     __attribute__((format(printf, 1, 2)));
+
+// writes str as a quoted JSON string
+void fprint_json_string(FILE* fp, const char* str);
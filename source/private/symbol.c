@@ -0,0 +1,57 @@
+#include <private/alloc.h>
+#include <private/hash/fnv.h>
+#include <private/hash/table.h>
+#include <private/list.h>
+#include <private/symbol.h>
+#include <private/threads.h>
+#include <stdint.h>
+#include <string.h>
+
+static struct hash_table* Symbols = NULL;
+static LIST(const char*) Names;
+THREADS_MUTEX(SymbolsLock);
+
+size_t symbol_intern(const char* name)
+{
+  THREADS_LOCK(SymbolsLock);
+  if (Symbols == NULL) {
+    alloc_add_root(&Symbols, sizeof Symbols);
+    alloc_add_root(&Names, sizeof Names);
+    Symbols = hash_table_new(hash_fnv1a);
+    LIST_INIT(&Names);
+    // reserve SYMBOL_NONE
+    LIST_PUSH(&Names, "");
+  }
+  void** found = hash_table_try_get(Symbols, name, strlen(name));
+  size_t symbol;
+  if (found) {
+    symbol = (size_t)(uintptr_t)*found;
+  } else {
+    symbol = (size_t)Names.length;
+    hash_table_insert(Symbols, name, (void*)(uintptr_t)symbol);
+    LIST_PUSH(&Names, alloc_strdup(name));
+  }
+  THREADS_UNLOCK(SymbolsLock);
+  return symbol;
+}
+
+const char* symbol_name(size_t symbol)
+{
+  if (symbol == SYMBOL_NONE) {
+    return NULL;
+  }
+  THREADS_LOCK(SymbolsLock);
+  // Names may be reallocated by an intern on another thread
+  const char* name =
+      symbol < (size_t)Names.length ? Names.pointer[symbol] : NULL;
+  THREADS_UNLOCK(SymbolsLock);
+  return name;
+}
+
+size_t symbol_count(void)
+{
+  THREADS_LOCK(SymbolsLock);
+  size_t count = Symbols == NULL ? 1 : (size_t)Names.length;
+  THREADS_UNLOCK(SymbolsLock);
+  return count;
+}
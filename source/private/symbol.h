@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+// Interned identifier names. Every distinct name gets a small dense ID the
+// first time it is seen; IDs index the global variable table.
+
+#define SYMBOL_NONE 0
+
+size_t symbol_intern(const char* name);
+const char* symbol_name(size_t symbol);
+// one past the largest symbol handed out so far
+size_t symbol_count(void);
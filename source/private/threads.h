@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+
+// State shared by every interpreter in the process (interned symbols, type
+// descriptors, statistics, the trace file, JIT code) is guarded with these.
+// Builds with INTERPRETER_THREADS (the gc-c-jlox_THREADS CMake option) use
+// pthreads; other builds compile them away.
+//
+// Interpreters themselves are not shared: each thread creates its own with
+// interpreter_new and runs a program it parsed itself, since evaluation
+// rewrites the AST's caches as it goes. State that belongs to one run, like
+// lib.c's error flags, is THREADS_LOCAL instead.
+
+#ifdef INTERPRETER_THREADS
+#  include <pthread.h>
+
+#  define THREADS_MUTEX(name) \
+    static pthread_mutex_t name = PTHREAD_MUTEX_INITIALIZER
+#  define THREADS_LOCK(name) pthread_mutex_lock(&(name))
+#  define THREADS_UNLOCK(name) pthread_mutex_unlock(&(name))
+
+#  define THREADS_ONCE(name) static pthread_once_t name = PTHREAD_ONCE_INIT
+#  define THREADS_CALL_ONCE(name, function) pthread_once(&(name), (function))
+
+// a thread that owns some state, e.g. the one being profiled
+#  define THREADS_OWNER(name) static pthread_t name
+#  define THREADS_CLAIM(name) ((name) = pthread_self())
+#  define THREADS_OWNS(name) pthread_equal((name), pthread_self())
+
+#  define THREADS_ADD(lvalue, n) \
+    __atomic_fetch_add(&(lvalue), (n), __ATOMIC_RELAXED)
+
+#  define THREADS_LOCAL _Thread_local
+#else
+#  define THREADS_MUTEX(name) struct name##_unused
+#  define THREADS_LOCK(name) ((void)0)
+#  define THREADS_UNLOCK(name) ((void)0)
+
+#  define THREADS_ONCE(name) static bool name = false
+#  define THREADS_CALL_ONCE(name, function) \
+    do { \
+      if (!(name)) { \
+        (name) = true; \
+        (function)(); \
+      } \
+    } while (false)
+
+#  define THREADS_OWNER(name) struct name##_unused
+#  define THREADS_CLAIM(name) ((void)0)
+#  define THREADS_OWNS(name) true
+
+#  define THREADS_ADD(lvalue, n) ((lvalue) += (n))
+
+#  define THREADS_LOCAL
+#endif
@@ -0,0 +1,10 @@
+#include <private/timing.h>
+#include <time.h>
+
+unsigned long long timing_now_ns(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL
+      + (unsigned long long)ts.tv_nsec;
+}
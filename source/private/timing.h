@@ -0,0 +1,5 @@
+#pragma once
+
+// nanoseconds since an arbitrary epoch, shared by all runtime telemetry so
+// that timestamps from different modules are comparable
+unsigned long long timing_now_ns(void);
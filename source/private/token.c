@@ -1,4 +1,4 @@
-#include <gc.h>
+#include <private/alloc.h>
 #include <private/token.h>
 
 #define TOKEN_LIST_INITIAL_CAPACITY 8
@@ -23,7 +23,13 @@ size_t token_snprint(char* s, size_t n, const struct token* tok)
 
 struct token_list* token_list_new(void)
 {
-  struct token_list* result = GC_MALLOC(sizeof(struct token_list));
+  struct token_list* result = alloc_untyped(sizeof(struct token_list));
   LIST_INIT(result);
   return result;
 }
+
+void token_layout(struct alloc_layout* layout, size_t offset)
+{
+  alloc_layout_pointer(layout, offset + offsetof(struct token, lexeme));
+  alloc_layout_pointer(layout, offset + offsetof(struct token, literal));
+}
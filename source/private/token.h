@@ -1,5 +1,6 @@
 #pragma once
 
+#include <private/alloc.h>
 #include <private/list.h>
 #include <private/object.h>
 #include <private/token_type.h>
@@ -9,6 +10,8 @@ struct token {
   char* lexeme;
   struct object* literal;
   size_t line;
+  // interned name of identifier tokens, SYMBOL_NONE otherwise
+  size_t symbol;
 };
 
 DECLARE_NAMED_LIST(token_list, struct token);
@@ -18,3 +21,5 @@ size_t token_fprint(FILE* f, const struct token* tok);
 size_t token_snprint(char* s, size_t n, const struct token* tok);
 
 struct token_list* token_list_new(void);
+// adds the pointers of a token embedded at `offset` to a layout
+void token_layout(struct alloc_layout* layout, size_t offset);
@@ -0,0 +1,80 @@
+#include <private/gc_stats.h>
+#include <private/strutils.h>
+#include <private/threads.h>
+#include <private/timing.h>
+#include <private/trace.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static FILE* TraceFile = NULL;
+static unsigned long long TraceStartNs = 0;
+static unsigned long long CallThresholdNs = 0;
+static bool FirstEvent = true;
+THREADS_MUTEX(TraceLock);
+
+static void trace_gc_pause(unsigned long long start_ns,
+                           unsigned long long end_ns);
+
+bool trace_open(const char* path, unsigned long long call_threshold_ns)
+{
+  TraceFile = fopen(path, "we");
+  if (!TraceFile) {
+    return false;
+  }
+  TraceStartNs = timing_now_ns();
+  CallThresholdNs = call_threshold_ns;
+  FirstEvent = true;
+  fprintf(TraceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  gc_stats_set_pause_hook(trace_gc_pause);
+  gc_stats_enable();
+  return true;
+}
+
+void trace_close(void)
+{
+  if (!TraceFile) {
+    return;
+  }
+  gc_stats_set_pause_hook(NULL);
+  fprintf(TraceFile, "\n]}\n");
+  fclose(TraceFile);
+  TraceFile = NULL;
+}
+
+bool trace_enabled(void)
+{
+  return TraceFile != NULL;
+}
+
+unsigned long long trace_call_threshold_ns(void)
+{
+  return CallThresholdNs;
+}
+
+void trace_span(const char* name,
+                const char* category,
+                unsigned long long start_ns,
+                unsigned long long end_ns)
+{
+  if (!TraceFile) {
+    return;
+  }
+  THREADS_LOCK(TraceLock);
+  fprintf(TraceFile, FirstEvent ? "\n{\"name\":" : ",\n{\"name\":");
+  FirstEvent = false;
+  fprint_json_string(TraceFile, name);
+  fprintf(TraceFile, ",\"cat\":");
+  fprint_json_string(TraceFile, category);
+  // trace-event timestamps are microseconds
+  fprintf(TraceFile,
+          ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+          (double)(start_ns - TraceStartNs) / 1e3,
+          (double)(end_ns - start_ns) / 1e3);
+  THREADS_UNLOCK(TraceLock);
+}
+
+static void trace_gc_pause(unsigned long long start_ns,
+                           unsigned long long end_ns)
+{
+  trace_span("GC", "gc", start_ns, end_ns);
+}
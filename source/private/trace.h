@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Writes Chrome/Perfetto trace-event JSON ("X" complete events). Spans are
+// timed with timing_now_ns() and written when they end.
+
+bool trace_open(const char* path, unsigned long long call_threshold_ns);
+void trace_close(void);
+bool trace_enabled(void);
+unsigned long long trace_call_threshold_ns(void);
+void trace_span(const char* name,
+                const char* category,
+                unsigned long long start_ns,
+                unsigned long long end_ns);
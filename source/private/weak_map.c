@@ -0,0 +1,161 @@
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
+#include <private/threads.h>
+#include <private/weak_map.h>
+#include <stdint.h>
+
+#define INITIAL_CAPACITY 8
+
+// where maps and entries keep their (strong) pointers
+static alloc_descriptor MapDescriptor;
+static alloc_descriptor EntryDescriptor;
+THREADS_ONCE(Described);
+
+static void describe_weak_map(void);
+static struct weak_map_entry** bucket_for(struct weak_map* map,
+                                          struct object* key);
+static struct weak_map_entry** find(struct weak_map* map, struct object* key);
+static void purge(struct weak_map* map);
+static void resize(struct weak_map* map, size_t capacity);
+
+struct weak_map* weak_map_new(void)
+{
+  THREADS_CALL_ONCE(Described, describe_weak_map);
+  struct weak_map* map = alloc_typed(sizeof(struct weak_map), MapDescriptor);
+  alloc_profiler_record(sizeof(struct weak_map));
+  map->buckets = NULL;
+  map->capacity = 0;
+  map->length = 0;
+  return map;
+}
+
+struct object* weak_map_get(struct weak_map* map, struct object* key)
+{
+  struct weak_map_entry** at = find(map, key);
+  return at ? (*at)->value : NULL;
+}
+
+bool weak_map_set(struct weak_map* map,
+                  struct object* key,
+                  struct object* value)
+{
+  struct weak_map_entry** at = find(map, key);
+  if (at) {
+    (*at)->value = value;
+    return true;
+  }
+  if (map->length + 1 > map->capacity / 4 * 3) {
+    // dropping the cleared entries may be enough to make room
+    purge(map);
+    if (map->length + 1 > map->capacity / 2) {
+      resize(map, map->capacity ? map->capacity * 2 : INITIAL_CAPACITY);
+    }
+  }
+  struct weak_map_entry* entry =
+      alloc_typed(sizeof(struct weak_map_entry), EntryDescriptor);
+  alloc_profiler_record(sizeof(struct weak_map_entry));
+  entry->key = key;
+  if (!alloc_register_weak_link((void**)&entry->key, key)) {
+    return false;
+  }
+  entry->value = value;
+  struct weak_map_entry** bucket = bucket_for(map, key);
+  entry->next = *bucket;
+  *bucket = entry;
+  ++map->length;
+  return true;
+}
+
+bool weak_map_delete(struct weak_map* map, struct object* key)
+{
+  struct weak_map_entry** at = find(map, key);
+  if (!at) {
+    return false;
+  }
+  struct weak_map_entry* entry = *at;
+  *at = entry->next;
+  alloc_clear_weak_link((void**)&entry->key);
+  --map->length;
+  return true;
+}
+
+size_t weak_map_size(struct weak_map* map)
+{
+  purge(map);
+  return map->length;
+}
+
+static void describe_weak_map(void)
+{
+  struct alloc_layout layout;
+
+  alloc_layout_init(&layout, sizeof(struct weak_map));
+  ALLOC_LAYOUT_POINTER(&layout, struct weak_map, buckets);
+  MapDescriptor = alloc_layout_descriptor(&layout);
+
+  alloc_layout_init(&layout, sizeof(struct weak_map_entry));
+  ALLOC_LAYOUT_POINTER(&layout, struct weak_map_entry, value);
+  ALLOC_LAYOUT_POINTER(&layout, struct weak_map_entry, next);
+  EntryDescriptor = alloc_layout_descriptor(&layout);
+}
+
+// Neither collector moves objects, so a key's address is a stable hash.
+static struct weak_map_entry** bucket_for(struct weak_map* map,
+                                          struct object* key)
+{
+  uint64_t hash = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+  return &map->buckets[(hash >> 32) & (map->capacity - 1)];
+}
+
+// the link to the key's entry, unlinking cleared entries on the way
+static struct weak_map_entry** find(struct weak_map* map, struct object* key)
+{
+  if (map->capacity == 0) {
+    return NULL;
+  }
+  struct weak_map_entry** at = bucket_for(map, key);
+  while (*at) {
+    if (!(*at)->key) {
+      *at = (*at)->next;
+      --map->length;
+    } else if ((*at)->key == key) {
+      return at;
+    } else {
+      at = &(*at)->next;
+    }
+  }
+  return NULL;
+}
+
+static void purge(struct weak_map* map)
+{
+  for (size_t i = 0; i < map->capacity; ++i) {
+    struct weak_map_entry** at = &map->buckets[i];
+    while (*at) {
+      if ((*at)->key) {
+        at = &(*at)->next;
+      } else {
+        *at = (*at)->next;
+        --map->length;
+      }
+    }
+  }
+}
+
+static void resize(struct weak_map* map, size_t capacity)
+{
+  struct weak_map_entry** old = map->buckets;
+  size_t old_capacity = map->capacity;
+  map->buckets = alloc_untyped(capacity * sizeof(struct weak_map_entry*));
+  alloc_profiler_record(capacity * sizeof(struct weak_map_entry*));
+  map->capacity = capacity;
+  for (size_t i = 0; i < old_capacity; ++i) {
+    while (old[i]) {
+      struct weak_map_entry* entry = old[i];
+      old[i] = entry->next;
+      struct weak_map_entry** bucket = bucket_for(map, entry->key);
+      entry->next = *bucket;
+      *bucket = entry;
+    }
+  }
+}
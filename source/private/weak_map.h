@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct object;
+
+// A hash table that holds its keys weakly: once nothing else reaches a key,
+// the collector clears the entry's link to it (see alloc_register_weak_link)
+// and the entry is dropped the next time the table runs into it. Keys are
+// compared by identity. Values are held strongly, so a value that refers to
+// its own key keeps the entry alive.
+//
+// Lox sees these as WeakMap objects (see natives.c).
+struct weak_map_entry {
+  // weak: left out of the entry's layout
+  struct object* key;
+  struct object* value;
+  struct weak_map_entry* next;
+};
+
+struct weak_map {
+  // chains of entries, by the key's address
+  struct weak_map_entry** buckets;
+  size_t capacity;
+  // entries in the chains, including ones whose key was cleared
+  size_t length;
+};
+
+struct weak_map* weak_map_new(void);
+// the value stored under the key, or NULL
+struct object* weak_map_get(struct weak_map* map, struct object* key);
+// returns false if the key couldn't be registered with the collector
+bool weak_map_set(struct weak_map* map,
+                  struct object* key,
+                  struct object* value);
+// returns whether the key was there
+bool weak_map_delete(struct weak_map* map, struct object* key);
+// the number of keys still alive
+size_t weak_map_size(struct weak_map* map);
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs mark_scaling.lox with 1 to N parallel markers and prints the wall time
+# and collector pause statistics for each. Use a threaded build, e.g.
+#
+#   cmake --preset=ci-threads && cmake --build build/threads
+#   test/bench/mark_scaling.sh build/threads/gc-c-jlox
+#
+# N defaults to the number of online CPUs.
+
+set -eu
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 path/to/gc-c-jlox [max-markers]" >&2
+  exit 64
+fi
+
+interpreter=$1
+max_markers=${2:-$(getconf _NPROCESSORS_ONLN)}
+script=$(dirname "$0")/mark_scaling.lox
+
+printf '%8s %10s  %s\n' markers wall-ms pauses
+markers=1
+while [ "$markers" -le "$max_markers" ]; do
+  start=$(date +%s%N)
+  pauses=$(GC_MARKERS=$markers "$interpreter" --gc-stats "$script" 2>&1 \
+    >/dev/null | grep '^pause time:' | sed 's/^pause time: //')
+  end=$(date +%s%N)
+  printf '%8d %10d  %s\n' "$markers" $(((end - start) / 1000000)) "$pauses"
+  markers=$((markers + 1))
+done
@@ -0,0 +1,49 @@
+cmake_minimum_required(VERSION 3.14)
+
+# Runs a script with the INTERPRETER under --profile=alloc, writing the
+# collapsed stacks into WORK_DIR, and fails unless both the report and the
+# stacks charge each function's allocations to it, small ones included.
+
+foreach(var IN ITEMS INTERPRETER WORK_DIR)
+  if(NOT DEFINED "${var}")
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+set(script "${WORK_DIR}/alloc_profile.lox")
+set(stacks "${WORK_DIR}/alloc_profile.collapsed")
+file(REMOVE "${stacks}")
+# label is small enough to be inlined, which would hide it
+file(WRITE "${script}" [[
+fun label(n) { return "item " + "n"; }
+fun build(count) {
+  var i = 0;
+  var last = nil;
+  while (i < count) {
+    last = label(i);
+    i = i + 1;
+  }
+  return last;
+}
+print build(100);
+]])
+execute_process(
+    COMMAND "${INTERPRETER}" --profile=alloc "--profile-out=${stacks}"
+    "${script}"
+    RESULT_VARIABLE result
+    ERROR_VARIABLE report
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "the script failed (${result}):\n${report}")
+endif()
+
+# a string and its text per call
+if(NOT report MATCHES "\n +[0-9]+ +200 +1  label\n")
+  message(FATAL_ERROR "no row for label's 200 allocations:\n${report}")
+endif()
+file(READ "${stacks}" collapsed)
+foreach(stack IN ITEMS "<script>:11;build:6" "<script>:11;build:6;label:1")
+  if(NOT collapsed MATCHES "(^|\n)${stack} [0-9]+\n")
+    message(FATAL_ERROR "no stack ${stack}:\n${collapsed}")
+  endif()
+endforeach()
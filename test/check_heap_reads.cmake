@@ -0,0 +1,31 @@
+cmake_minimum_required(VERSION 3.14)
+
+# Fails if a source file outside the collectors reads into memory with a
+# system call other than through alloc_fread, which a write-protected heap
+# page would make fail with EFAULT (see alloc.h). Reads into memory the
+# collector doesn't own are marked "outside the heap" on their line.
+
+if(NOT DEFINED SOURCE_DIR)
+  message(FATAL_ERROR "SOURCE_DIR is not set")
+endif()
+
+file(GLOB_RECURSE sources "${SOURCE_DIR}/*.c")
+set(call "(^|[^A-Za-z0-9_.>])(fread|read|pread|readv|recv|recvfrom|recvmsg")
+string(APPEND call "|fgets|getline|getdelim|fscanf|scanf)[ ]*\\(")
+set(offending "")
+foreach(source IN LISTS sources)
+  get_filename_component(name "${source}" NAME)
+  if(name STREQUAL "alloc.c" OR name STREQUAL "precise.c")
+    continue()
+  endif()
+  file(STRINGS "${source}" lines REGEX "${call}")
+  foreach(line IN LISTS lines)
+    if(NOT line MATCHES "outside the heap")
+      string(APPEND offending "\n${source}: ${line}")
+    endif()
+  endforeach()
+endforeach()
+
+if(NOT offending STREQUAL "")
+  message(FATAL_ERROR "read into memory without alloc_fread:${offending}")
+endif()
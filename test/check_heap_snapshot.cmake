@@ -0,0 +1,123 @@
+cmake_minimum_required(VERSION 3.19)
+
+# Runs a script with the INTERPRETER that builds a small graph and writes it
+# with heapSnapshot() into WORK_DIR, then fails unless the snapshot parses
+# and names the nodes and edges heap_snapshot.h promises.
+
+foreach(var IN ITEMS INTERPRETER WORK_DIR)
+  if(NOT DEFINED "${var}")
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+set(script "${WORK_DIR}/heap_snapshot.lox")
+set(snapshot "${WORK_DIR}/heap_snapshot.heapsnapshot")
+file(REMOVE "${snapshot}")
+file(WRITE "${script}"
+     "var greeting = \"hello\";\n"
+     "fun make(n) { fun get() { return n; } return get; }\n"
+     "var getter = make(42);\n"
+     "var map = WeakMap();\n"
+     "weakMapSet(map, getter, \"value\");\n"
+     "print heapSnapshot(\"${snapshot}\");\n")
+execute_process(
+    COMMAND "${INTERPRETER}" "${script}"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors
+)
+if(NOT result EQUAL 0 OR NOT output MATCHES "\ntrue\n$")
+  message(FATAL_ERROR "heapSnapshot failed (${result}):\n${errors}")
+endif()
+
+file(READ "${snapshot}" json)
+# the flat arrays as lists
+foreach(array IN ITEMS nodes edges)
+  string(JSON text GET "${json}" "${array}")
+  string(REGEX REPLACE "[][ \n]" "" text "${text}")
+  string(REPLACE "," ";" "${array}" "${text}")
+endforeach()
+string(JSON node_count GET "${json}" snapshot node_count)
+list(LENGTH nodes length)
+math(EXPR length "${length} / 6")
+if(NOT length EQUAL node_count)
+  message(FATAL_ERROR "${length} nodes, ${node_count} announced")
+endif()
+
+function(field list index out)
+  list(GET "${list}" "${index}" value)
+  set("${out}" "${value}" PARENT_SCOPE)
+endfunction()
+
+function(string_at index out)
+  string(JSON value GET "${json}" strings "${index}")
+  set("${out}" "${value}" PARENT_SCOPE)
+endfunction()
+
+# fails unless node `index` has the type and name
+function(expect_node index type name)
+  math(EXPR at "${index} * 6")
+  field(nodes "${at}" type_index)
+  math(EXPR at "${at} + 1")
+  field(nodes "${at}" name_index)
+  string(JSON actual_type GET "${json}" snapshot meta node_types 0
+         "${type_index}")
+  string_at("${name_index}" actual_name)
+  if(NOT actual_type STREQUAL type OR NOT actual_name STREQUAL name)
+    message(FATAL_ERROR "node ${index} is ${actual_type} '${actual_name}', "
+                        "expected ${type} '${name}'")
+  endif()
+endfunction()
+
+# the index of the node a `type` edge named `name` leads to from node `from`
+function(follow from type name out)
+  # a node's edges follow the previous node's
+  set(edge 0)
+  foreach(node RANGE "${from}")
+    math(EXPR at "${node} * 6 + 4")
+    field(nodes "${at}" count)
+    if(node EQUAL from)
+      break()
+    endif()
+    math(EXPR edge "${edge} + ${count}")
+  endforeach()
+  math(EXPR end "${edge} + ${count}")
+  while(edge LESS end)
+    math(EXPR at "${edge} * 3")
+    field(edges "${at}" type_index)
+    math(EXPR at "${at} + 1")
+    field(edges "${at}" name_index)
+    math(EXPR at "${at} + 1")
+    field(edges "${at}" to)
+    string(JSON actual_type GET "${json}" snapshot meta edge_types 0
+           "${type_index}")
+    string_at("${name_index}" actual_name)
+    if(actual_type STREQUAL type AND actual_name STREQUAL name)
+      math(EXPR to "${to} / 6")
+      set("${out}" "${to}" PARENT_SCOPE)
+      return()
+    endif()
+    math(EXPR edge "${edge} + 1")
+  endwhile()
+  message(FATAL_ERROR "node ${from} has no ${type} edge '${name}'")
+endfunction()
+
+expect_node(0 synthetic "(root)")
+follow(0 property globals globals)
+expect_node("${globals}" object Globals)
+follow("${globals}" context greeting greeting)
+expect_node("${greeting}" string hello)
+follow("${globals}" context getter getter)
+expect_node("${getter}" closure get)
+follow("${getter}" internal context closure)
+expect_node("${closure}" object Environment)
+follow("${closure}" context n n)
+expect_node("${n}" number 42)
+follow("${globals}" context map map)
+expect_node("${map}" object WeakMap)
+follow("${map}" weak key key)
+if(NOT key EQUAL getter)
+  message(FATAL_ERROR "the weak map's key is node ${key}, not ${getter}")
+endif()
+follow("${map}" internal value value)
+expect_node("${value}" string value)
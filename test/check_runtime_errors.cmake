@@ -0,0 +1,172 @@
+cmake_minimum_required(VERSION 3.14)
+
+# Runs small scripts with the INTERPRETER (written to WORK_DIR) whose fast
+# paths meet values they were not specialized for, and fails unless each
+# prints what the generic interpreter would, runtime errors included.
+
+foreach(var IN ITEMS INTERPRETER WORK_DIR)
+  if(NOT DEFINED "${var}")
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+set(failures "")
+
+# runs `source` as WORK_DIR/name.lox, expecting `output` on stdout and
+# `errors` on stderr
+function(expect_run name source output errors)
+  set(script "${WORK_DIR}/${name}.lox")
+  file(WRITE "${script}" "${source}")
+  execute_process(
+      COMMAND "${INTERPRETER}" "${script}"
+      OUTPUT_VARIABLE actual_output
+      ERROR_VARIABLE actual_errors
+  )
+  # the interpreter dumps the parsed statements first
+  string(REGEX REPLACE "^.*--- END STATEMENTS ---\n" "" actual_output
+                       "${actual_output}")
+  if(NOT actual_output STREQUAL output OR NOT actual_errors STREQUAL errors)
+    string(APPEND failures
+           "\n${name}: printed\n${actual_output}${actual_errors}"
+           "expected\n${output}${errors}")
+    set(failures "${failures}" PARENT_SCOPE)
+  endif()
+endfunction()
+
+# ---- quickening ----
+
+# a + b is quickened for numbers, then sees strings
+expect_run(quickened_add_strings [[
+var a = 1;
+var b = 2;
+var r = nil;
+var i = 0;
+while (i < 20) {
+  if (i == 10) { a = "x"; b = "y"; }
+  r = a + b;
+  i = i + 1;
+}
+print r;
+]] "xy\n" "")
+
+# and a number with a string, which no specialization takes
+expect_run(quickened_add_mixed [[
+var a = 1;
+var i = 0;
+while (i < 12) {
+  if (i == 10) a = "x";
+  print a + 1;
+  i = i + 1;
+}
+]] "2\n2\n2\n2\n2\n2\n2\n2\n2\n2\n" [[
+Operands must be two numbers or two strings.
+[line 5]
+]])
+
+# ---- fused operations ----
+
+# i < 3 as a fused variable-constant condition, quickened for numbers
+expect_run(fused_condition [[
+var i = 0;
+while (i < 3) {
+  i = i + 1;
+  if (i == 2) i = "two";
+}
+]] "" [[
+Operands must be numbers.
+[line 2]
+]])
+
+# s = s - 1 as an in-place increment, on a string
+expect_run(fused_increment_string [[
+var s = "a";
+print s;
+s = s - 1;
+]] "a\n" [[
+Operands must be numbers.
+[line 3]
+]])
+
+expect_run(fused_increment_undefined [[
+var n = 0;
+n = n + 1;
+print n;
+m = m + 1;
+]] "1\n" [[
+Undefined variable 'm'.
+[line 4]
+]])
+
+# missing * 2 as a fused variable-constant operation
+expect_run(fused_variable_constant_undefined [[
+var i = 0;
+while (i < 3) {
+  i = i + 1;
+  print i * 2;
+}
+print missing * 2;
+]] "2\n4\n6\n" [[
+Undefined variable 'missing'.
+[line 6]
+]])
+
+# ---- evaluators bound to nodes ----
+
+# each node runs the evaluator bound for its shape; a + b is the
+# two-variable one
+expect_run(bound_evaluators [[
+var a = 1;
+var b = "b";
+var i = 0;
+while (i < 2) {
+  print (a) + (i);
+  print -a;
+  print a or b;
+  i = i + 1;
+}
+print a + b;
+]] "1\n-1\n1\n2\n-1\n1\n" [[
+Operands must be two numbers or two strings.
+[line 10]
+]])
+
+# -s and s * 2 are rebound to the hoisted evaluator, which must fail only
+# when reached
+expect_run(bound_hoisted_unary [[
+var s = "s";
+var i = 0;
+while (i < 2) {
+  i = i + 1;
+  if (i == 2) print -s;
+  print i;
+}
+]] "1\n" [[
+Operand must be a number.
+[line 5]
+]])
+
+expect_run(bound_hoisted_binary [[
+var s = "s";
+var i = 0;
+while (i < 2) {
+  i = i + 1;
+  if (i == 2) print s * 2;
+}
+]] "" [[
+Operands must be numbers.
+[line 5]
+]])
+
+expect_run(bound_call [[
+var f = "f";
+fun g(n) { return n; }
+print g(1);
+f(1);
+]] "1\n" [[
+Can only call functions and classes.
+[line 4]
+]])
+
+if(NOT failures STREQUAL "")
+  message(FATAL_ERROR "${failures}")
+endif()
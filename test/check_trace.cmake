@@ -0,0 +1,88 @@
+cmake_minimum_required(VERSION 3.19)
+
+# Runs a script with the INTERPRETER under --trace with no call threshold,
+# writing the trace into WORK_DIR, and fails unless the trace parses and has
+# the pipeline stages, the statement and a span for every call inside it.
+
+foreach(var IN ITEMS INTERPRETER WORK_DIR)
+  if(NOT DEFINED "${var}")
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+set(script "${WORK_DIR}/trace.lox")
+set(trace "${WORK_DIR}/trace.json")
+file(REMOVE "${trace}")
+file(WRITE "${script}" [[
+fun fib(n) {
+  if (n < 2) return n;
+  return fib(n - 1) + fib(n - 2);
+}
+print fib(5);
+]])
+execute_process(
+    COMMAND "${INTERPRETER}" "--trace=${trace}" --trace-threshold=0
+    "${script}"
+    RESULT_VARIABLE result
+    ERROR_VARIABLE errors
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "the script failed (${result}):\n${errors}")
+endif()
+
+# Timestamps are microseconds with three decimals, which string(JSON) gives
+# back as the nearest double; this rounds them to whole nanoseconds.
+function(to_ns value out)
+  if(NOT value MATCHES "^([0-9]+)(\\.([0-9]*))?$")
+    message(FATAL_ERROR "bad timestamp ${value}")
+  endif()
+  string(SUBSTRING "${CMAKE_MATCH_3}0000" 0 4 fraction)
+  math(EXPR ns "${CMAKE_MATCH_1} * 1000 + (1${fraction} - 10000 + 5) / 10")
+  set("${out}" "${ns}" PARENT_SCOPE)
+endfunction()
+
+file(READ "${trace}" json)
+string(JSON count LENGTH "${json}" traceEvents)
+math(EXPR last "${count} - 1")
+set(names "")
+set(calls "")
+foreach(i RANGE "${last}")
+  foreach(field IN ITEMS name cat ph ts dur)
+    string(JSON "${field}" GET "${json}" traceEvents "${i}" "${field}")
+  endforeach()
+  if(NOT ph STREQUAL "X")
+    message(FATAL_ERROR "event ${i} is '${ph}', not a complete event")
+  endif()
+  to_ns("${ts}" start)
+  to_ns("${dur}" length)
+  math(EXPR end "${start} + ${length}")
+  list(APPEND names "${cat}/${name}")
+  if(name STREQUAL "statement (line 5)")
+    set(statement_start "${start}")
+    set(statement_end "${end}")
+  elseif(cat STREQUAL "call")
+    list(APPEND calls "${name}:${start}:${end}")
+  endif()
+endforeach()
+
+foreach(expected IN ITEMS pipeline/load pipeline/scan pipeline/parse
+                          "execute/statement (line 5)")
+  if(NOT expected IN_LIST names)
+    message(FATAL_ERROR "no ${expected} span in ${names}")
+  endif()
+endforeach()
+list(LENGTH calls call_count)
+if(NOT call_count EQUAL 15)
+  message(FATAL_ERROR "${call_count} call spans, not one per call of fib")
+endif()
+foreach(call IN LISTS calls)
+  string(REPLACE ":" ";" call "${call}")
+  list(GET call 0 name)
+  list(GET call 1 start)
+  list(GET call 2 end)
+  if(NOT name STREQUAL "fib" OR start LESS statement_start
+     OR end GREATER statement_end)
+    message(FATAL_ERROR "call span ${name} ${start}..${end} is not inside "
+                        "the statement, ${statement_start}..${statement_end}")
+  endif()
+endforeach()
@@ -0,0 +1,42 @@
+cmake_minimum_required(VERSION 3.14)
+
+# Runs SCRIPT with the INTERPRETER and the COMPILED program written from it
+# by --emit-c, and fails unless both exit the same way and print the same,
+# errors included. Either may fail with a Lox error (exit code 65 or 70),
+# but not crash.
+
+foreach(var IN ITEMS INTERPRETER COMPILED SCRIPT)
+  if(NOT DEFINED "${var}")
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+execute_process(
+    COMMAND "${INTERPRETER}" "${SCRIPT}"
+    RESULT_VARIABLE interpreted_result
+    OUTPUT_VARIABLE interpreted
+    ERROR_VARIABLE interpreted_errors
+)
+execute_process(
+    COMMAND "${COMPILED}"
+    RESULT_VARIABLE compiled_result
+    OUTPUT_VARIABLE compiled
+    ERROR_VARIABLE compiled_errors
+)
+# the interpreter dumps the parsed statements first
+string(REGEX REPLACE "^.*--- END STATEMENTS ---\n" "" interpreted
+                     "${interpreted}")
+
+if(NOT interpreted_result MATCHES "^(0|65|70)$"
+   OR NOT interpreted_result STREQUAL compiled_result)
+  message(FATAL_ERROR "interpreter returned ${interpreted_result}, "
+                      "compiled program ${compiled_result}\n"
+                      "${compiled_errors}")
+endif()
+if(NOT interpreted STREQUAL compiled)
+  message(FATAL_ERROR "interpreted:\n${interpreted}\ncompiled:\n${compiled}")
+endif()
+if(NOT interpreted_errors STREQUAL compiled_errors)
+  message(FATAL_ERROR "interpreter errors:\n${interpreted_errors}\n"
+                      "compiled program errors:\n${compiled_errors}")
+endif()
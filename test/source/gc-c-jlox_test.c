@@ -1,13 +1,39 @@
 #include <lib.h>
+#include <private/alloc.h>
+#include <private/alloc_profiler.h>
 #include <private/ast/expr.h>
 #include <private/ast/printer.h>
+#include <private/environment.h>
+#include <private/gc_stats.h>
+#include <private/interpreter.h>
+#include <private/jit.h>
 #include <private/object.h>
+#include <private/parser.h>
+#include <private/scanner.h>
+#include <private/symbol.h>
+#include <private/weak_map.h>
+#include <stdio.h>
 #include <string.h>
 
 static int test_ast_printer(void);
+static int test_gc_stats(void);
+static int test_collector(void);
+static int test_weak_map(void);
+static int test_environment_cache(void);
+static int test_hoist(void);
+static int test_inliner(void);
+static int test_jit(void);
+static int test_call_depth(void);
+static int test_out_of_memory(void);
+static bool run_script(struct interpreter* interpreter, const char* source);
+static long run_loop(const char* source);
+#ifdef INTERPRETER_THREADS
+static int test_threads(void);
+#endif
 
 int main(int argc, const char* argv[])
 {
+  ALLOC_INIT();
   (void)argc;
   (void)argv;
 
@@ -16,6 +42,38 @@ int main(int argc, const char* argv[])
   if ((ret = test_ast_printer())) {
     return ret;
   }
+  if ((ret = test_gc_stats())) {
+    return ret;
+  }
+  if ((ret = test_collector())) {
+    return ret;
+  }
+  if ((ret = test_weak_map())) {
+    return ret;
+  }
+  if ((ret = test_environment_cache())) {
+    return ret;
+  }
+  if ((ret = test_hoist())) {
+    return ret;
+  }
+  if ((ret = test_inliner())) {
+    return ret;
+  }
+  if ((ret = test_jit())) {
+    return ret;
+  }
+  if ((ret = test_call_depth())) {
+    return ret;
+  }
+  if ((ret = test_out_of_memory())) {
+    return ret;
+  }
+#ifdef INTERPRETER_THREADS
+  if ((ret = test_threads())) {
+    return ret;
+  }
+#endif
   return 0;
 }
 
@@ -46,3 +104,497 @@ static int test_ast_printer(void)
   }
   return ret;
 }
+
+static int test_gc_stats(void)
+{
+  struct gc_stats before = gc_stats_get();
+  (void)OBJECT_NUMBER(1.5);
+  (void)OBJECT_NUMBER(2.5);
+  (void)expr_new_literal(OBJECT_NULL());
+  // shared, so not allocated
+  struct object* small = OBJECT_NUMBER(SMALL_NUMBER_MAX);
+  struct object* truth = object_new_bool(true);
+  struct gc_stats after = gc_stats_get();
+
+  size_t numbers = after.kinds[GC_STATS_KIND_NUMBER].count
+      - before.kinds[GC_STATS_KIND_NUMBER].count;
+  size_t exprs = after.kinds[GC_STATS_KIND_EXPR].count
+      - before.kinds[GC_STATS_KIND_EXPR].count;
+  if (numbers != 2 || exprs != 1 || small != OBJECT_NUMBER(SMALL_NUMBER_MAX)
+      || OBJECT_AS_NUMBER(small) != SMALL_NUMBER_MAX || truth != &ObjectTrue)
+  {
+    printf("numbers: %zu, exprs: %zu\n", numbers, exprs);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_collector(void)
+{
+  struct environment* globals = environment_new();
+  char* text = alloc_string(5);
+  memcpy(text, "hello", 5);
+  environment_define(globals, "s", object_new_string(text));
+  environment_define(globals, "n", OBJECT_NUMBER(0));
+  text = NULL;
+  alloc_collect();
+  // a young number stored into a table that is old by now
+  environment_define(globals, "n", OBJECT_NUMBER(42));
+  // enough garbage to make either collector run on its own
+  for (int i = 0; i < 1000000; ++i) {
+    (void)OBJECT_NUMBER(i);
+  }
+
+  struct token s = {.type = TOKEN_IDENTIFIER, .lexeme = "s", .line = 1};
+  struct token n = {.type = TOKEN_IDENTIFIER, .lexeme = "n", .line = 1};
+  struct environment_lookup_result string = environment_get(globals, &s);
+  struct environment_lookup_result number = environment_get(globals, &n);
+  if (!ENVIRONMENT_LOOKUP_RESULT_IS_OK(&string)
+      || !ENVIRONMENT_LOOKUP_RESULT_IS_OK(&number)
+      || strcmp(OBJECT_AS_STRING(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&string)),
+                "hello")
+          != 0
+      || OBJECT_AS_NUMBER(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&number)) != 42)
+  {
+    printf("reachable values did not survive a collection\n");
+    return 1;
+  }
+  if (alloc_size(globals) < sizeof(struct environment) || alloc_size(&s) != 0)
+  {
+    printf("alloc_size: %zu, %zu\n", alloc_size(globals), alloc_size(&s));
+    return 1;
+  }
+
+  // the kernel writing to memory that is old by now; the read is larger than
+  // stdio's buffer, so it goes straight into the heap
+  size_t length = 100000;
+  char* buffer = alloc_string(length);
+  alloc_collect();
+  FILE* file = tmpfile();
+  if (!file) {
+    printf("tmpfile failed\n");
+    return 1;
+  }
+  for (size_t i = 0; i < length; ++i) {
+    fputc('a' + (int)(i % 26), file);
+  }
+  rewind(file);
+  size_t nread = alloc_fread(buffer, length, file);
+  fclose(file);
+  if (nread != length || buffer[0] != 'a' || buffer[length - 1] != 'd') {
+    printf("read into the heap: %zu of %zu bytes\n", nread, length);
+    return 1;
+  }
+
+#ifdef ALLOC_PRECISE
+  // one survivor per nursery page must not keep the rest of the page from
+  // being allocated in again
+  void** survivors = NULL;
+  size_t count = 0;
+  for (int i = 0; i < 4000000; ++i) {
+    void** node = alloc_untyped(2 * sizeof(void*));
+    if (i % 2048 == 0) {
+      node[0] = survivors;
+      survivors = node;
+    }
+  }
+  for (void** node = survivors; node; node = node[0]) {
+    ++count;
+  }
+  size_t heap_size = alloc_get_heap_stats().heap_size;
+  if (count != 1954 || heap_size > (size_t)32 << 20) {
+    printf("%zu survivors took a heap of %zu bytes\n", count, heap_size);
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+static int test_weak_map(void)
+{
+  struct weak_map* map = weak_map_new();
+  struct object* kept = OBJECT_STRING("kept");
+  struct object* deleted = OBJECT_STRING("deleted");
+  weak_map_set(map, kept, OBJECT_NUMBER(1));
+  weak_map_set(map, deleted, OBJECT_NUMBER(2));
+  for (int i = 0; i < 1000; ++i) {
+    weak_map_set(map, OBJECT_STRING("dropped"), OBJECT_NUMBER(i));
+  }
+  alloc_collect();
+
+  // the stack may still hold a few of the dropped keys
+  size_t size = weak_map_size(map);
+  if (size < 2 || size > 100 || !weak_map_delete(map, deleted)
+      || weak_map_get(map, deleted) != NULL
+      || OBJECT_AS_NUMBER(weak_map_get(map, kept)) != 1)
+  {
+    printf("weak map: %zu entries survived a collection\n", size);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_environment_cache(void)
+{
+  struct environment* globals = environment_new();
+  struct environment* outer = environment_new_enclosed(globals);
+  struct environment* inner = environment_new_enclosed(outer);
+  struct token name = {
+      .type = TOKEN_IDENTIFIER,
+      .lexeme = "x",
+      .literal = OBJECT_NULL(),
+      .line = 1,
+  };
+  struct environment_cache cache = ENVIRONMENT_CACHE_EMPTY;
+
+  environment_define(globals, "x", OBJECT_NUMBER(1));
+  environment_define(globals, "x", OBJECT_NUMBER(2));
+  struct environment_lookup_result result =
+      environment_get_cached(inner, &name, &cache);
+  if (!ENVIRONMENT_LOOKUP_RESULT_IS_OK(&result)
+      || OBJECT_AS_NUMBER(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&result)) != 2)
+  {
+    printf("redefined global not found\n");
+    return 1;
+  }
+
+  // shadowing after the site was cached must not return the global
+  environment_define(outer, "x", OBJECT_NUMBER(3));
+  result = environment_get_cached(inner, &name, &cache);
+  if (!ENVIRONMENT_LOOKUP_RESULT_IS_OK(&result)
+      || OBJECT_AS_NUMBER(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&result)) != 3)
+  {
+    printf("shadowing definition not found\n");
+    return 1;
+  }
+
+  // closures made in calls keep their environments while pooled ones are
+  // reused by many calls and blocks around them
+  if (!run_script(interpreter_new(),
+                  "fun make(n) {\n"
+                  "  var twice = n * 2;\n"
+                  "  fun get() { return n + twice; }\n"
+                  "  return get;\n"
+                  "}\n"
+                  "fun wrap(n) { var m = n; return make(m); }\n"
+                  "fun churn(n, twice) { var get = n + twice; return get; }\n"
+                  "var first = make(1);\n"
+                  "var second = wrap(10);\n"
+                  "var i = 0;\n"
+                  "while (i < 1000) {\n"
+                  "  churn(i, -i);\n"
+                  "  { var n = i; var twice = -1; }\n"
+                  "  i = i + 1;\n"
+                  "}\n"
+                  "if (first() != 3 or second() != 30) wrong;\n"))
+  {
+    printf("a closure lost its environment to the pool\n");
+    return 1;
+  }
+  return 0;
+}
+
+static int test_hoist(void)
+{
+  static const struct {
+    const char* source;
+    long hoisted;
+  } loops[] = {
+      // a is read before the body assigns it; only k * 0 is invariant
+      {"var a = 1;\n"
+       "var k = 3;\n"
+       "var i = 0;\n"
+       "var sum = 0;\n"
+       "while (i < 3) { sum = sum + a * 2 + k * 0; a = a + 1; i = i + 1; }\n"
+       "if (sum != 12) wrong;\n",
+       1},
+      // a call has side effects, and the callee may assign any variable
+      {"var k = 1;\n"
+       "var calls = 0;\n"
+       "fun bump() { calls = calls + 1; k = k + 1; return 1; }\n"
+       "var i = 0;\n"
+       "var sum = 0;\n"
+       "while (i < 3) { sum = sum + k * 10 + (bump() - 1); i = i + 1; }\n"
+       "if (sum != 60 or calls != 3) wrong;\n",
+       0},
+      // the hoisted s - 1 must not fail when the body never runs
+      {"var s = \"a\";\n"
+       "var i = 0;\n"
+       "while (i < 0) { print s - 1; i = i + 1; }\n",
+       1},
+  };
+  for (size_t i = 0; i < sizeof loops / sizeof loops[0]; ++i) {
+    long hoisted = run_loop(loops[i].source);
+    if (hoisted != loops[i].hoisted) {
+      printf("loop %zu: %ld expressions hoisted\n", i, hoisted);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int test_inliner(void)
+{
+  // an inlined call must bind parameters as a call does: the last of
+  // duplicates wins
+  if (!run_script(interpreter_new(),
+                  "fun second(a, a) { return a; }\n"
+                  "if (second(1, 2) != 2) wrong;\n"))
+  {
+    printf("inlined call bound the first duplicate parameter\n");
+    return 1;
+  }
+  return 0;
+}
+
+static int test_jit(void)
+{
+  if (!jit_available()) {
+    return 0;
+  }
+  struct token x = {
+      .type = TOKEN_IDENTIFIER,
+      .lexeme = "x",
+      .literal = OBJECT_NULL(),
+      .line = 1,
+      .symbol = symbol_intern("x"),
+  };
+  struct token op = {
+      .type = TOKEN_STAR,
+      .lexeme = "*",
+      .literal = OBJECT_NULL(),
+      .line = 1,
+  };
+  struct token_list* params = token_list_new();
+  LIST_PUSH(params, x);
+  // fun f(x) { return x * 2; }
+  struct stmt_list* body = stmt_list_new();
+  LIST_PUSH(body,
+            (struct stmt*)stmt_new_return(
+                op,
+                (struct expr*)expr_new_binary(
+                    (struct expr*)expr_new_variable(x),
+                    op,
+                    (struct expr*)expr_new_literal(OBJECT_NUMBER(2)))));
+  jit_code code = jit_compile(stmt_new_function(x, params, body));
+  if (!code) {
+    printf("jit_compile failed\n");
+    return 1;
+  }
+
+  struct object* arguments[] = {OBJECT_NUMBER(21)};
+  double result = 0;
+  if (!code(arguments, &result) || result != 42) {
+    printf("jit result: %g\n", result);
+    return 1;
+  }
+  arguments[0] = OBJECT_STRING("21");
+  if (code(arguments, &result)) {
+    printf("jit guard passed a string\n");
+    return 1;
+  }
+
+  // locals, loops and comparisons; a path that returns nothing falls back
+  static const char loop[] =
+      "fun f(n) {\n"
+      "  var total = 0;\n"
+      "  for (var i = 1; i <= n; i = i + 1) {\n"
+      "    if (i == 3 or !(i < 5)) total = total + i; else total = total - 1;\n"
+      "  }\n"
+      "  if (n >= 0) return total;\n"
+      "}\n";
+  struct scanner* scanner = scanner_new(loop, loop + sizeof loop - 1);
+  struct stmt_list* statements =
+      parser_parse(parser_new(scanner_scan_tokens(scanner)));
+  code = jit_compile((struct function_stmt*)statements->pointer[0]);
+  if (!code) {
+    printf("jit_compile failed on a loop\n");
+    return 1;
+  }
+  arguments[0] = OBJECT_NUMBER(6);
+  // -1 - 1 + 3 - 1 + 5 + 6
+  if (!code(arguments, &result) || result != 11) {
+    printf("jit loop result: %g\n", result);
+    return 1;
+  }
+  arguments[0] = OBJECT_NUMBER(-1);
+  if (code(arguments, &result)) {
+    printf("jit returned a number for nil\n");
+    return 1;
+  }
+
+  // the inliner takes twice first, but must hand it over once it is hot
+  struct interpreter* interpreter = interpreter_new();
+  if (!run_script(interpreter,
+                  "fun twice(x) { return x * 2; }\n"
+                  "var i = 0;\n"
+                  "while (i < 2000) { twice(i); i = i + 1; }\n"))
+  {
+    printf("jit script failed\n");
+    return 1;
+  }
+  struct token twice = {
+      .type = TOKEN_IDENTIFIER,
+      .lexeme = "twice",
+      .literal = OBJECT_NULL(),
+      .line = 1,
+      .symbol = symbol_intern("twice"),
+  };
+  struct environment_lookup_result lookup =
+      environment_get(interpreter->globals, &twice);
+  if (!ENVIRONMENT_LOOKUP_RESULT_IS_OK(&lookup)) {
+    printf("twice not found\n");
+    return 1;
+  }
+  struct function_stmt* declaration =
+      OBJECT_AS_FUNCTION(ENVIRONMENT_LOOKUP_RESULT_GET_OK(&lookup)).declaration;
+  if (!declaration->jit_code) {
+    printf("inlined function was never compiled\n");
+    return 1;
+  }
+  // each call counts once, however it is made
+  if (declaration->calls != JIT_DEFAULT_THRESHOLD) {
+    printf("compiled after %lu calls\n", declaration->calls);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_call_depth(void)
+{
+  static const char format[] =
+      "fun r(n) { if (n > 1) r(n - 1); }\n"
+      "r(%ld);\n";
+  char source[sizeof format + 32];
+  struct interpreter* interpreter = interpreter_new();
+  long depth = interpreter->max_call_depth;
+  if (depth != interpreter_default_max_call_depth()) {
+    printf("max_call_depth: %ld\n", depth);
+    return 1;
+  }
+  snprintf(source, sizeof source, format, depth - 1);
+  if (!run_script(interpreter, source)) {
+    printf("recursion to depth %ld failed\n", depth - 1);
+    return 1;
+  }
+  // the reported error goes to stderr
+  snprintf(source, sizeof source, format, depth + 1);
+  if (run_script(interpreter, source)) {
+    printf("recursion to depth %ld succeeded\n", depth + 1);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_out_of_memory(void)
+{
+  struct interpreter* interpreter = interpreter_new();
+  alloc_profiler_enable();
+  size_t depth = alloc_profiler_depth();
+  size_t limit = alloc_get_heap_stats().heap_size + ((size_t)32 << 20);
+  alloc_set_max_heap_size(limit);
+  // the error goes to stderr
+  bool ran = run_script(interpreter,
+                        "var kept = 1;\n"
+                        "fun grow(s) { return s + s; }\n"
+                        "fun outgrow(s) { while (true) s = grow(s); }\n"
+                        "outgrow(\"x\");\n");
+  alloc_set_max_heap_size(0);
+  if (ran) {
+    printf("outgrew the heap without an error\n");
+    return 1;
+  }
+  // the recovery skipped leaving outgrow and grow
+  if (alloc_profiler_depth() != depth) {
+    printf("profiler left %zu calls deep\n", alloc_profiler_depth() - depth);
+    return 1;
+  }
+  if (!run_script(interpreter, "if (kept != 1) wrong;\n")) {
+    printf("interpreter unusable after running out of memory\n");
+    return 1;
+  }
+  return 0;
+}
+
+// returns whether the script ran without errors
+static bool run_script(struct interpreter* interpreter, const char* source)
+{
+  HadError = false;
+  HadRuntimeError = false;
+  struct scanner* scanner = scanner_new(source, source + strlen(source));
+  struct parser* parser = parser_new(scanner_scan_tokens(scanner));
+  struct stmt_list* statements = parser_parse(parser);
+  if (!HadError) {
+    interpret(interpreter, statements);
+  }
+  bool ok = !HadError && !HadRuntimeError;
+  HadError = false;
+  HadRuntimeError = false;
+  return ok;
+}
+
+// runs a script and returns how many expressions were hoisted out of its
+// first top-level while loop, or -1 if it failed
+static long run_loop(const char* source)
+{
+  struct scanner* scanner = scanner_new(source, source + strlen(source));
+  struct parser* parser = parser_new(scanner_scan_tokens(scanner));
+  struct stmt_list* statements = parser_parse(parser);
+  if (!HadError) {
+    interpret(interpreter_new(), statements);
+  }
+  bool ok = !HadError && !HadRuntimeError;
+  HadError = false;
+  HadRuntimeError = false;
+  for (long i = 0; ok && i < statements->length; ++i) {
+    if (statements->pointer[i]->type == STMT_WHILE) {
+      struct while_stmt* loop = (struct while_stmt*)statements->pointer[i];
+      return loop->invariants ? loop->invariants->length : 0;
+    }
+  }
+  return -1;
+}
+
+#ifdef INTERPRETER_THREADS
+#  define TEST_THREADS 4
+
+// returns non-NULL on failure
+static void* run_counter(void* arg)
+{
+  // fails with an undefined variable if the count comes out wrong
+  static const char source[] =
+      "fun count(n) { var i = 0; while (i < n) i = i + 1; return i; }\n"
+      "var total = 0;\n"
+      "var i = 0;\n"
+      "while (i < 50) { total = total + count(100); i = i + 1; }\n"
+      "if (total != 5000) wrong;\n";
+  struct scanner* scanner = scanner_new(source, source + sizeof source - 1);
+  struct parser* parser = parser_new(scanner_scan_tokens(scanner));
+  struct stmt_list* statements = parser_parse(parser);
+  if (!HadError) {
+    interpret(interpreter_new(), statements);
+  }
+  return HadError || HadRuntimeError ? arg : NULL;
+}
+
+static int test_threads(void)
+{
+  pthread_t threads[TEST_THREADS];
+  for (size_t i = 0; i < TEST_THREADS; ++i) {
+    if (pthread_create(&threads[i], NULL, run_counter, &threads[i]) != 0) {
+      printf("pthread_create failed\n");
+      return 1;
+    }
+  }
+  int ret = 0;
+  for (size_t i = 0; i < TEST_THREADS; ++i) {
+    void* failed;
+    pthread_join(threads[i], &failed);
+    if (failed) {
+      printf("thread %zu failed\n", i);
+      ret = 1;
+    }
+  }
+  return ret;
+}
+#endif